@@ -0,0 +1,542 @@
+/*
+
+Cycle counts of the firmware on simavr
+
+  bench .pio/build/bench/firmware.elf [report.json]
+
+Runs the BENCH build of the Leonardo image on a simulated ATmega32U4 at
+16 MHz. The relay board and the Grove LCD are stubbed on the TWI bus, the
+encoder and the button are driven on their pins. A fixed scenario goes
+through the main menu, every entry of the settings with edits, a save and
+the crash log, and then runs, pauses and resumes the cycle with short
+steps.
+
+The firmware marks its sections in GPIOR0 and the menu and run state in
+GPIOR1 and GPIOR2 (include/bench.h). Every section is counted per state
+and screen from its start mark to its end mark, so loop() comes out per
+menu and run state, updateMenu() per screen, the failsafe record per step
+change and the input interrupt as it is. The report is JSON, compare two
+with scripts/bench_compare.py.
+
+The scenario is deterministic and so are the counts, any difference to a
+baseline comes from the firmware.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <simavr/sim_avr.h>
+#include <simavr/sim_elf.h>
+#include <simavr/sim_io.h>
+#include <simavr/avr_ioport.h>
+#include <simavr/avr_twi.h>
+
+#define FREQUENCY 16000000UL
+#define CYCLES_PER_MS (FREQUENCY / 1000UL)
+
+/* Data space addresses of the marks on the ATmega32U4 */
+#define GPIOR0_ADDR 0x3E
+#define GPIOR1_ADDR 0x4A
+#define GPIOR2_ADDR 0x4B
+#define MARK_END 0x80
+
+/* USBDevice.attach() of the Arduino core sets PLLE and waits for PLOCK */
+#define PLLCSR_ADDR 0x49
+#define PLLCSR_PLOCK 0x01
+#define PLLCSR_PLLE 0x02
+
+/* The firmware's ProfileSections, in the same order */
+static const char *const section_names[] = {
+  "loop", "input", "action", "menu", "lcd",
+  "eeprom", "relay", "wdt", "input isr", "failsafe"
+};
+#define SECTIONS (sizeof(section_names) / sizeof(section_names[0]))
+
+static const char *const menu_names[] = {"main", "settings", "crashes", "?"};
+static const char *const run_names[] = {"stopped", "running", "paused", "?"};
+
+/* ---------------------------------------------------------------------
+   Counts per section, state and screen
+   --------------------------------------------------------------------- */
+
+struct section_stat
+{
+  uint8_t section;
+  uint8_t state;
+  uint8_t screen;
+  uint32_t runs;
+  uint64_t min;
+  uint64_t max;
+  uint64_t total;
+};
+
+#define MAX_STATS 512
+
+static struct section_stat stats[MAX_STATS];
+static unsigned stat_count;
+static unsigned stat_overflow;
+
+/* Start of the open sections, with the state and screen they started in */
+static avr_cycle_count_t started[MARK_END];
+static uint8_t started_state[MARK_END];
+static uint8_t started_screen[MARK_END];
+static uint8_t is_open[MARK_END];
+static uint8_t state;
+static uint8_t screen;
+
+static void count(uint8_t section, uint8_t in_state, uint8_t on_screen, uint64_t cycles)
+{
+  struct section_stat *s = NULL;
+  for (unsigned i = 0; i < stat_count; i++)
+    if (stats[i].section == section && stats[i].state == in_state
+        && stats[i].screen == on_screen)
+      s = &stats[i];
+  if (!s)
+  {
+    if (stat_count == MAX_STATS)
+    {
+      stat_overflow++;
+      return;
+    }
+    s = &stats[stat_count++];
+    s->section = section;
+    s->state = in_state;
+    s->screen = on_screen;
+    s->min = cycles;
+  }
+  s->runs++;
+  s->total += cycles;
+  if (cycles < s->min)
+    s->min = cycles;
+  if (cycles > s->max)
+    s->max = cycles;
+}
+
+static void mark_write(struct avr_t *avr, avr_io_addr_t addr, uint8_t v, void *param)
+{
+  (void) param;
+  /* with a write hook the register isn't written by the core */
+  avr->data[addr] = v;
+  if (addr == GPIOR1_ADDR)
+  {
+    state = v;
+    return;
+  }
+  if (addr == GPIOR2_ADDR)
+  {
+    screen = v;
+    return;
+  }
+  uint8_t id = v & ~MARK_END;
+  if (!(v & MARK_END))
+  {
+    started[id] = avr->cycle;
+    started_state[id] = state;
+    started_screen[id] = screen;
+    is_open[id] = 1;
+  }
+  else if (is_open[id])
+  {
+    is_open[id] = 0;
+    count(id, started_state[id], started_screen[id], avr->cycle - started[id]);
+  }
+}
+
+/* ---------------------------------------------------------------------
+   TWI: the relay board and the Grove LCD RGB Backlight
+   --------------------------------------------------------------------- */
+
+/* Multi Channel Relay commands */
+#define CMD_CHANNEL_CTRL 0x10
+#define CMD_SAVE_I2C_ADDR 0x11
+#define CMD_READ_I2C_ADDR 0x12
+#define CMD_READ_FIRMWARE_VER 0x13
+
+#define LCD_ADDRESS 0x3E
+#define RGB_ADDRESS 0x62
+#define RGB_ADDRESS_V5 0x30
+
+struct twi_stub
+{
+  avr_irq_t *irq;
+  /* 7 bit address of the relay board, it moves at boot */
+  uint8_t relay_address;
+  uint8_t relay_mask;
+  uint8_t relay_command;
+  /* 8 bit address of the transaction, 0 if none is addressed */
+  uint8_t selected;
+  /* bytes written in the transaction */
+  uint8_t written;
+  uint32_t relay_writes;
+  uint32_t lcd_bytes;
+};
+
+static struct twi_stub twi;
+
+static const char *twi_irq_names[2] = {"8<bench.twi.in", "32>bench.twi.out"};
+
+static int twi_acks(uint8_t address)
+{
+  return address == twi.relay_address || address == LCD_ADDRESS
+    || address == RGB_ADDRESS || address == RGB_ADDRESS_V5;
+}
+
+static void twi_relay_byte(uint8_t data)
+{
+  if (twi.written == 0)
+  {
+    twi.relay_command = data;
+    return;
+  }
+  if (twi.written == 1 && twi.relay_command == CMD_CHANNEL_CTRL)
+  {
+    twi.relay_mask = data;
+    twi.relay_writes++;
+  }
+  else if (twi.written == 1 && twi.relay_command == CMD_SAVE_I2C_ADDR)
+  {
+    twi.relay_address = data;
+  }
+}
+
+static void twi_out_hook(struct avr_irq_t *irq, uint32_t value, void *param)
+{
+  (void) irq;
+  (void) param;
+  avr_twi_msg_irq_t msg;
+  msg.u.v = value;
+
+  if (msg.u.twi.msg & TWI_COND_STOP)
+    twi.selected = 0;
+  if (msg.u.twi.msg & TWI_COND_START)
+  {
+    twi.selected = 0;
+    twi.written = 0;
+  }
+  if (msg.u.twi.msg & TWI_COND_ADDR)
+  {
+    twi.written = 0;
+    if (twi_acks(msg.u.twi.addr >> 1))
+    {
+      twi.selected = msg.u.twi.addr;
+      avr_raise_irq(twi.irq + TWI_IRQ_INPUT,
+                    avr_twi_irq_msg(TWI_COND_ACK, twi.selected, 1));
+    }
+  }
+  if (!twi.selected)
+    return;
+  uint8_t address = twi.selected >> 1;
+  if (msg.u.twi.msg & TWI_COND_WRITE)
+  {
+    avr_raise_irq(twi.irq + TWI_IRQ_INPUT,
+                  avr_twi_irq_msg(TWI_COND_ACK, twi.selected, 1));
+    if (address == twi.relay_address)
+      twi_relay_byte(msg.u.twi.data);
+    else
+      twi.lcd_bytes++;
+    twi.written++;
+  }
+  if (msg.u.twi.msg & TWI_COND_READ)
+  {
+    /* the board answers according to the last command */
+    uint8_t data = 0;
+    if (address == twi.relay_address)
+    {
+      data = twi.relay_mask;
+      if (twi.relay_command == CMD_READ_I2C_ADDR)
+        data = twi.relay_address;
+      else if (twi.relay_command == CMD_READ_FIRMWARE_VER)
+        data = 0x01;
+    }
+    avr_raise_irq(twi.irq + TWI_IRQ_INPUT,
+                  avr_twi_irq_msg(TWI_COND_READ, twi.selected, data));
+  }
+}
+
+static void twi_init(avr_t *avr)
+{
+  memset(&twi, 0, sizeof(twi));
+  /* the address a new board comes with */
+  twi.relay_address = 0x11;
+  twi.irq = avr_alloc_irq(&avr->irq_pool, 0, 2, twi_irq_names);
+  avr_irq_register_notify(twi.irq + TWI_IRQ_OUTPUT, twi_out_hook, NULL);
+  avr_connect_irq(twi.irq + TWI_IRQ_INPUT,
+                  avr_io_getirq(avr, AVR_IOCTL_TWI_GETIRQ(0), TWI_IRQ_INPUT));
+  avr_connect_irq(avr_io_getirq(avr, AVR_IOCTL_TWI_GETIRQ(0), TWI_IRQ_OUTPUT),
+                  twi.irq + TWI_IRQ_OUTPUT);
+}
+
+/* ---------------------------------------------------------------------
+   Inputs: encoder on A0 (PF7) and A1 (PF6), button on D5 (PC6)
+   --------------------------------------------------------------------- */
+
+#define EDGE_MS 3
+/* Detents of one input start this far apart, slower than the firmware's
+   acceleration (kFastMs), so every detent of an edit counts once */
+#define DETENT_MS 120
+#define PRESS_MS 200
+
+static avr_irq_t *encoder_a;
+static avr_irq_t *encoder_b;
+static avr_irq_t *button;
+
+enum kind { TURN, PRESS, END };
+
+struct input
+{
+  uint32_t at_ms;
+  enum kind kind;
+  int detents;
+  const char *note;
+};
+
+/*
+The scenario. The main menu opens on Start, the settings on Return, in
+them Filtration, Gas-Jet, Pressure relief and Waiting follow. Filtration
+gets 5 s, Gas-Jet 3 s, Pressure relief 2 s, with the close-all steps of
+2 s a cycle takes 14 s. After the resume the run goes on for a whole
+cycle, so every step change and its failsafe record are counted while
+the cycle runs on its own.
+*/
+static const struct input scenario[] = {
+  {1000, TURN, 1, "main: Settings"},
+  {1500, PRESS, 0, "settings: Return"},
+  {2000, TURN, 1, "Filtration"},
+  {2500, PRESS, 0, "edit the minutes"},
+  {3000, PRESS, 0, "edit the seconds"},
+  {3500, TURN, 5, "5 s"},
+  {4000, PRESS, 0, "done"},
+  {4500, TURN, 1, "Gas-Jet"},
+  {5000, PRESS, 0, "edit the minutes"},
+  {5500, PRESS, 0, "edit the seconds"},
+  {6000, TURN, 3, "3 s"},
+  {6500, PRESS, 0, "done"},
+  {7000, TURN, 1, "Pressure relief"},
+  {7500, PRESS, 0, "edit the minutes"},
+  {8000, PRESS, 0, "edit the seconds"},
+  {8500, TURN, 2, "2 s"},
+  {9000, PRESS, 0, "done"},
+  {9500, TURN, 1, "Waiting"},
+  {10000, TURN, 1, "Save Settings"},
+  {10500, PRESS, 0, "save"},
+  {11000, TURN, 1, "Load Settings"},
+  {11500, TURN, 1, "Reset Cycles"},
+  {12000, TURN, 1, "Crashes"},
+  {12500, PRESS, 0, "crash log"},
+  {13000, TURN, 1, "crash log: Return"},
+  {13500, PRESS, 0, "settings: Crashes"},
+  {14000, TURN, 1, "Return, wrapped"},
+  {14500, PRESS, 0, "main"},
+  {15000, TURN, -1, "Start"},
+  {15500, PRESS, 0, "start"},
+  {45500, PRESS, 0, "stop"},
+  {48000, PRESS, 0, "resume"},
+  {66000, END, 0, NULL}
+};
+
+/* Pending pin edges of the current input */
+struct edge
+{
+  avr_cycle_count_t at;
+  avr_irq_t *pin;
+  uint8_t level;
+};
+
+#define MAX_EDGES 64
+
+static struct edge edges[MAX_EDGES];
+static unsigned edge_count;
+static unsigned edge_next;
+static uint8_t quadrature = 3;
+
+static void schedule(avr_cycle_count_t at, avr_irq_t *pin, uint8_t level)
+{
+  if (edge_count == MAX_EDGES)
+  {
+    fprintf(stderr, "bench: too many edges in one input\n");
+    exit(1);
+  }
+  edges[edge_count].at = at;
+  edges[edge_count].pin = pin;
+  edges[edge_count].level = level;
+  edge_count++;
+}
+
+static void start_input(const struct input *input, avr_cycle_count_t now)
+{
+  /* Gray code order of A << 1 | B, turning right A changes first */
+  static const uint8_t right[4] = {2, 0, 3, 1};
+  static const uint8_t left[4] = {1, 3, 0, 2};
+  edge_count = 0;
+  edge_next = 0;
+  if (input->kind == PRESS)
+  {
+    schedule(now, button, 0);
+    schedule(now + PRESS_MS * CYCLES_PER_MS, button, 1);
+    return;
+  }
+  avr_cycle_count_t at = now;
+  int steps = 4 * abs(input->detents);
+  for (int i = 0; i < steps; i++)
+  {
+    if (i && i % 4 == 0)
+      at += (DETENT_MS - 4 * EDGE_MS) * CYCLES_PER_MS;
+    uint8_t next = input->detents > 0 ? right[quadrature] : left[quadrature];
+    uint8_t changed = next ^ quadrature;
+    at += EDGE_MS * CYCLES_PER_MS;
+    if (changed & 2)
+      schedule(at, encoder_a, (next >> 1) & 1);
+    else
+      schedule(at, encoder_b, next & 1);
+    quadrature = next;
+  }
+}
+
+/* ---------------------------------------------------------------------
+   Report
+   --------------------------------------------------------------------- */
+
+static int compare_stats(const void *a, const void *b)
+{
+  const struct section_stat *x = a, *y = b;
+  if (x->section != y->section)
+    return x->section - y->section;
+  if (x->state != y->state)
+    return x->state - y->state;
+  return x->screen - y->screen;
+}
+
+static void report(FILE *out, const char *firmware, avr_cycle_count_t cycles)
+{
+  qsort(stats, stat_count, sizeof(stats[0]), compare_stats);
+  fprintf(out, "{\n");
+  fprintf(out, "  \"firmware\": \"%s\",\n", firmware);
+  fprintf(out, "  \"mcu\": \"atmega32u4\",\n");
+  fprintf(out, "  \"frequency\": %lu,\n", FREQUENCY);
+  fprintf(out, "  \"cycles\": %llu,\n", (unsigned long long) cycles);
+  fprintf(out, "  \"relay_writes\": %u,\n", twi.relay_writes);
+  fprintf(out, "  \"lcd_bytes\": %u,\n", twi.lcd_bytes);
+  fprintf(out, "  \"sections\": [");
+  for (unsigned i = 0; i < stat_count; i++)
+  {
+    const struct section_stat *s = &stats[i];
+    char unknown[8];
+    const char *name = unknown;
+    if (s->section < SECTIONS)
+      name = section_names[s->section];
+    else
+      snprintf(unknown, sizeof(unknown), "%u", s->section);
+    fprintf(out, "%s\n    {\"section\": \"%s\", \"menu\": \"%s\", \"editing\": %u, "
+            "\"run\": \"%s\", \"entry\": %u, \"position\": %u, \"runs\": %u, "
+            "\"min\": %llu, \"mean\": %llu, \"max\": %llu}",
+            i ? "," : "", name,
+            menu_names[(s->state >> 4) < 3 ? s->state >> 4 : 3],
+            (s->state >> 3) & 1,
+            run_names[(s->state & 7) < 3 ? s->state & 7 : 3],
+            s->screen >> 4, s->screen & 0x0F, s->runs,
+            (unsigned long long) s->min,
+            (unsigned long long) (s->total / s->runs),
+            (unsigned long long) s->max);
+  }
+  fprintf(out, "\n  ]\n}\n");
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc < 2 || argc > 3)
+  {
+    fprintf(stderr, "usage: %s firmware.elf [report.json]\n", argv[0]);
+    return 2;
+  }
+
+  elf_firmware_t firmware;
+  memset(&firmware, 0, sizeof(firmware));
+  if (elf_read_firmware(argv[1], &firmware))
+  {
+    fprintf(stderr, "bench: can't read %s\n", argv[1]);
+    return 1;
+  }
+  avr_t *avr = avr_make_mcu_by_name("atmega32u4");
+  if (!avr)
+  {
+    fprintf(stderr, "bench: no atmega32u4 in this simavr\n");
+    return 1;
+  }
+  avr_init(avr);
+  avr->frequency = FREQUENCY;
+  avr_load_firmware(avr, &firmware);
+
+  avr_register_io_write(avr, GPIOR0_ADDR, mark_write, NULL);
+  avr_register_io_write(avr, GPIOR1_ADDR, mark_write, NULL);
+  avr_register_io_write(avr, GPIOR2_ADDR, mark_write, NULL);
+  twi_init(avr);
+
+  encoder_a = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('F'), 7);
+  encoder_b = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('F'), 6);
+  button = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('C'), 6);
+  /* idle levels: detent of the encoder, button released */
+  avr_raise_irq(encoder_a, 1);
+  avr_raise_irq(encoder_b, 1);
+  avr_raise_irq(button, 1);
+
+  const struct input *input = scenario;
+  avr_cycle_count_t next = input->at_ms * CYCLES_PER_MS;
+  int cpu = cpu_Running;
+  while (cpu != cpu_Done && cpu != cpu_Crashed)
+  {
+    cpu = avr_run(avr);
+    /* Without the USB module of simavr nothing locks the PLL and the boot
+       spins forever. Nothing is connected to the port, Serial drops what
+       the firmware writes. */
+    uint8_t pll = avr->data[PLLCSR_ADDR];
+    if ((pll & PLLCSR_PLLE) && !(pll & PLLCSR_PLOCK))
+      avr->data[PLLCSR_ADDR] = pll | PLLCSR_PLOCK;
+    while (edge_next < edge_count && avr->cycle >= edges[edge_next].at)
+    {
+      avr_raise_irq(edges[edge_next].pin, edges[edge_next].level);
+      edge_next++;
+    }
+    if (avr->cycle < next)
+      continue;
+    if (input->kind == END)
+      break;
+    start_input(input, avr->cycle);
+    input++;
+    next = input->at_ms * CYCLES_PER_MS;
+  }
+  if (cpu == cpu_Done || cpu == cpu_Crashed)
+  {
+    fprintf(stderr, "bench: the firmware stopped after %s at %llu cycles\n",
+            input > scenario ? input[-1].note : "boot",
+            (unsigned long long) avr->cycle);
+    return 1;
+  }
+  if (!stat_count)
+  {
+    fprintf(stderr, "bench: the firmware never marked a section, stuck at pc 0x%04x\n",
+            (unsigned) avr->pc);
+    return 1;
+  }
+  if (!twi.relay_writes)
+  {
+    fprintf(stderr, "bench: the relay board was never switched\n");
+    return 1;
+  }
+
+  FILE *out = stdout;
+  if (argc == 3 && !(out = fopen(argv[2], "w")))
+  {
+    perror(argv[2]);
+    return 1;
+  }
+  report(out, argv[1], avr->cycle);
+  if (out != stdout)
+    fclose(out);
+  if (stat_overflow)
+    fprintf(stderr, "bench: %u counts didn't fit\n", stat_overflow);
+  fprintf(stderr, "bench: %u sections and states in %llu cycles\n",
+          stat_count, (unsigned long long) avr->cycle);
+  return 0;
+}
@@ -0,0 +1,119 @@
+#include "Arduino.h"
+#include "sim.h"
+
+HostSerial Serial;
+
+uint32_t millis()
+{
+  return (uint32_t) (sim::uptime_us() / 1000ULL);
+}
+
+uint32_t micros()
+{
+  return (uint32_t) sim::uptime_us();
+}
+
+void delay(uint32_t ms)
+{
+  sim::advance_us((uint64_t) ms * 1000ULL);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+  sim::advance_us(us);
+}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+  (void) pin;
+  (void) mode;
+}
+
+int digitalRead(uint8_t pin)
+{
+  return sim::pin_read(pin);
+}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+  sim::pin_write(pin, value);
+}
+
+size_t Print::write(const char *str)
+{
+  return str ? write((const uint8_t *) str, strlen(str)) : 0;
+}
+
+size_t Print::write(const uint8_t *buffer, size_t size)
+{
+  size_t n = 0;
+  while (size--)
+    n += write(*buffer++);
+  return n;
+}
+
+size_t Print::print(const __FlashStringHelper *str) { return write((const char *) str); }
+size_t Print::print(const char str[]) { return write(str); }
+size_t Print::print(char c) { return write((uint8_t) c); }
+size_t Print::print(unsigned char n, int base) { return printNumber(n, base); }
+size_t Print::print(unsigned int n, int base) { return printNumber(n, base); }
+size_t Print::print(unsigned long n, int base) { return printNumber(n, base); }
+size_t Print::print(int n, int base) { return print((long) n, base); }
+
+size_t Print::print(long n, int base)
+{
+  if (base == DEC && n < 0)
+    return write('-') + printNumber((unsigned long) -n, base);
+  return printNumber((unsigned long) n, base);
+}
+
+size_t Print::println() { return write('\r') + write('\n'); }
+size_t Print::println(const __FlashStringHelper *str) { return print(str) + println(); }
+size_t Print::println(const char str[]) { return print(str) + println(); }
+size_t Print::println(char c) { return print(c) + println(); }
+size_t Print::println(unsigned char n, int base) { return print(n, base) + println(); }
+size_t Print::println(int n, int base) { return print(n, base) + println(); }
+size_t Print::println(unsigned int n, int base) { return print(n, base) + println(); }
+size_t Print::println(long n, int base) { return print(n, base) + println(); }
+size_t Print::println(unsigned long n, int base) { return print(n, base) + println(); }
+
+size_t Print::printNumber(unsigned long n, int base)
+{
+  char buf[8 * sizeof(long) + 1];
+  char *str = &buf[sizeof(buf) - 1];
+  *str = '\0';
+  if (base < 2)
+    base = 10;
+  do
+  {
+    char c = n % base;
+    n /= base;
+    *--str = c < 10 ? c + '0' : c + 'A' - 10;
+  } while (n);
+  return write(str);
+}
+
+size_t HostSerial::write(uint8_t c)
+{
+  return sim::serial_write(&c, 1);
+}
+
+size_t HostSerial::write(const uint8_t *buffer, size_t size)
+{
+  return sim::serial_write(buffer, size);
+}
+
+int HostSerial::availableForWrite()
+{
+  return sim::serial_space();
+}
+
+int HostSerial::available()
+{
+  return sim::serial_available();
+}
+
+int HostSerial::read()
+{
+  return sim::serial_read();
+}
@@ -0,0 +1,117 @@
+/*
+
+Host stand-in for the Arduino core
+
+Only the part of the API used by the firmware is provided. Time is taken
+from the virtual clock in sim.h, so millis() wraps at 2^32 like on the AVR.
+
+*/
+
+#ifndef ARDUINO_HOST_H
+#define ARDUINO_HOST_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "avr/io.h"
+#include "avr/interrupt.h"
+#include "avr/pgmspace.h"
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 0x1
+#define LOW 0x0
+
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+// Arduino Leonardo pin numbers
+#define A0 18
+#define A1 19
+#define A2 20
+#define A3 21
+#define A4 22
+#define A5 23
+#define NUM_DIGITAL_PINS 31
+// ADC channel of A0 + P, the simulator has a single analog input
+#define analogPinToChannel(P) (P)
+
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void delayMicroseconds(unsigned int us);
+
+// A string in flash, print() reads it with the _P functions
+class __FlashStringHelper;
+#define F(s) ((const __FlashStringHelper *) PSTR(s))
+
+void pinMode(uint8_t pin, uint8_t mode);
+int digitalRead(uint8_t pin);
+void digitalWrite(uint8_t pin, uint8_t value);
+
+class Print
+{
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  size_t write(const char *str);
+  virtual size_t write(const uint8_t *buffer, size_t size);
+  virtual int availableForWrite() { return 0; }
+
+  size_t print(const __FlashStringHelper *str);
+  size_t print(const char str[]);
+  size_t print(char c);
+  size_t print(unsigned char n, int base = DEC);
+  size_t print(int n, int base = DEC);
+  size_t print(unsigned int n, int base = DEC);
+  size_t print(long n, int base = DEC);
+  size_t print(unsigned long n, int base = DEC);
+
+  size_t println();
+  size_t println(const __FlashStringHelper *str);
+  size_t println(const char str[]);
+  size_t println(char c);
+  size_t println(unsigned char n, int base = DEC);
+  size_t println(int n, int base = DEC);
+  size_t println(unsigned int n, int base = DEC);
+  size_t println(long n, int base = DEC);
+  size_t println(unsigned long n, int base = DEC);
+
+private:
+  size_t printNumber(unsigned long n, int base);
+};
+
+class Stream : public Print
+{
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+};
+
+class HostSerial : public Stream
+{
+public:
+  void begin(unsigned long baud) { (void) baud; }
+  operator bool() const { return true; }
+  int available();
+  int read();
+  size_t write(uint8_t c);
+  // stops at the first byte the port doesn't take
+  size_t write(const uint8_t *buffer, size_t size);
+  // bytes a write() takes without blocking
+  int availableForWrite();
+  using Print::write;
+};
+
+extern HostSerial Serial;
+
+#endif
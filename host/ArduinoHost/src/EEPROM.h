@@ -0,0 +1,39 @@
+#ifndef EEPROM_HOST_H
+#define EEPROM_HOST_H
+
+#include "Arduino.h"
+#include "sim.h"
+
+// 1 KB EEPROM of the ATmega32U4. The cells live in the simulator so they
+// survive the simulated power cycles.
+struct EEPROMClass
+{
+  uint8_t read(int idx) { return sim::eeprom_read(idx); }
+  void write(int idx, uint8_t val) { sim::eeprom_write(idx, val); }
+  void update(int idx, uint8_t val)
+  {
+    if (read(idx) != val)
+      write(idx, val);
+  }
+  uint16_t length() { return sim::kEEPROMSize; }
+
+  template <typename T> T &get(int idx, T &t)
+  {
+    uint8_t *ptr = (uint8_t *) &t;
+    for (int count = sizeof(T); count; --count, ++idx)
+      *ptr++ = read(idx);
+    return t;
+  }
+
+  template <typename T> const T &put(int idx, const T &t)
+  {
+    const uint8_t *ptr = (const uint8_t *) &t;
+    for (int count = sizeof(T); count; --count, ++idx)
+      update(idx, *ptr++);
+    return t;
+  }
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
@@ -0,0 +1,34 @@
+#include "Wire.h"
+#include "sim.h"
+
+TwoWire Wire;
+
+void TwoWire::beginTransmission(uint8_t address)
+{
+  tx_address = address;
+  tx_length = 0;
+}
+
+size_t TwoWire::write(uint8_t value)
+{
+  if (tx_length >= kBufferSize)
+    return 0;
+  tx_buffer[tx_length++] = value;
+  return 1;
+}
+
+uint8_t TwoWire::endTransmission(bool stop)
+{
+  (void) stop;
+  return sim::i2c_write(tx_address, tx_buffer, tx_length);
+}
+
+uint8_t TwoWire::requestFrom(uint8_t address, uint8_t quantity, bool stop)
+{
+  (void) stop;
+  if (quantity > kBufferSize)
+    quantity = kBufferSize;
+  rx_length = sim::i2c_read(address, rx_buffer, quantity);
+  rx_position = 0;
+  return rx_length;
+}
@@ -0,0 +1,36 @@
+#ifndef WIRE_HOST_H
+#define WIRE_HOST_H
+
+#include "Arduino.h"
+
+// The transactions go to the devices modelled by the simulator. The LCD
+// stand-in reports its traffic directly and doesn't use this object.
+class TwoWire
+{
+public:
+  static const uint8_t kBufferSize = 32;
+
+  void begin() {}
+  void setClock(uint32_t clock) { (void) clock; }
+
+  void beginTransmission(uint8_t address);
+  size_t write(uint8_t value);
+  // 0 on success, 2 if the address was not acknowledged
+  uint8_t endTransmission(bool stop = true);
+
+  uint8_t requestFrom(uint8_t address, uint8_t quantity, bool stop = true);
+  int available() { return rx_length - rx_position; }
+  int read() { return rx_position < rx_length ? rx_buffer[rx_position++] : -1; }
+
+private:
+  uint8_t tx_address = 0;
+  uint8_t tx_buffer[kBufferSize];
+  uint8_t tx_length = 0;
+  uint8_t rx_buffer[kBufferSize];
+  uint8_t rx_length = 0;
+  uint8_t rx_position = 0;
+};
+
+extern TwoWire Wire;
+
+#endif
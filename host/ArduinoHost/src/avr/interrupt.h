@@ -0,0 +1,15 @@
+#ifndef AVR_INTERRUPT_HOST_H
+#define AVR_INTERRUPT_HOST_H
+
+// The simulator calls the handlers from its virtual clock, they never
+// preempt loop() in the middle of a statement
+#define ISR(vector) extern "C" void vector()
+#define TIMER0_COMPA_vect sim_timer0_compa_vect
+#define TIMER1_OVF_vect sim_timer1_ovf_vect
+#define ADC_vect sim_adc_vect
+#define WDT_vect sim_wdt_vect
+
+inline void cli() {}
+inline void sei() {}
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef AVR_IO_HOST_H
+#define AVR_IO_HOST_H
+
+#include <stdint.h>
+
+// Timer0 registers the firmware touches, the simulator reads them
+extern volatile uint8_t TIMSK0;
+extern volatile uint8_t OCR0A;
+
+#define TOIE0 0
+#define OCIE0A 1
+#define OCIE0B 2
+
+// Timer1, TCNT1 counts on the virtual clock with the prescaler selected
+// in TCCR1B, starting at boot
+extern volatile uint8_t TCCR1A;
+extern volatile uint8_t TCCR1B;
+extern volatile uint8_t TIMSK1;
+extern volatile uint8_t TIFR1;
+
+struct HostTimer1Counter
+{
+  operator uint16_t() const;
+  HostTimer1Counter &operator=(uint16_t value);
+};
+extern HostTimer1Counter TCNT1;
+
+#define CS10 0
+#define CS11 1
+#define CS12 2
+#define TOIE1 0
+#define TOV1 0
+
+// ADC, the simulator converts when the trigger selected in ADCSRB fires
+// and ADC holds the result
+extern volatile uint8_t ADMUX;
+extern volatile uint8_t ADCSRA;
+extern volatile uint8_t ADCSRB;
+extern volatile uint8_t DIDR0;
+extern volatile uint8_t DIDR2;
+extern volatile uint16_t ADC;
+
+#define MUX0 0
+#define ADLAR 5
+#define REFS0 6
+#define REFS1 7
+#define ADPS0 0
+#define ADPS1 1
+#define ADPS2 2
+#define ADIE 3
+#define ADIF 4
+#define ADATE 5
+#define ADSC 6
+#define ADEN 7
+#define ADTS0 0
+#define ADTS1 1
+#define ADTS2 2
+#define ADTS3 3
+#define MUX5 5
+
+// Reset cause, set by the simulator at boot: PORF after a power cycle,
+// WDRF after a watchdog reset
+extern volatile uint8_t MCUSR;
+
+#define PORF 0
+#define EXTRF 1
+#define BORF 2
+#define WDRF 3
+
+// With WDIE the first watchdog timeout calls the handler and clears it,
+// the next one resets
+extern volatile uint8_t WDTCSR;
+
+#define WDE 3
+#define WDIE 6
+
+// Interrupts are never pending on the host, the I bit is only kept
+extern volatile uint8_t SREG;
+
+#ifndef _BV
+#define _BV(bit) (1 << (bit))
+#endif
+
+#endif
@@ -0,0 +1,27 @@
+/*
+
+Host stand-in for avr/pgmspace.h
+
+Flash and RAM share one address space on the host, so PROGMEM data is
+read like any other and the _P functions are the plain ones.
+
+*/
+
+#ifndef AVR_PGMSPACE_HOST_H
+#define AVR_PGMSPACE_HOST_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define PSTR(s) (s)
+
+#define pgm_read_byte(address) (*(const uint8_t *) (address))
+#define pgm_read_word(address) (*(const uint16_t *) (address))
+#define pgm_read_ptr(address) (*(void *const *) (address))
+
+#define memcpy_P memcpy
+#define strlen_P strlen
+#define strcpy_P strcpy
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef AVR_SLEEP_HOST_H
+#define AVR_SLEEP_HOST_H
+
+#include <stdint.h>
+
+#define SLEEP_MODE_IDLE 0
+
+inline void set_sleep_mode(unsigned char mode) { (void) mode; }
+inline void sleep_enable() {}
+inline void sleep_disable() {}
+// The simulator moves the clock on to the next interrupt
+void sleep_cpu();
+// Host only: the sleep ends once millis() reaches ms, until then the
+// simulator may skip the interrupts that change nothing
+void sleep_deadline(uint32_t ms);
+
+#endif
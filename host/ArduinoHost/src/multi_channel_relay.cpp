@@ -0,0 +1,50 @@
+#include "multi_channel_relay.h"
+#include "Wire.h"
+
+uint8_t Multi_Channel_Relay::scanI2CDevice()
+{
+  for (uint8_t address = 1; address < 127; address++)
+  {
+    Wire.beginTransmission(address);
+    if (Wire.endTransmission() == 0)
+      return address;
+  }
+  return 0;
+}
+
+void Multi_Channel_Relay::changeI2CAddress(uint8_t old_addr, uint8_t new_addr)
+{
+  Wire.beginTransmission(old_addr);
+  Wire.write(CMD_SAVE_I2C_ADDR);
+  Wire.write(new_addr);
+  Wire.endTransmission();
+  device_address = new_addr;
+}
+
+uint8_t Multi_Channel_Relay::getFirmwareVersion()
+{
+  Wire.beginTransmission(device_address);
+  Wire.write(CMD_READ_FIRMWARE_VER);
+  Wire.endTransmission();
+  Wire.requestFrom(device_address, (uint8_t) 1);
+  return Wire.read();
+}
+
+void Multi_Channel_Relay::channelCtrl(uint8_t state)
+{
+  channel_state = state;
+  Wire.beginTransmission(device_address);
+  Wire.write(CMD_CHANNEL_CTRL);
+  Wire.write(channel_state);
+  Wire.endTransmission();
+}
+
+void Multi_Channel_Relay::turn_on_channel(uint8_t channel)
+{
+  channelCtrl(channel_state | (1 << (channel - 1)));
+}
+
+void Multi_Channel_Relay::turn_off_channel(uint8_t channel)
+{
+  channelCtrl(channel_state & ~(1 << (channel - 1)));
+}
@@ -0,0 +1,40 @@
+#ifndef MULTI_CHANNEL_RELAY_HOST_H
+#define MULTI_CHANNEL_RELAY_HOST_H
+
+#include "Arduino.h"
+
+#define CHANNLE1_BIT 0x01
+#define CHANNLE2_BIT 0x02
+#define CHANNLE3_BIT 0x04
+#define CHANNLE4_BIT 0x08
+#define CHANNLE5_BIT 0x10
+#define CHANNLE6_BIT 0x20
+#define CHANNLE7_BIT 0x40
+#define CHANNLE8_BIT 0x80
+
+#define CMD_CHANNEL_CTRL 0x10
+#define CMD_SAVE_I2C_ADDR 0x11
+#define CMD_READ_I2C_ADDR 0x12
+#define CMD_READ_FIRMWARE_VER 0x13
+
+// Grove 4-Channel SPDT Relay, talks to the simulated board over Wire like
+// the Seeed library. getChannelState() returns the last mask sent, not
+// the board's.
+class Multi_Channel_Relay
+{
+public:
+  void begin(uint8_t address = 0x11) { device_address = address; }
+  uint8_t scanI2CDevice();
+  void changeI2CAddress(uint8_t old_addr, uint8_t new_addr);
+  uint8_t getFirmwareVersion();
+  uint8_t getChannelState() { return channel_state; }
+  void channelCtrl(uint8_t state);
+  void turn_on_channel(uint8_t channel);
+  void turn_off_channel(uint8_t channel);
+
+private:
+  uint8_t device_address = 0x11;
+  uint8_t channel_state = 0;
+};
+
+#endif
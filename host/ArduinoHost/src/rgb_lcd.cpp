@@ -0,0 +1,49 @@
+#include "rgb_lcd.h"
+#include "sim.h"
+
+void rgb_lcd::begin(uint8_t cols, uint8_t rows, uint8_t charsize)
+{
+  (void) cols;
+  (void) rows;
+  (void) charsize;
+  clear();
+}
+
+void rgb_lcd::clear()
+{
+  sim::lcd_i2c(3);
+  sim::lcd_clear();
+  // the HD44780 needs 2 ms to clear the display, the library waits for it
+  delayMicroseconds(2000);
+}
+
+void rgb_lcd::home()
+{
+  sim::lcd_i2c(3);
+  sim::lcd_set_cursor(0, 0);
+  delayMicroseconds(2000);
+}
+
+void rgb_lcd::setCursor(uint8_t col, uint8_t row)
+{
+  sim::lcd_i2c(3);
+  sim::lcd_set_cursor(col, row);
+}
+
+void rgb_lcd::setRGB(unsigned char r, unsigned char g, unsigned char b)
+{
+  (void) r;
+  (void) g;
+  (void) b;
+  // one register write per color
+  sim::lcd_i2c(3);
+  sim::lcd_i2c(3);
+  sim::lcd_i2c(3);
+}
+
+size_t rgb_lcd::write(uint8_t value)
+{
+  sim::lcd_i2c(3);
+  sim::lcd_write(value);
+  return 1;
+}
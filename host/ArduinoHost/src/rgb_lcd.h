@@ -0,0 +1,21 @@
+#ifndef RGB_LCD_HOST_H
+#define RGB_LCD_HOST_H
+
+#include "Arduino.h"
+
+// Grove LCD RGB Backlight, rendered into the simulator's 16x2 screen
+class rgb_lcd : public Print
+{
+public:
+  void begin(uint8_t cols, uint8_t rows, uint8_t charsize = 0);
+  void clear();
+  void home();
+  void setCursor(uint8_t col, uint8_t row);
+  void setRGB(unsigned char r, unsigned char g, unsigned char b);
+  void display() {}
+  void noDisplay() {}
+  size_t write(uint8_t value);
+  using Print::write;
+};
+
+#endif
@@ -0,0 +1,1635 @@
+/*
+
+Simulation driver for the native build
+
+Usage: program [options] [script]
+
+  --duration T    simulated time to run (default 1d)
+  --tick T        virtual time between two loop() calls (default 1ms)
+  --start T       millis() at the first boot, e.g. 49d17h to cross the wrap
+  --eeprom FILE   load the EEPROM image from FILE and save it back at the end
+  --erased        start with erased (0xFF) EEPROM cells instead of 0x00
+  --cycle-channel N
+                  relay channel that starts each cycle, used to project the
+                  EEPROM lifetime in cycles (default 1)
+  --plant         model the membrane behind the first relay board and
+                  feed its TMP to the ADC, see below
+  --relay-boards N
+                  relay boards on the bus (default 1, at most 8). A single
+                  board starts at 0x21 and is readdressed by the firmware,
+                  a bank starts at 0x11, 0x12, ...
+  --no-readback   the relay boards answer a read after a channel write
+                  with 0 instead of their channels
+  --random-resets T
+                  power cycle at random times, T apart on average, and
+                  report the filtration time lost, see below
+  --seed N        seed of the random resets (default 1)
+  --max-wakeups N fail if loop() runs more than N times per hour. The
+                  interrupts that end a sleep_cpu() and let the firmware
+                  go back to sleep don't count.
+  --realtime      keep the virtual clock at the pace of the wall clock,
+                  for a host talking to --serial
+  --serial FILE   connect the USB serial port to FILE, e.g. a pty. Reads
+                  and writes don't block, when FILE doesn't take more the
+                  port is full. Without it no host is connected and the
+                  port only takes text for -v.
+  -v              log relay changes, watchdog interrupts and resets
+
+Times take an optional unit: us, ms (default), s, m, h or d, e.g. 90s or
+2h30m.
+
+The inputs are only seen through the pins. The Timer0 compare interrupt
+runs every 1.024 ms once the firmware enables it, like on the Leonardo.
+
+The script has one event per line, '#' starts a comment:
+
+  <time> press [bounces] [T]    push the Grove button for T (default
+                                200ms), the contact bounces that often
+                                on press and release, 250 us apart
+  <time> turn <detents> [T]     turn the encoder, negative is left, one
+                                quadrature edge every T (default 3ms)
+  <time> reset                  power cycle the controller
+  <time> cut-power-after-writes <n>
+                                power cycle right before the (n+1)th of the
+                                following EEPROM cell writes, which tears
+                                a multi-byte write at any offset
+  <time> relay-nack <n> [board] the relay board doesn't acknowledge its
+                                next n transactions
+  <time> relay-brownout [board] the relay board restarts with all
+                                channels off, the controller keeps running
+  <time> relay-stall <T> [board]
+                                the next transaction with the relay board
+                                hangs for T, e.g. 10s to trip the watchdog
+  <time> expect-relay <mask> [board]
+                                check the relay board channels
+
+Boards are numbered from 1 in the order of their addresses, the default
+is the first one.
+  <time> expect-lcd <row> <text>
+                                check the beginning of an LCD row
+  <time> lcd                    print the LCD content
+  <time> serial <text>          send text to the firmware over the USB
+                                serial port, e.g. t for the TRACE dump
+
+The process exits with 1 if any expectation or --max-wakeups failed.
+
+The plant model: while channel 1 (filtration) is on, the TMP is 100 mbar
+for the clean membrane plus the fouling, which grows by 0.25 mbar/s at
+the average load. The load swings by 70 % around it over 12 h, so a fixed
+schedule backflushes too early at night and too late at noon. Channel 3
+(gas-jet) scours the fouling off with a time constant of 10 s. The
+transducer reads 0 mbar without flow and adds a few counts of noise.
+Without --plant the ADC reads 0, like a missing transducer.
+
+Filtration is the cycle channel of the first board. When a reset cuts an
+activation, the part before it and the rest that was resumed after the
+boot add up to one activation. The report compares that sum with the
+longest activation without a reset: the excess ran again because the
+progress was lost, a shortfall was cut short. A filtration that doesn't
+resume within a second of the boot was skipped. Splits before the first
+activation without a reset aren't counted.
+
+*/
+
+#include "sim.h"
+#include "Arduino.h"
+#include "avr/wdt.h"
+#include "avr/sleep.h"
+#include "multi_channel_relay.h"
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+
+void setup();
+void loop();
+
+volatile uint8_t TIMSK0 = 0;
+volatile uint8_t OCR0A = 0;
+volatile uint8_t TCCR1A = 0;
+volatile uint8_t TCCR1B = 0;
+volatile uint8_t TIMSK1 = 0;
+volatile uint8_t TIFR1 = 0;
+volatile uint8_t SREG = 0;
+HostTimer1Counter TCNT1;
+extern "C" void sim_timer0_compa_vect() __attribute__((weak));
+extern "C" void sim_timer1_ovf_vect() __attribute__((weak));
+volatile uint8_t ADMUX = 0;
+volatile uint8_t ADCSRA = 0;
+volatile uint8_t ADCSRB = 0;
+volatile uint8_t DIDR0 = 0;
+volatile uint8_t DIDR2 = 0;
+volatile uint16_t ADC = 0;
+extern "C" void sim_adc_vect() __attribute__((weak));
+volatile uint8_t MCUSR = 0;
+volatile uint8_t WDTCSR = 0;
+extern "C" void sim_wdt_vect() __attribute__((weak));
+
+namespace sim
+{
+  namespace
+  {
+    const uint8_t kButtonPin = 5;
+    const uint8_t kEncoderPinA = A0;
+    const uint8_t kEncoderPinB = A1;
+    const uint64_t kButtonPressUs = 200000ULL;
+    const uint64_t kBounceUs = 250ULL;
+    const uint64_t kTurnEdgeUs = 3000ULL;
+    // Timer0 overflows every 64 * 256 cycles at 16 MHz
+    const uint64_t kTimer0PeriodUs = 1024ULL;
+    const uint8_t kRelayChannels = 4;
+    const uint8_t kMaxRelayBoards = 8;
+    const uint8_t kNoBoard = 0xFF;
+    const uint8_t kLcdCols = 16;
+    const uint8_t kLcdRows = 2;
+    // erase/write cycles guaranteed by the ATmega32U4 datasheet
+    const uint32_t kEEPROMEndurance = 100000UL;
+    // ADCSRB trigger source of the Timer0 compare match A
+    const uint8_t kAdcTriggerTimer0CompA = 3;
+    // CDC bulk endpoint, what a write takes at once
+    const int kSerialEndpoint = 64;
+    // Plant
+    const double kCleanTmp = 100.0;
+    const double kFoulingRate = 0.25;
+    const double kLoadSwing = 0.7;
+    const double kLoadPeriodS = 12.0 * 3600.0;
+    const double kScourTauS = 10.0;
+    const double kTmpLimit = 300.0;
+    const uint8_t kFiltrationBit = 0x01;
+    const uint8_t kGasJetBit = 0x04;
+    // a resumed filtration switches on this soon after the boot
+    const uint64_t kResumeUs = 1000000ULL;
+    // The input interrupt changes nothing once the pins kept their level
+    // for more samples than a uint8_t debounce counter takes
+    const uint64_t kSettleUs = 300000ULL;
+
+    enum ExitCode
+    {
+      EXIT_DONE = 0,
+      EXIT_RESET = 3
+    };
+
+    enum EventType
+    {
+      PRESS,
+      TURN,
+      RESET,
+      CUT_POWER,
+      RELAY_NACK,
+      RELAY_BROWNOUT,
+      RELAY_STALL,
+      EXPECT_RELAY,
+      EXPECT_LCD,
+      PRINT_LCD,
+      SERIAL_INPUT
+    };
+
+    struct Event
+    {
+      uint64_t at_us;
+      EventType type;
+      long arg;
+      uint64_t span_us;
+      uint8_t board;
+      char text[kLcdCols + 1];
+      int line;
+    };
+
+    struct ChannelStats
+    {
+      uint64_t on_since_us;
+      uint32_t activations;
+      uint64_t total_on_us;
+      uint64_t min_on_us;
+      uint64_t max_on_us;
+      // switch-on to switch-on periods, a drifting schedule widens them
+      uint32_t rises;
+      uint64_t first_rise_us;
+      uint64_t min_period_us;
+      uint64_t max_period_us;
+    };
+
+    struct RelayBoard
+    {
+      uint8_t address;
+      uint8_t mask;
+      uint8_t command;
+      long nacks_pending;
+      // the next transaction takes this long
+      uint64_t stall_us;
+      uint32_t writes;
+      uint32_t reads;
+      uint32_t nacks;
+      uint32_t brownouts;
+      ChannelStats channels[kRelayChannels];
+    };
+
+    struct Filtration
+    {
+      // the channel was on at the last reset
+      bool reset;
+      uint64_t boot_us;
+      // on-time of an activation split by resets so far
+      uint64_t carry_us;
+      // longest activation without a reset
+      uint64_t nominal_us;
+      uint32_t resets;
+      uint64_t redone_us;
+      uint64_t cut_us;
+      uint32_t skipped;
+    };
+
+    struct Plant
+    {
+      uint64_t last_us;
+      // mbar on top of the clean membrane
+      double fouling;
+      uint32_t noise;
+      // while filtering
+      uint64_t filtration_us;
+      double tmp_integral;
+      double tmp_max;
+      double above_limit_s;
+    };
+
+    // Everything that has to survive a simulated power cycle
+    struct Shared
+    {
+      uint64_t now_us;
+      uint8_t eeprom[kEEPROMSize];
+      uint32_t eeprom_writes[kEEPROMSize];
+      RelayBoard boards[kMaxRelayBoards];
+      // channels switched on by two different boards closest together,
+      // the inrush of both adds up below the stagger
+      uint64_t last_rise_us;
+      uint8_t last_rise_board;
+      uint64_t min_rise_gap_us;
+      uint32_t rise_gaps;
+      uint64_t lcd_transactions;
+      uint64_t lcd_bytes;
+      uint64_t lcd_second;
+      uint32_t lcd_second_transactions;
+      uint32_t lcd_peak_transactions;
+      Plant plant;
+      Filtration filtration;
+      uint64_t next_random_reset_us;
+      uint64_t random_state;
+      uint64_t loop_passes;
+      uint64_t sleeps;
+      uint64_t asleep_us;
+      uint64_t serial_bytes;
+      uint64_t serial_refused;
+      uint32_t power_cycles;
+      uint32_t watchdog_resets;
+      uint32_t watchdog_interrupts;
+      // MCUSR at the next boot
+      uint8_t reset_cause;
+      uint32_t passed;
+      uint32_t failed;
+      size_t next_event;
+    } *shared;
+
+    // Options
+    uint64_t duration_us = 24ULL * 3600ULL * 1000000ULL;
+    uint64_t tick_us = 1000ULL;
+    uint64_t start_us = 0;
+    const char *eeprom_file = nullptr;
+    bool verbose = false;
+    unsigned cycle_channel = 1;
+    unsigned relay_boards = 1;
+    bool relay_readback = true;
+    bool plant_model = false;
+    const char *serial_file = nullptr;
+    bool realtime = false;
+    uint64_t max_wakeups = 0;
+    uint64_t random_resets_us = 0;
+    uint64_t seed = 1;
+    // wall clock at the start, for --realtime
+    uint64_t wall_start_us = 0;
+    int serial_fd = -1;
+    std::vector<Event> events;
+    // Text of serial events not read by the firmware yet
+    char serial_input[kLcdCols + 1];
+    size_t serial_input_length = 0;
+
+    // Per boot state, reset by the fork
+    uint64_t boot_us = 0;
+    uint64_t timer0_next_us = 0;
+    // Timer1 counted from 0 at timer1_zero_us, the overflows up to
+    // timer1_overflows were handled
+    uint64_t timer1_zero_us = 0;
+    uint64_t timer1_overflows = 0;
+    bool watchdog_enabled = false;
+    uint64_t watchdog_timeout_us = 0;
+    uint64_t watchdog_kicked_us = 0;
+    struct PinEdge
+    {
+      uint64_t at_us;
+      uint8_t pin;
+      uint8_t value;
+      bool operator<(const PinEdge &other) const { return at_us < other.at_us; }
+    };
+    // Scheduled input edges in time order
+    std::vector<PinEdge> edges;
+    // A << 1 | B of the encoder after the last scheduled edge, at rest both
+    // contacts are open and pulled up
+    uint8_t encoder_state = 3;
+    uint64_t encoder_last_edge_us = 0;
+    // the last edge that reached the pins
+    uint64_t pins_changed_us = 0;
+    // millis() the firmware's sleep ends at the latest, see sleep_deadline()
+    uint32_t wake_ms = 0;
+    bool wake_known = false;
+    long eeprom_writes_until_cut = -1;
+    uint8_t pins[NUM_DIGITAL_PINS];
+    char lcd[kLcdRows][kLcdCols];
+    uint8_t lcd_col = 0;
+    uint8_t lcd_row = 0;
+
+    void format_time(uint64_t us, char *out, size_t size)
+    {
+      uint64_t s = us / 1000000ULL;
+      snprintf(out, size, "%llud %02llu:%02llu:%02llu.%03llu",
+        (unsigned long long) (s / 86400ULL),
+        (unsigned long long) (s / 3600ULL % 24ULL),
+        (unsigned long long) (s / 60ULL % 60ULL),
+        (unsigned long long) (s % 60ULL),
+        (unsigned long long) (us / 1000ULL % 1000ULL));
+    }
+
+    void log_time()
+    {
+      char t[32];
+      format_time(shared->now_us, t, sizeof(t));
+      printf("[%s] ", t);
+    }
+
+    bool parse_time(const char *str, uint64_t &us)
+    {
+      us = 0;
+      if (!*str)
+        return false;
+      while (*str)
+      {
+        char *end;
+        unsigned long long value = strtoull(str, &end, 10);
+        if (end == str)
+          return false;
+        uint64_t unit = 1000ULL;
+        if (!strncmp(end, "us", 2)) { unit = 1ULL; end += 2; }
+        else if (!strncmp(end, "ms", 2)) { end += 2; }
+        else if (*end == 's') { unit = 1000000ULL; end++; }
+        else if (*end == 'm') { unit = 60ULL * 1000000ULL; end++; }
+        else if (*end == 'h') { unit = 3600ULL * 1000000ULL; end++; }
+        else if (*end == 'd') { unit = 86400ULL * 1000000ULL; end++; }
+        else if (*end) return false;
+        us += value * unit;
+        str = end;
+      }
+      return true;
+    }
+
+    // Optional board number after skip other arguments, 0 based
+    bool parse_board(const char *args, int skip, uint8_t &board)
+    {
+      char field[32];
+      int consumed = 0;
+      for (int i = 0; i < skip; i++)
+      {
+        if (sscanf(args, "%31s%n", field, &consumed) != 1)
+          return false;
+        args += consumed;
+      }
+      board = 0;
+      if (sscanf(args, "%31s", field) != 1)
+        return true;
+      char *end;
+      long number = strtol(field, &end, 10);
+      if (*end || number < 1 || number > (long) relay_boards)
+        return false;
+      board = number - 1;
+      return true;
+    }
+
+    bool load_script(const char *path)
+    {
+      FILE *f = fopen(path, "r");
+      if (!f)
+      {
+        perror(path);
+        return false;
+      }
+      char line[256];
+      int line_number = 0;
+      while (fgets(line, sizeof(line), f))
+      {
+        line_number++;
+        char *comment = strchr(line, '#');
+        if (comment)
+          *comment = '\0';
+        char time[32], command[32];
+        int consumed = 0;
+        if (sscanf(line, "%31s %31s %n", time, command, &consumed) < 2)
+          continue;
+        Event event = {};
+        event.line = line_number;
+        const char *args = line + consumed;
+        bool ok = parse_time(time, event.at_us);
+        if (!strcmp(command, "press"))
+        {
+          event.type = PRESS;
+          char span[32];
+          int fields = sscanf(args, "%ld %31s", &event.arg, span);
+          event.span_us = kButtonPressUs;
+          ok = ok && (fields < 1 || event.arg >= 0)
+            && (fields < 2 || parse_time(span, event.span_us));
+        }
+        else if (!strcmp(command, "turn"))
+        {
+          event.type = TURN;
+          char span[32];
+          int fields = sscanf(args, "%ld %31s", &event.arg, span);
+          event.span_us = kTurnEdgeUs;
+          ok = ok && fields >= 1 && (fields == 1 || parse_time(span, event.span_us))
+            && event.span_us > 0;
+        }
+        else if (!strcmp(command, "reset"))
+          event.type = RESET;
+        else if (!strcmp(command, "cut-power-after-writes"))
+        {
+          event.type = CUT_POWER;
+          ok = ok && sscanf(args, "%ld", &event.arg) == 1 && event.arg >= 0;
+        }
+        else if (!strcmp(command, "relay-nack"))
+        {
+          event.type = RELAY_NACK;
+          ok = ok && sscanf(args, "%ld", &event.arg) == 1 && event.arg >= 0
+            && parse_board(args, 1, event.board);
+        }
+        else if (!strcmp(command, "relay-brownout"))
+        {
+          event.type = RELAY_BROWNOUT;
+          ok = ok && parse_board(args, 0, event.board);
+        }
+        else if (!strcmp(command, "relay-stall"))
+        {
+          event.type = RELAY_STALL;
+          char span[32];
+          ok = ok && sscanf(args, "%31s", span) == 1 && parse_time(span, event.span_us)
+            && parse_board(args, 1, event.board);
+        }
+        else if (!strcmp(command, "expect-relay"))
+        {
+          event.type = EXPECT_RELAY;
+          event.arg = strtol(args, nullptr, 0);
+          ok = ok && parse_board(args, 1, event.board);
+        }
+        else if (!strcmp(command, "expect-lcd"))
+        {
+          event.type = EXPECT_LCD;
+          int offset = 0;
+          ok = ok && sscanf(args, "%ld %n", &event.arg, &offset) == 1
+            && event.arg >= 0 && event.arg < kLcdRows;
+          const char *text = args + offset;
+          size_t n = strcspn(text, "\r\n");
+          while (n && text[n - 1] == ' ')
+            n--;
+          if (n >= 2 && text[0] == '"' && text[n - 1] == '"')
+          {
+            text++;
+            n -= 2;
+          }
+          if (n > kLcdCols)
+            n = kLcdCols;
+          memcpy(event.text, text, n);
+        }
+        else if (!strcmp(command, "lcd"))
+          event.type = PRINT_LCD;
+        else if (!strcmp(command, "serial"))
+        {
+          event.type = SERIAL_INPUT;
+          size_t n = strcspn(args, "\r\n");
+          ok = ok && n > 0 && n <= kLcdCols;
+          if (ok)
+            memcpy(event.text, args, n);
+        }
+        else
+          ok = false;
+        if (!ok)
+        {
+          fprintf(stderr, "%s:%d: invalid event\n", path, line_number);
+          fclose(f);
+          return false;
+        }
+        events.push_back(event);
+      }
+      fclose(f);
+      for (size_t i = 1; i < events.size(); i++)
+        for (size_t j = i; j > 0 && events[j - 1].at_us > events[j].at_us; j--)
+          std::swap(events[j - 1], events[j]);
+      return true;
+    }
+
+    void lcd_row_text(uint8_t row, char *out)
+    {
+      memcpy(out, lcd[row], kLcdCols);
+      out[kLcdCols] = '\0';
+    }
+
+    void print_lcd()
+    {
+      char row[kLcdCols + 1];
+      for (uint8_t r = 0; r < kLcdRows; r++)
+      {
+        lcd_row_text(r, row);
+        printf("  |%s|\n", row);
+      }
+    }
+
+    void expect(bool ok, const Event &event, const char *what)
+    {
+      if (ok)
+      {
+        shared->passed++;
+        return;
+      }
+      shared->failed++;
+      log_time();
+      printf("line %d: expected %s\n", event.line, what);
+      print_lcd();
+      for (uint8_t b = 0; b < relay_boards; b++)
+        printf("  relay 0x%02x\n", shared->boards[b].mask);
+    }
+
+    // Prefix of the lines about a board, none with a single board
+    void board_prefix(uint8_t b)
+    {
+      if (relay_boards > 1)
+        printf("board %u ", b + 1);
+    }
+
+    // Run the plant up to now with the valves as they are
+    void plant_advance()
+    {
+      Plant &p = shared->plant;
+      if (!plant_model || shared->now_us <= p.last_us)
+        return;
+      double dt = (shared->now_us - p.last_us) / 1e6;
+      double mid_s = (p.last_us + shared->now_us) / 2e6;
+      p.last_us = shared->now_us;
+      uint8_t mask = shared->boards[0].mask;
+      if (mask & kFiltrationBit)
+      {
+        // the TMP rises linearly within the interval
+        double load = 1.0 + kLoadSwing * sin(2.0 * M_PI * mid_s / kLoadPeriodS);
+        double from = kCleanTmp + p.fouling;
+        p.fouling += kFoulingRate * load * dt;
+        double to = kCleanTmp + p.fouling;
+        p.filtration_us += (uint64_t) (dt * 1e6 + 0.5);
+        p.tmp_integral += (from + to) / 2.0 * dt;
+        p.tmp_max = std::max(p.tmp_max, to);
+        if (to > kTmpLimit)
+          p.above_limit_s += to > from ? dt * (to - std::max(from, kTmpLimit)) / (to - from) : dt;
+      }
+      if (mask & kGasJetBit)
+        p.fouling *= exp(-dt / kScourTauS);
+    }
+
+    // Transducer output in ADC counts, 0.5 V to 4.5 V for 0 to 1000 mbar
+    uint16_t plant_sample()
+    {
+      if (!plant_model)
+        return 0;
+      plant_advance();
+      Plant &p = shared->plant;
+      double tmp = (shared->boards[0].mask & kFiltrationBit) ? kCleanTmp + p.fouling : 0.0;
+      p.noise = p.noise * 1103515245UL + 12345UL;
+      int noise = (int) ((p.noise >> 16) % 5) - 2;
+      double counts = 1024.0 * (0.5 + 4.0 * tmp / 1000.0) / 5.0 + noise;
+      return (uint16_t) std::min(std::max(counts, 0.0), 1023.0);
+    }
+
+    // A conversion started by the trigger, it completes right away
+    void adc_trigger(uint8_t source)
+    {
+      if ((ADCSRA & (_BV(ADEN) | _BV(ADATE))) != (_BV(ADEN) | _BV(ADATE))
+        || (ADCSRB & 0x0F) != source)
+        return;
+      ADC = plant_sample();
+      if ((ADCSRA & _BV(ADIE)) && sim_adc_vect)
+        sim_adc_vect();
+      else
+        ADCSRA |= _BV(ADIF);
+    }
+
+    void filtration_edge(bool on, uint64_t on_us)
+    {
+      Filtration &f = shared->filtration;
+      if (on)
+      {
+        if (f.carry_us && shared->now_us - f.boot_us > kResumeUs)
+        {
+          f.skipped++;
+          if (f.nominal_us > f.carry_us)
+            f.cut_us += f.nominal_us - f.carry_us;
+          f.carry_us = 0;
+        }
+        return;
+      }
+      if (f.reset)
+      {
+        f.reset = false;
+        f.carry_us += on_us;
+        return;
+      }
+      if (!f.carry_us)
+      {
+        if (on_us > f.nominal_us)
+          f.nominal_us = on_us;
+        return;
+      }
+      uint64_t total = f.carry_us + on_us;
+      f.carry_us = 0;
+      if (!f.nominal_us)
+        return;
+      if (total > f.nominal_us)
+        f.redone_us += total - f.nominal_us;
+      else
+        f.cut_us += f.nominal_us - total;
+    }
+
+    // Before a reset, the filtration is split if it runs
+    void filtration_reset()
+    {
+      if (shared->boards[0].mask & (1 << (cycle_channel - 1)))
+      {
+        shared->filtration.reset = true;
+        shared->filtration.resets++;
+      }
+    }
+
+    void relay_apply(RelayBoard &board, uint8_t mask)
+    {
+      uint8_t changed = board.mask ^ mask;
+      if (!changed)
+        return;
+      uint8_t b = &board - shared->boards;
+      if (b == 0)
+        plant_advance();
+      if (changed & mask)
+      {
+        if (shared->last_rise_board != kNoBoard && shared->last_rise_board != b)
+        {
+          uint64_t gap_us = shared->now_us - shared->last_rise_us;
+          if (!shared->rise_gaps || gap_us < shared->min_rise_gap_us)
+            shared->min_rise_gap_us = gap_us;
+          shared->rise_gaps++;
+        }
+        shared->last_rise_us = shared->now_us;
+        shared->last_rise_board = b;
+      }
+      for (uint8_t ch = 0; ch < kRelayChannels; ch++)
+      {
+        if (!(changed & (1 << ch)))
+          continue;
+        ChannelStats &c = board.channels[ch];
+        if (b == 0 && ch == cycle_channel - 1)
+          filtration_edge(mask & (1 << ch), shared->now_us - c.on_since_us);
+        if (mask & (1 << ch))
+        {
+          if (c.rises)
+          {
+            uint64_t period_us = shared->now_us - c.on_since_us;
+            if (c.rises == 1 || period_us < c.min_period_us)
+              c.min_period_us = period_us;
+            if (period_us > c.max_period_us)
+              c.max_period_us = period_us;
+          }
+          else
+          {
+            c.first_rise_us = shared->now_us;
+          }
+          c.rises++;
+          c.on_since_us = shared->now_us;
+          continue;
+        }
+        uint64_t on_us = shared->now_us - c.on_since_us;
+        if (!c.activations || on_us < c.min_on_us)
+          c.min_on_us = on_us;
+        if (on_us > c.max_on_us)
+          c.max_on_us = on_us;
+        c.total_on_us += on_us;
+        c.activations++;
+      }
+      board.mask = mask;
+      if (verbose)
+      {
+        log_time();
+        board_prefix(b);
+        printf("relay 0x%02x\n", mask);
+      }
+    }
+
+    void reboot(ExitCode code)
+    {
+      fflush(stdout);
+      _exit(code);
+    }
+
+    void watchdog_check()
+    {
+      if (!watchdog_enabled
+        || shared->now_us - watchdog_kicked_us <= watchdog_timeout_us)
+        return;
+      // Interrupt mode, the handler runs and the next timeout resets
+      if ((WDTCSR & _BV(WDIE)) && sim_wdt_vect)
+      {
+        WDTCSR &= ~_BV(WDIE);
+        watchdog_kicked_us = shared->now_us;
+        shared->watchdog_interrupts++;
+        if (verbose)
+        {
+          log_time();
+          printf("watchdog interrupt\n");
+        }
+        sim_wdt_vect();
+        return;
+      }
+      shared->watchdog_resets++;
+      shared->reset_cause = _BV(WDRF);
+      filtration_reset();
+      if (verbose)
+      {
+        log_time();
+        printf("watchdog reset\n");
+      }
+      reboot(EXIT_RESET);
+    }
+
+    void power_cycle()
+    {
+      shared->power_cycles++;
+      shared->reset_cause = _BV(PORF);
+      filtration_reset();
+      if (verbose)
+      {
+        log_time();
+        printf("power cycle\n");
+      }
+      // the relay boards lose their state together with the controller
+      for (uint8_t b = 0; b < relay_boards; b++)
+      {
+        shared->boards[b].command = 0;
+        relay_apply(shared->boards[b], 0);
+      }
+      reboot(EXIT_RESET);
+    }
+
+    void schedule_edge(uint64_t at_us, uint8_t pin, uint8_t value)
+    {
+      PinEdge edge = {at_us, pin, value};
+      edges.insert(std::upper_bound(edges.begin(), edges.end(), edge), edge);
+    }
+
+    // The contact closes and opens again after bounces extra edges
+    void schedule_bouncing(uint64_t at_us, uint8_t pin, uint8_t value, long bounces)
+    {
+      for (long i = 0; i <= 2 * bounces; i++)
+        schedule_edge(at_us + i * kBounceUs, pin, (i % 2) ? !value : value);
+    }
+
+    void schedule_turn(long detents, uint64_t span_us)
+    {
+      // Gray code order of A << 1 | B, turning right A changes first
+      static const uint8_t kRight[4] = {2, 0, 3, 1};
+      static const uint8_t kLeft[4] = {1, 3, 0, 2};
+      uint64_t at_us = std::max(shared->now_us, encoder_last_edge_us);
+      for (long i = 0; i < 4 * labs(detents); i++)
+      {
+        uint8_t next = detents > 0 ? kRight[encoder_state] : kLeft[encoder_state];
+        uint8_t changed = next ^ encoder_state;
+        at_us += span_us;
+        if (changed & 2)
+          schedule_edge(at_us, kEncoderPinA, (next >> 1) & 1);
+        else
+          schedule_edge(at_us, kEncoderPinB, next & 1);
+        encoder_state = next;
+      }
+      encoder_last_edge_us = at_us;
+    }
+
+    void run_event(const Event &event)
+    {
+      char text[kLcdCols + 1];
+      RelayBoard &board = shared->boards[event.board];
+      switch (event.type)
+      {
+      case PRESS:
+        schedule_bouncing(shared->now_us, kButtonPin, LOW, event.arg);
+        schedule_bouncing(shared->now_us + event.span_us, kButtonPin, HIGH, event.arg);
+        break;
+      case TURN:
+        schedule_turn(event.arg, event.span_us);
+        break;
+      case RESET:
+        power_cycle();
+        break;
+      case CUT_POWER:
+        eeprom_writes_until_cut = event.arg;
+        break;
+      case RELAY_NACK:
+        board.nacks_pending = event.arg;
+        break;
+      case RELAY_STALL:
+        board.stall_us = event.span_us;
+        break;
+      case RELAY_BROWNOUT:
+        board.brownouts++;
+        board.command = 0;
+        relay_apply(board, 0);
+        break;
+      case EXPECT_RELAY:
+        snprintf(text, sizeof(text), "relay 0x%02lx", event.arg);
+        expect(board.mask == event.arg, event, text);
+        break;
+      case EXPECT_LCD:
+        lcd_row_text(event.arg, text);
+        expect(!strncmp(text, event.text, strlen(event.text)), event, event.text);
+        break;
+      case PRINT_LCD:
+        log_time();
+        printf("lcd\n");
+        print_lcd();
+        break;
+      case SERIAL_INPUT:
+        {
+          size_t n = std::min(strlen(event.text), sizeof(serial_input) - serial_input_length);
+          memcpy(serial_input + serial_input_length, event.text, n);
+          serial_input_length += n;
+        }
+        break;
+      }
+    }
+
+    uint64_t wall_us()
+    {
+      struct timespec t;
+      clock_gettime(CLOCK_MONOTONIC, &t);
+      return (uint64_t) t.tv_sec * 1000000ULL + t.tv_nsec / 1000;
+    }
+
+    // Sleep until the wall clock has caught up with the virtual one
+    void wait_wall_clock()
+    {
+      uint64_t elapsed = wall_us() - wall_start_us;
+      if (shared->now_us <= elapsed)
+        return;
+      uint64_t ahead = shared->now_us - elapsed;
+      struct timespec t = {(time_t) (ahead / 1000000ULL), (long) (ahead % 1000000ULL) * 1000L};
+      nanosleep(&t, nullptr);
+    }
+
+    // xorshift64, uniform in [0, 1)
+    double random_unit()
+    {
+      uint64_t &x = shared->random_state;
+      x ^= x << 13;
+      x ^= x >> 7;
+      x ^= x << 17;
+      return (x >> 11) / 9007199254740992.0;
+    }
+
+    void schedule_random_reset()
+    {
+      shared->next_random_reset_us = shared->now_us
+        + (uint64_t) (2.0 * random_resets_us * random_unit());
+    }
+
+    void run_due_events()
+    {
+      while (shared->next_event < events.size()
+        && events[shared->next_event].at_us <= shared->now_us)
+        run_event(events[shared->next_event++]);
+      if (random_resets_us && shared->now_us >= shared->next_random_reset_us)
+      {
+        schedule_random_reset();
+        power_cycle();
+      }
+    }
+
+    // First Timer0 interrupt of a sleep that can make a difference. While
+    // the inputs are settled, the ADC isn't triggered by Timer0 and Timer1
+    // has no interrupt, the Timer0 interrupts only sample the same pins
+    // again, and the ones before the end of the sleep, the next script
+    // event, edge, reset or watchdog timeout are skipped.
+    uint64_t skip_ahead(uint64_t next_us)
+    {
+      bool adc = (ADCSRA & (_BV(ADEN) | _BV(ADATE))) == (_BV(ADEN) | _BV(ADATE))
+        && (ADCSRB & 0x0F) == kAdcTriggerTimer0CompA;
+      bool overflow = (TIMSK1 & _BV(TOIE1)) && sim_timer1_ovf_vect;
+      if (!wake_known || realtime || adc || overflow
+        || shared->now_us - pins_changed_us < kSettleUs)
+        return next_us;
+      // millis() wraps, the deadline is at most 2^31 ms ahead
+      uint64_t uptime_ms = uptime_us() / 1000ULL;
+      int32_t left_ms = (int32_t) (wake_ms - (uint32_t) uptime_ms);
+      if (left_ms <= 0)
+        return next_us;
+      uint64_t until = boot_us + (uptime_ms + left_ms) * 1000ULL;
+      if (shared->next_event < events.size())
+        until = std::min(until, events[shared->next_event].at_us);
+      if (!edges.empty())
+        until = std::min(until, edges.front().at_us);
+      if (random_resets_us)
+        until = std::min(until, shared->next_random_reset_us);
+      if (watchdog_enabled)
+        until = std::min(until, watchdog_kicked_us + watchdog_timeout_us);
+      until = std::min(until, duration_us);
+      if (until <= next_us + kTimer0PeriodUs)
+        return next_us;
+      uint64_t skipped = (until - next_us) / kTimer0PeriodUs;
+      shared->sleeps += skipped;
+      timer0_next_us = next_us + skipped * kTimer0PeriodUs;
+      return timer0_next_us;
+    }
+
+    void run_firmware()
+    {
+      // millis() restarts at zero after a reset
+      boot_us = shared->now_us;
+      if (!shared->power_cycles && !shared->watchdog_resets)
+        boot_us -= start_us;
+      memset(pins, HIGH, sizeof(pins));
+      pins_changed_us = shared->now_us;
+      shared->filtration.boot_us = shared->now_us;
+      MCUSR = shared->reset_cause;
+      WDTCSR = 0;
+      lcd_clear();
+      // compare match A at OCR0A = 0x80, halfway through the count
+      timer0_next_us = shared->now_us + kTimer0PeriodUs / 2;
+      timer1_zero_us = shared->now_us;
+
+      setup();
+      while (shared->now_us < duration_us)
+      {
+        run_due_events();
+        shared->loop_passes++;
+        loop();
+        advance_us(tick_us);
+        if (realtime)
+          wait_wall_clock();
+      }
+      reboot(EXIT_DONE);
+    }
+
+    void report_wear()
+    {
+      uint16_t hottest = 0;
+      uint64_t total = 0;
+      for (uint16_t i = 0; i < kEEPROMSize; i++)
+      {
+        total += shared->eeprom_writes[i];
+        if (shared->eeprom_writes[i] > shared->eeprom_writes[hottest])
+          hottest = i;
+      }
+      uint32_t max_writes = shared->eeprom_writes[hottest];
+      printf("eeprom: %llu cell writes, %u to the most used cell 0x%03x\n",
+        (unsigned long long) total, max_writes, hottest);
+      if (!max_writes)
+        return;
+
+      // Project the current write rate of the hottest cell to its endurance
+      double lifetime_s = duration_us / 1e6 * kEEPROMEndurance / max_writes;
+      printf("eeprom: endurance reached after %.0f days", lifetime_s / 86400.0);
+      uint32_t cycles = shared->boards[0].channels[cycle_channel - 1].activations;
+      if (cycles)
+        printf(" or %.0f cycles", (double) cycles * kEEPROMEndurance / max_writes);
+      printf("\n");
+    }
+
+    void expect_wakeups(double per_hour)
+    {
+      if (per_hour <= max_wakeups)
+      {
+        shared->passed++;
+        return;
+      }
+      shared->failed++;
+      printf("expected at most %llu wakeups/h, got %.0f\n",
+        (unsigned long long) max_wakeups, per_hour);
+    }
+
+    void report(double wall_s)
+    {
+      char t[32];
+      format_time(duration_us, t, sizeof(t));
+      printf("simulated %s in %.2f s", t, wall_s);
+      if (wall_s > 0)
+        printf(" (%.0fx real time)", duration_us / 1e6 / wall_s);
+      printf("\n");
+      printf("resets: %u power cycles, %u watchdog, %u watchdog interrupts\n",
+        shared->power_cycles, shared->watchdog_resets, shared->watchdog_interrupts);
+      for (uint8_t b = 0; b < relay_boards; b++)
+      {
+        RelayBoard &board = shared->boards[b];
+        board_prefix(b);
+        printf("relay: %u writes, %u reads, %u not acknowledged, %u brownouts\n",
+          board.writes, board.reads, board.nacks, board.brownouts);
+        for (uint8_t ch = 0; ch < kRelayChannels; ch++)
+        {
+          ChannelStats &c = board.channels[ch];
+          if (!c.activations)
+            continue;
+          board_prefix(b);
+          printf("channel %u: %u activations, on min %.3f s, max %.3f s, total %.3f s\n",
+            ch + 1, c.activations, c.min_on_us / 1e6, c.max_on_us / 1e6,
+            c.total_on_us / 1e6);
+          if (c.rises > 1)
+          {
+            board_prefix(b);
+            printf("channel %u: period min %.3f s, max %.3f s, mean %.6f s\n",
+              ch + 1, c.min_period_us / 1e6, c.max_period_us / 1e6,
+              (c.on_since_us - c.first_rise_us) / 1e6 / (c.rises - 1));
+          }
+        }
+      }
+      if (shared->rise_gaps)
+        printf("relay: boards switched on at least %.3f s apart\n",
+          shared->min_rise_gap_us / 1e6);
+      printf("lcd i2c: %llu transactions, %llu bytes, %.1f transactions/s and"
+        " %.1f bytes/s average, %u transactions/s peak\n",
+        (unsigned long long) shared->lcd_transactions,
+        (unsigned long long) shared->lcd_bytes,
+        shared->lcd_transactions / (duration_us / 1e6),
+        shared->lcd_bytes / (duration_us / 1e6),
+        shared->lcd_peak_transactions);
+      if (plant_model)
+      {
+        plant_advance();
+        Plant &p = shared->plant;
+        double filtration_s = p.filtration_us / 1e6;
+        printf("plant: filtration %.1f %% of the time, TMP mean %.0f mbar, max %.0f mbar,"
+          " %.0f s above %.0f mbar\n", 100.0 * filtration_s / (duration_us / 1e6),
+          filtration_s > 0 ? p.tmp_integral / filtration_s : 0.0, p.tmp_max,
+          p.above_limit_s, kTmpLimit);
+      }
+      Filtration &f = shared->filtration;
+      if (f.resets)
+        printf("filtration: %u resets while on, %.0f s run again (%.0f s per reset),"
+          " %u skipped, %.0f s cut short\n", f.resets, f.redone_us / 1e6,
+          f.redone_us / 1e6 / f.resets, f.skipped, f.cut_us / 1e6);
+      double hours = duration_us / 3600e6;
+      printf("cpu: %.0f wakeups/h (loop passes), asleep %.1f %% of the time,"
+        " %.0f interrupts/h while asleep\n", shared->loop_passes / hours,
+        100.0 * shared->asleep_us / duration_us, shared->sleeps / hours);
+      if (max_wakeups)
+        expect_wakeups(shared->loop_passes / hours);
+      if (serial_fd >= 0)
+        printf("serial: %llu bytes written, %llu refused\n",
+          (unsigned long long) shared->serial_bytes,
+          (unsigned long long) shared->serial_refused);
+      report_wear();
+      if (shared->passed || shared->failed)
+        printf("expectations: %u passed, %u failed\n", shared->passed, shared->failed);
+    }
+
+    int usage(const char *name)
+    {
+      fprintf(stderr,
+        "usage: %s [--duration T] [--tick T] [--start T] [--eeprom FILE]"
+        " [--erased] [--cycle-channel N] [--plant] [--relay-boards N] [--no-readback] [--serial FILE] [--realtime]"
+        " [--max-wakeups N] [--random-resets T] [--seed N]"
+        " [-v] [script]\n", name);
+      return 2;
+    }
+  }
+
+  // Timer1 clock divider, 0 while it is stopped
+  uint32_t timer1_prescaler()
+  {
+    static const uint32_t kPrescalers[8] = {0, 1, 8, 64, 256, 1024, 0, 0};
+    return kPrescalers[TCCR1B & 7];
+  }
+
+  uint64_t timer1_period_us()
+  {
+    return 65536ULL * timer1_prescaler() / 16ULL;
+  }
+
+  uint64_t timer1_ticks()
+  {
+    uint32_t prescaler = timer1_prescaler();
+    if (!prescaler)
+      return 0;
+    return (shared->now_us - timer1_zero_us) * 16ULL / prescaler;
+  }
+
+  // The timers keep counting while their interrupts are off
+  void timers_catch_up()
+  {
+    while (timer0_next_us <= shared->now_us)
+      timer0_next_us += kTimer0PeriodUs;
+    if (!(TIMSK1 & _BV(TOIE1)) || !sim_timer1_ovf_vect)
+      timer1_overflows = timer1_ticks() / 65536ULL;
+  }
+
+  uint64_t uptime_us()
+  {
+    return shared->now_us - boot_us;
+  }
+
+  void advance_us(uint64_t us)
+  {
+    uint64_t target = shared->now_us + us;
+    for (;;)
+    {
+      bool timer = (TIMSK0 & _BV(OCIE0A)) && sim_timer0_compa_vect;
+      uint64_t timer_us = timer ? timer0_next_us : UINT64_MAX;
+      bool overflow = (TIMSK1 & _BV(TOIE1)) && sim_timer1_ovf_vect && timer1_prescaler();
+      uint64_t overflow_us = overflow
+        ? timer1_zero_us + (timer1_overflows + 1) * timer1_period_us() : UINT64_MAX;
+      uint64_t edge_us = edges.empty() ? UINT64_MAX : edges.front().at_us;
+      uint64_t next_us = std::min(std::min(timer_us, edge_us), overflow_us);
+      if (next_us > target)
+        break;
+      shared->now_us = std::max(shared->now_us, next_us);
+      watchdog_check();
+      if (edge_us == next_us)
+      {
+        pins[edges.front().pin] = edges.front().value;
+        edges.erase(edges.begin());
+        pins_changed_us = shared->now_us;
+      }
+      else if (overflow_us == next_us)
+      {
+        timer1_overflows++;
+        sim_timer1_ovf_vect();
+      }
+      else
+      {
+        sim_timer0_compa_vect();
+        adc_trigger(kAdcTriggerTimer0CompA);
+      }
+      timers_catch_up();
+    }
+    shared->now_us = target;
+    timers_catch_up();
+    watchdog_check();
+  }
+
+  int pin_read(uint8_t pin)
+  {
+    return pin < NUM_DIGITAL_PINS ? pins[pin] : LOW;
+  }
+
+  void pin_write(uint8_t pin, uint8_t value)
+  {
+    if (pin < NUM_DIGITAL_PINS && pin != kButtonPin
+      && pin != kEncoderPinA && pin != kEncoderPinB)
+      pins[pin] = value ? HIGH : LOW;
+  }
+
+  uint8_t eeprom_read(int idx)
+  {
+    return shared->eeprom[idx % kEEPROMSize];
+  }
+
+  void eeprom_write(int idx, uint8_t value)
+  {
+    if (eeprom_writes_until_cut == 0)
+      power_cycle();
+    if (eeprom_writes_until_cut > 0)
+      eeprom_writes_until_cut--;
+    idx %= kEEPROMSize;
+    shared->eeprom[idx] = value;
+    shared->eeprom_writes[idx]++;
+    // an erase/write cycle of the ATmega32U4 takes 3.4 ms
+    advance_us(3400);
+  }
+
+  void lcd_clear()
+  {
+    memset(lcd, ' ', sizeof(lcd));
+    lcd_col = lcd_row = 0;
+  }
+
+  void lcd_set_cursor(uint8_t col, uint8_t row)
+  {
+    lcd_col = col;
+    lcd_row = row % kLcdRows;
+  }
+
+  void lcd_write(uint8_t value)
+  {
+    if (lcd_col < kLcdCols)
+      lcd[lcd_row][lcd_col] = value;
+    lcd_col++;
+  }
+
+  void lcd_i2c(uint8_t bytes)
+  {
+    uint64_t second = shared->now_us / 1000000ULL;
+    if (second != shared->lcd_second)
+    {
+      shared->lcd_second = second;
+      shared->lcd_second_transactions = 0;
+    }
+    if (++shared->lcd_second_transactions > shared->lcd_peak_transactions)
+      shared->lcd_peak_transactions = shared->lcd_second_transactions;
+    shared->lcd_transactions++;
+    shared->lcd_bytes += bytes;
+  }
+
+  // The board at the address, nullptr if nothing answers
+  RelayBoard *relay_board(uint8_t address)
+  {
+    for (uint8_t b = 0; b < relay_boards; b++)
+      if (shared->boards[b].address == address)
+        return &shared->boards[b];
+    return nullptr;
+  }
+
+  // A board that holds the clock line low, Wire waits for it
+  void relay_stall(RelayBoard &board)
+  {
+    uint64_t stall = board.stall_us;
+    board.stall_us = 0;
+    if (stall)
+      advance_us(stall);
+  }
+
+  uint8_t i2c_write(uint8_t address, const uint8_t *data, uint8_t length)
+  {
+    RelayBoard *board = relay_board(address);
+    if (!board)
+      return 2;
+    relay_stall(*board);
+    if (board->nacks_pending > 0)
+    {
+      board->nacks_pending--;
+      board->nacks++;
+      return 2;
+    }
+    // an empty write only probes the address
+    if (!length)
+      return 0;
+    // The board answers reads according to the last command
+    board->command = data[0];
+    if (data[0] == CMD_CHANNEL_CTRL && length >= 2)
+    {
+      board->writes++;
+      relay_apply(*board, data[1]);
+    }
+    else if (data[0] == CMD_SAVE_I2C_ADDR && length >= 2)
+    {
+      board->address = data[1];
+    }
+    return 0;
+  }
+
+  uint8_t i2c_read(uint8_t address, uint8_t *data, uint8_t length)
+  {
+    RelayBoard *board = relay_board(address);
+    if (!board)
+      return 0;
+    relay_stall(*board);
+    if (board->nacks_pending > 0)
+    {
+      board->nacks_pending--;
+      board->nacks++;
+      return 0;
+    }
+    board->reads++;
+    uint8_t value = board->mask;
+    if (board->command == CMD_READ_I2C_ADDR)
+      value = board->address;
+    else if (board->command == CMD_READ_FIRMWARE_VER)
+      value = 0x01;
+    else if (!relay_readback)
+      value = 0;
+    memset(data, value, length);
+    return length;
+  }
+
+  size_t serial_write(const uint8_t *data, size_t length)
+  {
+    if (serial_fd < 0)
+    {
+      if (verbose)
+        fwrite(data, 1, length, stdout);
+      return length;
+    }
+    ssize_t n = write(serial_fd, data, length);
+    if (n < 0)
+      n = 0;
+    shared->serial_bytes += n;
+    shared->serial_refused += length - n;
+    return n;
+  }
+
+  int serial_space()
+  {
+    return serial_fd < 0 ? 0 : kSerialEndpoint;
+  }
+
+  int serial_available()
+  {
+    int n = 0;
+    if (serial_fd < 0 || ioctl(serial_fd, FIONREAD, &n) < 0)
+      n = 0;
+    return serial_input_length + n;
+  }
+
+  int serial_read()
+  {
+    uint8_t c;
+    if (serial_input_length)
+    {
+      c = serial_input[0];
+      memmove(serial_input, serial_input + 1, --serial_input_length);
+      return c;
+    }
+    if (serial_fd < 0 || read(serial_fd, &c, 1) != 1)
+      return -1;
+    return c;
+  }
+}
+
+HostTimer1Counter::operator uint16_t() const
+{
+  return (uint16_t) sim::timer1_ticks();
+}
+
+HostTimer1Counter &HostTimer1Counter::operator=(uint16_t value)
+{
+  uint32_t prescaler = sim::timer1_prescaler();
+  sim::timer1_zero_us = sim::shared->now_us - (uint64_t) value * prescaler / 16ULL;
+  sim::timer1_overflows = 0;
+  return *this;
+}
+
+void wdt_enable(unsigned char timeout)
+{
+  // like avr-libc, only WDE and the prescaler are left
+  sim::watchdog_enabled = true;
+  sim::watchdog_timeout_us = (16000ULL << timeout);
+  WDTCSR = _BV(WDE);
+  sim::watchdog_kicked_us = sim::shared->now_us;
+}
+
+void wdt_disable()
+{
+  sim::watchdog_enabled = false;
+  WDTCSR = 0;
+}
+
+void sleep_cpu()
+{
+  // Idle until the next interrupt, the Timer0 one comes at least once per ms
+  using namespace sim;
+  uint64_t from = shared->now_us;
+  bool timer = (TIMSK0 & _BV(OCIE0A)) && sim_timer0_compa_vect;
+  uint64_t next = timer ? skip_ahead(timer0_next_us) : from + tick_us;
+  advance_us(next > from ? next - from : 0);
+  shared->sleeps++;
+  shared->asleep_us += shared->now_us - from;
+  run_due_events();
+}
+
+void sleep_deadline(uint32_t ms)
+{
+  sim::wake_ms = ms;
+  sim::wake_known = true;
+}
+
+void wdt_reset()
+{
+  sim::watchdog_kicked_us = sim::shared->now_us;
+}
+
+int sim::run(int argc, char *argv[])
+{
+  using namespace sim;
+  const char *script = nullptr;
+  bool erased = false;
+  for (int i = 1; i < argc; i++)
+  {
+    uint64_t *target = nullptr;
+    if (!strcmp(argv[i], "--duration")) target = &duration_us;
+    else if (!strcmp(argv[i], "--tick")) target = &tick_us;
+    else if (!strcmp(argv[i], "--start")) target = &start_us;
+    else if (!strcmp(argv[i], "--eeprom") && i + 1 < argc) eeprom_file = argv[++i];
+    else if (!strcmp(argv[i], "--erased")) erased = true;
+    else if (!strcmp(argv[i], "--cycle-channel") && i + 1 < argc)
+    {
+      cycle_channel = atoi(argv[++i]);
+      if (cycle_channel < 1 || cycle_channel > kRelayChannels)
+        return usage(argv[0]);
+    }
+    else if (!strcmp(argv[i], "--plant")) plant_model = true;
+    else if (!strcmp(argv[i], "--relay-boards") && i + 1 < argc)
+    {
+      relay_boards = atoi(argv[++i]);
+      if (relay_boards < 1 || relay_boards > kMaxRelayBoards)
+        return usage(argv[0]);
+    }
+    else if (!strcmp(argv[i], "--no-readback")) relay_readback = false;
+    else if (!strcmp(argv[i], "--serial") && i + 1 < argc) serial_file = argv[++i];
+    else if (!strcmp(argv[i], "--realtime")) realtime = true;
+    else if (!strcmp(argv[i], "--max-wakeups") && i + 1 < argc) max_wakeups = atoll(argv[++i]);
+    else if (!strcmp(argv[i], "--random-resets")) target = &random_resets_us;
+    else if (!strcmp(argv[i], "--seed") && i + 1 < argc) seed = strtoull(argv[++i], nullptr, 0);
+    else if (!strcmp(argv[i], "-v")) verbose = true;
+    else if (argv[i][0] != '-' && !script) script = argv[i];
+    else return usage(argv[0]);
+    if (target && (i + 1 >= argc || !parse_time(argv[++i], *target)))
+      return usage(argv[0]);
+  }
+  if (!tick_us || (script && !load_script(script)))
+    return usage(argv[0]);
+
+  shared = (Shared *) mmap(nullptr, sizeof(Shared), PROT_READ | PROT_WRITE,
+    MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (shared == MAP_FAILED)
+  {
+    perror("mmap");
+    return 2;
+  }
+  memset(shared, 0, sizeof(Shared));
+  memset(shared->eeprom, erased ? 0xFF : 0x00, kEEPROMSize);
+  shared->reset_cause = _BV(PORF);
+  // xorshift stays at 0 once it gets there
+  shared->random_state = seed ? seed : 1;
+  if (random_resets_us)
+    schedule_random_reset();
+  shared->last_rise_board = kNoBoard;
+  for (uint8_t b = 0; b < relay_boards; b++)
+    shared->boards[b].address = relay_boards > 1 ? 0x11 + b : 0x21;
+  if (eeprom_file)
+  {
+    FILE *f = fopen(eeprom_file, "rb");
+    if (f)
+    {
+      if (fread(shared->eeprom, 1, kEEPROMSize, f) != kEEPROMSize)
+        fprintf(stderr, "%s: short EEPROM image\n", eeprom_file);
+      fclose(f);
+    }
+  }
+
+  if (serial_file)
+  {
+    serial_fd = open(serial_file, O_RDWR | O_CREAT | O_TRUNC | O_NOCTTY | O_NONBLOCK, 0644);
+    if (serial_fd < 0)
+    {
+      perror(serial_file);
+      return 2;
+    }
+  }
+
+  struct timespec wall_start, wall_end;
+  clock_gettime(CLOCK_MONOTONIC, &wall_start);
+  wall_start_us = wall_us();
+  for (;;)
+  {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+      perror("fork");
+      return 2;
+    }
+    if (pid == 0)
+      run_firmware();
+    int status;
+    waitpid(pid, &status, 0);
+    if (WIFEXITED(status) && WEXITSTATUS(status) == EXIT_RESET)
+      continue;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_DONE)
+    {
+      fprintf(stderr, "firmware process died\n");
+      return 2;
+    }
+    break;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &wall_end);
+  report((wall_end.tv_sec - wall_start.tv_sec)
+    + (wall_end.tv_nsec - wall_start.tv_nsec) / 1e9);
+
+  if (eeprom_file)
+  {
+    FILE *f = fopen(eeprom_file, "wb");
+    if (f)
+    {
+      fwrite(shared->eeprom, 1, kEEPROMSize, f);
+      fclose(f);
+    }
+  }
+  return shared->failed ? 1 : 0;
+}
+
+int sim::run_script(const char *script, const char *options, char *report, size_t size)
+{
+  char script_path[] = "/tmp/sim-script-XXXXXX";
+  char report_path[] = "/tmp/sim-report-XXXXXX";
+  int script_fd = mkstemp(script_path);
+  int report_fd = mkstemp(report_path);
+  if (script_fd < 0 || report_fd < 0)
+  {
+    perror("mkstemp");
+    return -1;
+  }
+  size_t length = strlen(script);
+  bool written = write(script_fd, script, length) == (ssize_t) length;
+  close(script_fd);
+
+  fflush(stdout);
+  pid_t pid = written ? fork() : -1;
+  if (pid == 0)
+  {
+    dup2(report_fd, STDOUT_FILENO);
+    dup2(report_fd, STDERR_FILENO);
+    // the options split at the spaces, then the script
+    char words[256];
+    snprintf(words, sizeof(words), "%s", options ? options : "");
+    std::vector<char *> argv;
+    argv.push_back((char *) "sim");
+    for (char *word = strtok(words, " "); word; word = strtok(nullptr, " "))
+      argv.push_back(word);
+    argv.push_back(script_path);
+    argv.push_back(nullptr);
+    int code = run(argv.size() - 1, argv.data());
+    fflush(stdout);
+    _exit(code);
+  }
+  int status = -1;
+  if (pid > 0)
+    waitpid(pid, &status, 0);
+
+  // the end of the report, with the summary lines
+  if (report && size)
+  {
+    off_t end = lseek(report_fd, 0, SEEK_END);
+    off_t from = end > (off_t) size - 1 ? end - (off_t) size + 1 : 0;
+    ssize_t n = pread(report_fd, report, size - 1, from);
+    report[n > 0 ? n : 0] = '\0';
+  }
+  close(report_fd);
+  unlink(script_path);
+  unlink(report_path);
+  if (pid <= 0 || !WIFEXITED(status))
+    return -1;
+  return WEXITSTATUS(status);
+}
+
+namespace
+{
+  // Appends an input at ms to the script, the next one comes a second later
+  void ScriptInput(char *&p, char *end, uint32_t &ms, const char *event)
+  {
+    if (p < end)
+      p += snprintf(p, end - p, "%lums %s\n", (unsigned long) ms, event);
+    ms += 1000;
+  }
+}
+
+uint32_t sim::settings_script(char *script, size_t size, const uint32_t *seconds, uint8_t count)
+{
+  char *p = script;
+  char *end = script + size;
+  uint32_t ms = 2000;
+  ScriptInput(p, end, ms, "turn 1              # Settings");
+  ScriptInput(p, end, ms, "press");
+  for (uint8_t i = 0; i < count; i++)
+  {
+    ScriptInput(p, end, ms, "turn 1              # next step setting");
+    ScriptInput(p, end, ms, "press               # edit the minutes");
+    for (uint32_t m = 0; m < seconds[i] / 60; m++)
+      ScriptInput(p, end, ms, "turn 1");
+    ScriptInput(p, end, ms, "press               # seconds");
+    for (uint32_t s = 0; s < seconds[i] % 60; s++)
+      ScriptInput(p, end, ms, "turn 1");
+    ScriptInput(p, end, ms, "press");
+  }
+  // a second without input, then Return
+  ms += 1000;
+  char back[32];
+  snprintf(back, sizeof(back), "turn %d              # Return", -(int) count);
+  ScriptInput(p, end, ms, back);
+  ScriptInput(p, end, ms, "press");
+  uint32_t start = ms;
+  ScriptInput(p, end, ms, "press               # Start");
+  return p < end ? start : 0;
+}
+
+#if !defined(PIO_UNIT_TESTING) && !defined(UNIT_TEST)
+int main(int argc, char *argv[])
+{
+  return sim::run(argc, argv);
+}
+#endif
@@ -0,0 +1,70 @@
+/*
+
+Virtual clock and simulated peripherals for the native build
+
+The firmware's setup() and loop() run unchanged against the stand-in
+libraries in this directory. Time only moves when the simulator advances
+it, so a month of cycles runs in seconds. Every simulated power cycle runs
+the firmware in a freshly forked process, which gives it pristine globals
+just like a real reset, while the EEPROM, the relay board and the
+statistics are kept in memory shared with the supervising process.
+
+*/
+
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace sim
+{
+  const uint16_t kEEPROMSize = 1024;
+
+  // Virtual clock, uptime_us() is the time since the last reset
+  uint64_t uptime_us();
+  void advance_us(uint64_t us);
+
+  // Pins, the inputs change as the script says
+  int pin_read(uint8_t pin);
+  void pin_write(uint8_t pin, uint8_t value);
+
+  // EEPROM cells
+  uint8_t eeprom_read(int idx);
+  void eeprom_write(int idx, uint8_t value);
+
+  // Grove LCD
+  void lcd_clear();
+  void lcd_set_cursor(uint8_t col, uint8_t row);
+  void lcd_write(uint8_t value);
+  // Bus traffic of the LCD and its backlight controller, with address byte
+  void lcd_i2c(uint8_t bytes);
+
+  // I2C bus with the Grove relay board, i2c_write() returns the
+  // endTransmission() status and i2c_read() the number of bytes received
+  uint8_t i2c_write(uint8_t address, const uint8_t *data, uint8_t length);
+  uint8_t i2c_read(uint8_t address, uint8_t *data, uint8_t length);
+
+  // USB serial port, serial_write() returns the bytes taken
+  size_t serial_write(const uint8_t *data, size_t length);
+  int serial_space();
+  // bytes the host sent, serial_read() returns -1 without any
+  int serial_available();
+  int serial_read();
+
+  // The simulator with its command line options, what main() runs
+  int run(int argc, char *argv[]);
+  // For the tests: runs the script text with the options, separated by
+  // spaces, in a child process and returns the exit status of the
+  // simulator, -1 if it didn't get that far. report gets the end of its
+  // output.
+  int run_script(const char *script, const char *options, char *report, size_t size);
+  // For the tests: writes the script lines that open the settings, add
+  // seconds[i] to step setting i of a fresh controller, go back and
+  // start the reactor. One input a second from 2 s on, a detent per
+  // minute and per second. Returns the time of the Start press in ms,
+  // 0 if the lines don't fit into size.
+  uint32_t settings_script(char *script, size_t size, const uint32_t *seconds, uint8_t count);
+}
+
+#endif
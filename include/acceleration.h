@@ -0,0 +1,37 @@
+/*
+
+Encoder acceleration for editing times
+
+Each detent is weighted by how soon it followed the previous one, using
+the timestamps of the input events, so the weight doesn't depend on how
+fast loop() runs. Turning slowly changes a setting by one unit, faster
+by 10 and spinning by 60. With minutes as the coarse unit and seconds as
+the fine one, a turn moves by seconds, minutes or tens of minutes up to
+an hour. Turning back starts slow again, so an overshoot can be
+corrected detent by detent.
+
+*/
+
+#ifndef ACCELERATION_H
+#define ACCELERATION_H
+
+#include <Arduino.h>
+
+class Acceleration
+{
+public:
+  // Detent intervals in ms below which a turn counts as fast or spinning
+  static const uint16_t kFastMs = 100;
+  static const uint16_t kSpinMs = 40;
+
+  // Weight of a detent at time in direction (+1 or -1): 1, 10 or 60
+  uint8_t factor(uint32_t time, int8_t direction);
+  // The next detent is weighted 1
+  void reset() { last_direction = 0; }
+
+private:
+  uint32_t last_time = 0;
+  int8_t last_direction = 0;
+};
+
+#endif
@@ -0,0 +1,52 @@
+/*
+
+Section marks for the cycle counts on simavr
+
+With BENCH the firmware writes the id of a section to GPIOR0 when it
+starts and id | kEnd when it ends, and the menu and run state to GPIOR1
+and GPIOR2. bench/bench.c watches the writes and counts the cycles in
+between, so each mark costs a single OUT instruction and nothing else
+changes in the timing. The firmware only uses BenchScope through
+PROFILE_SECTION(). On the host the marks do nothing.
+
+*/
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <Arduino.h>
+
+class BenchScope
+{
+public:
+  static const uint8_t kEnd = 0x80;
+
+  BenchScope(uint8_t id) : id(id) { Mark(id); }
+  ~BenchScope() { Mark(id | kEnd); }
+
+  static void Mark(uint8_t value)
+  {
+    #ifdef __AVR__
+    GPIOR0 = value;
+    #else
+    (void) value;
+    #endif
+  }
+
+  // state: menu << 4 | editing << 3 | run state, screen: entry << 4 | position
+  static void State(uint8_t state, uint8_t screen)
+  {
+    #ifdef __AVR__
+    GPIOR1 = state;
+    GPIOR2 = screen;
+    #else
+    (void) state;
+    (void) screen;
+    #endif
+  }
+
+private:
+  uint8_t id;
+};
+
+#endif
@@ -0,0 +1,17 @@
+/*
+
+Checksums for the records kept in the EEPROM and sent over the serial port
+
+*/
+
+#ifndef CRC_H
+#define CRC_H
+
+#include <Arduino.h>
+
+// CRC-16/CCITT-FALSE
+uint16_t Crc16(const uint8_t *data, uint16_t length, uint16_t crc = 0xFFFF);
+// CRC-16/MODBUS, reflected polynomial 0xA001, sent low byte first
+uint16_t Crc16Modbus(const uint8_t *data, uint16_t length, uint16_t crc = 0xFFFF);
+
+#endif
@@ -0,0 +1,55 @@
+/*
+
+Saturating durations in milliseconds
+
+A step is at most 9999 min 59 s long, which is what the settings screen
+can show. Adding and subtracting stop at 0 and at that limit instead of
+wrapping around, and values read from the EEPROM are clamped the same
+way, so a corrupt record can't turn into a phase of several weeks.
+
+Elapsed() takes the unsigned difference of two millis() readings, which
+stays correct across the 49.7 day wrap as long as the interval itself is
+shorter than that.
+
+*/
+
+#ifndef DURATION_H
+#define DURATION_H
+
+#include <Arduino.h>
+
+class Duration
+{
+public:
+  static const uint32_t kMax = 9999UL * 60000UL + 59000UL;
+
+  constexpr Duration(uint32_t ms = 0) : value(ms < kMax ? ms : kMax) {}
+
+  static Duration Elapsed(uint32_t since, uint32_t now) { return Duration(now - since); }
+
+  uint32_t ms() const { return value; }
+  uint32_t minutes() const { return value / 60000UL; }
+  uint32_t seconds() const { return value / 1000UL; }
+  // Seconds within the current minute
+  uint8_t secondOfMinute() const { return value / 1000UL % 60UL; }
+  bool zero() const { return value == 0; }
+
+  Duration operator+(Duration other) const
+  {
+    return Duration(kMax - value < other.value ? kMax : value + other.value);
+  }
+  Duration operator-(Duration other) const
+  {
+    return Duration(value > other.value ? value - other.value : 0);
+  }
+  Duration &operator+=(Duration other) { return *this = *this + other; }
+  Duration &operator-=(Duration other) { return *this = *this - other; }
+
+  bool operator==(Duration other) const { return value == other.value; }
+  bool operator!=(Duration other) const { return value != other.value; }
+
+private:
+  uint32_t value;
+};
+
+#endif
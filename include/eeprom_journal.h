@@ -0,0 +1,63 @@
+/*
+
+Append-only journal of small records in the EEPROM
+
+Instead of rewriting the same cells, every record goes into the next slot
+of a ring, so the wear is spread over the whole area. A record is
+
+  [layout version][sequence lo][sequence hi][payload ...][crc16 lo][crc16 hi]
+
+begin() finds the newest valid record in a single scan, comparing the
+sequence numbers as signed differences. A record torn by a power loss
+fails the checksum and the previous one stays the newest. A record of
+another layout version fails like a torn one, so a payload that changed
+is never read with the new layout.
+
+rewrite() replaces the newest record in its slot with the same sequence
+number, for a record that is completed later. Torn, it is lost and the
+one before becomes the newest again.
+
+*/
+
+#ifndef EEPROM_JOURNAL_H
+#define EEPROM_JOURNAL_H
+
+#include <Arduino.h>
+#include "crc.h"
+
+class EEPROMJournal
+{
+public:
+  static const uint8_t kMaxPayload = 24;
+  // Bytes of a record besides the payload
+  static const uint8_t kOverhead = 5;
+
+  // Records of size payload bytes are kept in the EEPROM range [from, to),
+  // increase version whenever the payload layout changes
+  void begin(int from, int to, uint8_t size, uint8_t version);
+
+  // Copy the newest record to payload, false if there is none
+  bool read(void *payload) const;
+  void append(const void *payload);
+  void rewrite(const void *payload);
+  // Copy the record age appends before the newest, false past the oldest
+  bool readBack(uint16_t age, void *payload) const;
+
+  uint16_t slots() const { return slot_count; }
+  uint16_t sequence() const { return seq; }
+
+private:
+  bool load(uint16_t slot, uint16_t &sequence, uint8_t *payload) const;
+  void store(const void *payload);
+  int address(uint16_t slot) const { return start + slot * (payload_size + kOverhead); }
+
+  int start = 0;
+  uint8_t payload_size = 0;
+  uint8_t version = 0;
+  uint16_t slot_count = 0;
+  uint16_t head = 0;
+  uint16_t seq = 0;
+  bool empty = true;
+};
+
+#endif
@@ -0,0 +1,104 @@
+/*
+
+Crash records in the EEPROM
+
+The watchdog runs in interrupt-then-reset mode: the first timeout calls
+ISR(WDT_vect), which takes a snapshot of what the loop was doing, and only
+the next one resets. The snapshot holds the loop section, the reactor being
+handled and its step, the longest loop pass of the last one to two minutes
+with the pass that hung, and the stack pointer in the handler. It goes into
+a ring of kRecords, marked kSnapshot. At the next boot begin() marks it
+as a watchdog reset and clears the mark.
+
+The Caterina bootloader of the Leonardo clears all of MCUSR before it
+starts the sketch, so the firmware can't tell a brownout or an external
+reset from a power on, and they get no record. The snapshot tells a
+watchdog reset without WDRF. The sections are set with SectionMark, which
+the firmware only uses through LOOP_SECTION().
+
+*/
+
+#ifndef FORENSICS_H
+#define FORENSICS_H
+
+#include <Arduino.h>
+#include "eeprom_journal.h"
+
+struct __attribute__((packed)) CrashRecord
+{
+  // WDRF once the reset is done, kSnapshot until the boot after it
+  uint8_t cause;
+  // Forensics::kNoSection outside of the loop sections
+  uint8_t section;
+  // Forensics::kNoReactor if none was handled
+  uint8_t reactor;
+  // index of its step
+  uint8_t step;
+  // in the watchdog handler, 0 on the host
+  uint16_t stack;
+  uint32_t longest_us;
+  uint32_t uptime_s;
+};
+
+class Forensics
+{
+public:
+  static const uint8_t kRecords = 4;
+  static const uint8_t kNoSection = 0xFF;
+  static const uint8_t kNoReactor = 0xFF;
+  static const uint8_t kSnapshot = 0x80;
+  // The longest pass is kept per window, the last two count
+  static const uint32_t kWindow = 60000;
+  // Journal layout of CrashRecord
+  static const uint8_t kVersion = 1;
+
+  // EEPROM bytes of the ring
+  static int size() { return kRecords * (sizeof(CrashRecord) + EEPROMJournal::kOverhead); }
+
+  // The ring starts at from. names are the sections in flash, indexed by
+  // their id.
+  void begin(int from, const char *const *names);
+
+  // Around every loop pass
+  void passStart() { pass_start = micros(); in_pass = true; }
+  void passEnd();
+  // Longest pass of the windows, the running one included
+  uint32_t longest() const;
+
+  // Called from ISR(WDT_vect), writes the record
+  void snapshot(uint8_t reactor, uint8_t step);
+
+  // Records in the ring, age 0 is the newest
+  uint8_t count() const;
+  bool record(uint8_t age, CrashRecord &record) const;
+
+  // Cause as a three letter abbreviation and the section name, in flash
+  static const __FlashStringHelper *causeName(uint8_t cause);
+  const __FlashStringHelper *sectionName(uint8_t section) const;
+  void report(Print &out) const;
+
+  // The loop section the firmware is in
+  static volatile uint8_t section;
+
+private:
+  EEPROMJournal ring;
+  const char *const *names = nullptr;
+  volatile uint32_t pass_start = 0;
+  volatile bool in_pass = false;
+  uint32_t window_start = 0;
+  uint32_t window_max = 0;
+  uint32_t last_max = 0;
+};
+
+// Sets the loop section until the end of the enclosing block
+class SectionMark
+{
+public:
+  SectionMark(uint8_t id) : previous(Forensics::section) { Forensics::section = id; }
+  ~SectionMark() { Forensics::section = previous; }
+
+private:
+  uint8_t previous;
+};
+
+#endif
@@ -0,0 +1,54 @@
+/*
+
+Fixed-width numbers and times for the LCD, without printf
+
+Every function writes at out, terminates the text and returns a pointer
+to the '\0', so a line is built by chaining the calls into one buffer of
+LcdFrame::kCols + 1 bytes. Nothing is allocated and the 1.5 KB of
+vfprintf aren't linked.
+
+The AVR has no divider and a 32-bit division is a library call of about
+40 us, so the digits are split off with DivMod10(), which only shifts and
+adds and is exact for the full 32-bit range. Times accept any uint32_t
+in ms, up to 1193:02:47.
+
+*/
+
+#ifndef FORMAT_H
+#define FORMAT_H
+
+#include <Arduino.h>
+
+// value / 10, the remainder is stored in digit
+inline uint32_t DivMod10(uint32_t value, uint8_t &digit)
+{
+  uint32_t q = (value >> 1) + (value >> 2);
+  q += q >> 4;
+  q += q >> 8;
+  q += q >> 16;
+  q >>= 3;
+  // q is the quotient or one below it
+  uint8_t r = value - ((q << 3) + (q << 1));
+  if (r > 9)
+  {
+    q++;
+    r -= 10;
+  }
+  digit = r;
+  return q;
+}
+
+// Like printf("%<width>.<digits>lu"), right aligned with at least digits
+// digits, wider if the value needs it
+char *FormatUnsigned(char *out, uint32_t value, uint8_t width, uint8_t digits = 1);
+
+// Text from flash
+char *FormatText(char *out, const __FlashStringHelper *text);
+
+// Whole seconds of ms, right aligned
+char *FormatSeconds(char *out, uint32_t ms, uint8_t width);
+// "hh:mm:ss" and "mm:ss", the first field grows as needed
+char *FormatClock(char *out, uint32_t ms);
+char *FormatMinSec(char *out, uint32_t ms);
+
+#endif
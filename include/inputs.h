@@ -0,0 +1,82 @@
+/*
+
+Encoder and button input, sampled in an interrupt and queued for loop()
+
+The Leonardo has no pin change interrupts on A0, A1 and pin 5, so
+sample() runs from the Timer0 compare interrupt that fires once per
+millis() tick (1.024 ms) without a timer of its own. It decodes the
+quadrature signal with a transition table, debounces the button and
+pushes timestamped events into a ring buffer. loop() takes them out with
+pop(), so a press or a detent is not lost while loop() is blocked, e.g.
+by an EEPROM write, as long as the queue doesn't overflow.
+
+The interrupt only writes head and loop() only writes tail, both single
+bytes, so the queue needs no locking.
+
+*/
+
+#ifndef INPUTS_H
+#define INPUTS_H
+
+#include <Arduino.h>
+
+enum InputEventType : uint8_t
+{
+  ENCODER_LEFT,
+  ENCODER_RIGHT,
+  BUTTON_PRESS,
+  BUTTON_RELEASE
+};
+
+struct InputEvent
+{
+  uint8_t type;
+  // millis() of the first edge
+  uint32_t time;
+};
+
+class Inputs
+{
+public:
+  // Power of two, the index wraps with a mask
+  static const uint8_t kQueueSize = 16;
+  static const int8_t kStepsPerNotch = 4;
+
+  // The button is active LOW and must be stable for debounce_ms
+  void begin(uint8_t pin_a, uint8_t pin_b, uint8_t button_pin, uint8_t debounce_ms);
+
+  // Interrupt side, about once per ms
+  void sample();
+
+  // loop() side, false if the queue is empty
+  bool pop(InputEvent &event);
+  bool pending() const { return head != tail; }
+
+  // Events lost because the queue was full, the most ever queued
+  uint16_t dropped() const { return dropped_events; }
+  uint8_t peak() const { return peak_depth; }
+
+private:
+  void push(uint8_t type, uint32_t time);
+
+  InputEvent queue[kQueueSize];
+  volatile uint8_t head = 0;
+  volatile uint8_t tail = 0;
+  volatile uint16_t dropped_events = 0;
+  volatile uint8_t peak_depth = 0;
+
+  uint8_t pin_a = 0;
+  uint8_t pin_b = 0;
+  uint8_t button_pin = 0;
+  uint8_t debounce_ms = 0;
+
+  // Interrupt state
+  uint8_t quadrature = 0;
+  int8_t steps = 0;
+  uint32_t turn_time = 0;
+  uint8_t button_stable = HIGH;
+  uint8_t button_count = 0;
+  uint32_t button_time = 0;
+};
+
+#endif
@@ -0,0 +1,67 @@
+/*
+
+16x2 frame buffer for the Grove LCD
+
+The menu is rendered into the back buffer, which costs no I2C traffic.
+flush() compares it with the frame on the display and only sends the cells
+that changed, as setCursor runs. It sends a limited number of transactions
+per call so loop() keeps handling the encoder and the button while a
+screen is updated.
+
+notify() lays a message over the screen. The menu keeps drawing into the
+back buffer underneath, and dismiss() brings it back through the same
+diff, so a message never blocks loop().
+
+*/
+
+#ifndef LCD_FRAME_H
+#define LCD_FRAME_H
+
+#include <Arduino.h>
+#include "rgb_lcd.h"
+
+class LcdFrame : public Print
+{
+public:
+  static const uint8_t kCols = 16;
+  static const uint8_t kRows = 2;
+  // I2C transactions sent per flush() call, ~0.2 ms each at 100 kHz
+  static const uint8_t kFlushBudget = 8;
+
+  void begin(rgb_lcd &lcd);
+
+  // Drawing only touches the back buffer
+  void clear();
+  void setCursor(uint8_t col, uint8_t row);
+  size_t write(uint8_t c);
+  using Print::write;
+
+  // Show a message from flash instead of the back buffer until dismiss()
+  void notify(const __FlashStringHelper *line1, const __FlashStringHelper *line2 = nullptr);
+  void dismiss();
+  bool notifying() const { return toast_active; }
+
+  // Redraw every cell on the next flush, e.g. when the layout changes
+  void invalidate();
+
+  // Send up to budget transactions, returns true when the display is in sync
+  bool flush(uint8_t budget = kFlushBudget);
+  void flushAll();
+
+  // CRC-16 of the cells on the display
+  uint16_t crc() const;
+
+private:
+  rgb_lcd *lcd = nullptr;
+  char next[kRows][kCols];
+  char shown[kRows][kCols];
+  char toast[kRows][kCols];
+  bool toast_active = false;
+  uint8_t col = 0;
+  uint8_t row = 0;
+  // Position of the LCD's own address counter, 0xFF if unknown
+  uint8_t lcd_col = 0xFF;
+  uint8_t lcd_row = 0xFF;
+};
+
+#endif
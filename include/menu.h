@@ -0,0 +1,67 @@
+/*
+
+Table-driven menus
+
+A menu is an array of entries in flash. A turn moves to the previous or
+next entry and a press runs the entry's action. An entry with a count
+above 1 stands for that many consecutive positions, e.g. one per step
+setting, and its callbacks get the position within it. If the number
+depends on the state, positions() returns it instead.
+
+draw() prints the label behind the cursor, if the entry has one, and
+then calls render for the rest of the screen. An edit binding gets the
+turns first and returns true while it uses them, e.g. while a time is
+edited, so the menu stays on the entry.
+
+Only the menu, the entry and the position within it are kept in RAM, and
+moving to a neighbour is O(1). Entries with a count of 0 are skipped.
+
+*/
+
+#ifndef MENU_H
+#define MENU_H
+
+#include <Arduino.h>
+
+struct MenuEntry
+{
+  // in flash, nullptr if render draws the whole screen
+  const char *label;
+  void (*render)(uint8_t arg);
+  // true if the turn was used and the menu stays on the entry
+  bool (*edit)(uint8_t arg, int8_t direction, uint32_t amount);
+  void (*action)(uint8_t arg);
+  uint8_t count;
+  // nullptr or the number of positions, replaces count
+  uint8_t (*positions)();
+};
+
+class Menu
+{
+public:
+  // Show entries, a turn past either end wraps around if wrap is set and
+  // is ignored otherwise
+  void open(const MenuEntry *entries, uint8_t length, bool wrap, uint8_t entry = 0);
+
+  // direction is -1 or 1, amount is passed on to an edit binding
+  void turn(int8_t direction, uint32_t amount = 0);
+  void select();
+  void draw(Print &out) const;
+
+  const MenuEntry *entries() const { return table; }
+  uint8_t entry() const { return current; }
+  uint8_t position() const { return offset; }
+
+private:
+  void load(uint8_t index, MenuEntry &entry) const;
+  uint8_t count(uint8_t index) const;
+  bool move(int8_t direction);
+
+  const MenuEntry *table = nullptr;
+  uint8_t length = 0;
+  bool wrap = false;
+  uint8_t current = 0;
+  uint8_t offset = 0;
+};
+
+#endif
@@ -0,0 +1,104 @@
+/*
+
+Modbus RTU slave on a serial port
+
+poll() takes at most kMaxBytesPerPoll bytes per call and answers at most
+one request, so a pass of loop() costs a bounded amount however fast the
+master sends. The length of a request follows from its function code, a
+request is handled as soon as its last byte is in. A request that stops
+arriving for kGap ms is discarded, after a request with an unknown code
+the gap ends it and it is answered with an exception if its CRC holds.
+
+Over USB there are no character times, so the 3.5 character silence of
+RTU is replaced by kGap. The answer goes out as far as the port takes it
+without blocking, the rest in the following calls; no new request is
+read before it is out.
+
+Supported functions: read coils (1), read holding registers (3), read
+input registers (4), write single coil (5), write single register (6),
+write multiple coils (15) and write multiple registers (16). Requests to
+address 0 are broadcasts, writes are executed and not answered.
+
+The register map is a ModbusMap in flash with one callback per table,
+each returns 0 or the Modbus exception code. Multiple writes stop at the
+first address that fails, the ones before it are kept.
+
+*/
+
+#ifndef MODBUS_H
+#define MODBUS_H
+
+#include <Arduino.h>
+
+namespace ModbusException
+{
+  const uint8_t NONE = 0;
+  const uint8_t ILLEGAL_FUNCTION = 1;
+  const uint8_t ILLEGAL_ADDRESS = 2;
+  const uint8_t ILLEGAL_VALUE = 3;
+  const uint8_t DEVICE_FAILURE = 4;
+  const uint8_t DEVICE_BUSY = 6;
+}
+
+struct ModbusMap
+{
+  uint8_t (*readCoil)(uint16_t address, bool &value);
+  uint8_t (*writeCoil)(uint16_t address, bool value);
+  uint8_t (*readInput)(uint16_t address, uint16_t &value);
+  uint8_t (*readHolding)(uint16_t address, uint16_t &value);
+  uint8_t (*writeHolding)(uint16_t address, uint16_t value);
+};
+
+class ModbusSlave
+{
+public:
+  static const uint8_t kMaxRegisters = 16;
+  static const uint8_t kMaxCoils = 32;
+  static const uint8_t kMaxBytesPerPoll = 16;
+  // ms
+  static const uint8_t kGap = 20;
+  // write multiple registers with kMaxRegisters
+  static const uint8_t kMaxRequest = 9 + 2 * kMaxRegisters;
+  // read holding registers with kMaxRegisters
+  static const uint8_t kMaxReply = 5 + 2 * kMaxRegisters;
+
+  // map is in flash
+  void begin(uint8_t address, const ModbusMap *map);
+
+  // Read what arrived, now is millis(). True if a request wrote something.
+  bool poll(Stream &port, uint32_t now);
+
+  // A request is coming in or its answer going out
+  bool busy() const { return length || discarding || answer_sent < answer_length; }
+
+  uint32_t requests() const { return handled; }
+  // corrupt or overlong requests
+  uint32_t errors() const { return bad; }
+  uint32_t exceptions() const { return refused; }
+
+private:
+  // Length of the request in the buffer, 0 while it isn't known
+  uint16_t expected() const;
+  // true if it wrote something
+  bool handle();
+  // Exception code, size is the request without the CRC
+  uint8_t execute(uint8_t size, bool &wrote);
+  void reply(uint8_t length);
+  void send(Stream &port);
+
+  ModbusMap map;
+  uint8_t address = 1;
+  uint8_t request[kMaxRequest];
+  uint8_t length = 0;
+  // an overlong request is skipped until the gap
+  bool discarding = false;
+  uint32_t last_byte = 0;
+  uint8_t answer[kMaxReply];
+  uint8_t answer_length = 0;
+  uint8_t answer_sent = 0;
+  uint32_t handled = 0;
+  uint32_t bad = 0;
+  uint32_t refused = 0;
+};
+
+#endif
@@ -0,0 +1,58 @@
+/*
+
+Transmembrane pressure from an analog transducer
+
+The ADC is auto-triggered by the Timer0 compare match that already
+samples the inputs, so it converts once per 1.024 ms without the CPU
+starting conversions or waiting for them. The conversion complete
+interrupt hands each sample to sample(), which feeds a leaky integrator:
+
+  filter += sample - filter / 2^kFilterShift
+
+In steady state filter is the sample scaled by 2^kFilterShift, so the
+fraction is kept without floating point, and a step settles with a time
+constant of 2^kFilterShift samples (~0.26 s). Pump pulsation and ADC
+noise average out, a rising TMP still shows within a second.
+
+The transducer puts out 0.5 V to 4.5 V for 0 to kFullScale mbar,
+ratiometric to AVcc. Below 0.25 V or above 4.75 V the wire is broken or
+the transducer is missing, and mbar() returns kNoPressure.
+
+*/
+
+#ifndef PRESSURE_H
+#define PRESSURE_H
+
+#include <Arduino.h>
+
+class PressureSensor
+{
+public:
+  static const uint8_t kFilterShift = 8;
+  static const int16_t kNoPressure = -1;
+  static const uint16_t kFullScale = 1000;
+  // ADC counts at 0.5 V and per kFullScale, 1024 counts are 5 V
+  static const uint16_t kZero = 102;
+  static const uint16_t kSpan = 819;
+  // valid range 0.25 V .. 4.75 V
+  static const uint16_t kMinCounts = 51;
+  static const uint16_t kMaxCounts = 972;
+
+  // Analog pin, A0..A5. Timer0 must run its compare A interrupt.
+  void begin(uint8_t pin);
+
+  // Called from ISR(ADC_vect)
+  void sample(uint16_t counts);
+
+  // Filtered pressure in mbar, kNoPressure without a valid reading
+  int16_t mbar() const;
+  uint32_t samples() const;
+
+private:
+  uint32_t read() const;
+
+  volatile uint32_t filter = 0;
+  volatile uint32_t count = 0;
+};
+
+#endif
@@ -0,0 +1,82 @@
+/*
+
+Section timing for loop() and the interrupts
+
+Timer1 is otherwise unused and runs freely at clk/8, so one count is
+0.5 us. Its overflow interrupt extends the count to 32 bits, which
+covers sections of more than half an hour. Every section keeps
+min/max/total and a log2 histogram of its durations. Bucket i holds
+durations of [2^i, 2^(i+1)) counts and the last bucket everything above.
+
+The firmware only uses it through PROFILE_SECTION(), which is empty
+unless PROFILE is defined, and the overflow interrupt is only defined
+then too. calibrate() times empty sections at boot, the result is what
+every section adds to the loop.
+
+*/
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <Arduino.h>
+
+class Profiler
+{
+public:
+  static const uint8_t kMaxSections = 10;
+  static const uint8_t kBuckets = 12;
+  // Timer1 counts per microsecond
+  static const uint8_t kCountsPerUs = 2;
+
+  struct Section
+  {
+    // in flash
+    const char *name;
+    uint32_t runs;
+    uint32_t min;
+    uint32_t max;
+    uint64_t total;
+    uint16_t histogram[kBuckets];
+  };
+
+  // Start Timer1, sections are numbered in the order they are added
+  void begin();
+  uint8_t add(const char *name);
+  void calibrate();
+
+  static uint32_t now();
+  void record(uint8_t id, uint32_t counts);
+  // Called from ISR(TIMER1_OVF_vect)
+  static void overflow() { overflows++; }
+  void reset();
+
+  uint8_t sections() const { return count; }
+  const Section &section(uint8_t id) const { return table[id]; }
+  // Cost of an empty section in counts
+  uint32_t overhead() const { return empty; }
+
+  void report(Print &out) const;
+
+private:
+  static volatile uint16_t overflows;
+
+  Section table[kMaxSections];
+  uint8_t count = 0;
+  uint32_t empty = 0;
+};
+
+// Records the time until the end of the enclosing block
+class ProfileScope
+{
+public:
+  ProfileScope(Profiler &profiler, uint8_t id)
+    : profiler(profiler), id(id), start(Profiler::now()) {}
+  ~ProfileScope() { profiler.record(id, Profiler::now() - start); }
+
+private:
+  Profiler &profiler;
+  uint8_t id;
+  uint32_t start;
+};
+
+#endif
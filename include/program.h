@@ -0,0 +1,109 @@
+/*
+
+Table-driven cycle program
+
+A cycle is an array of steps. Each step switches the relays to its mask
+for its duration. A step with a repeat count jumps back to loop_to that
+many times before the cycle continues, which repeats a single step or a
+whole block of steps. Loops may be nested as long as the blocks don't
+overlap partially.
+
+The menu entries, the failsafe records and the EEPROM layout are derived
+from the array, so a new recipe only means editing the table.
+
+Advancing to the next step is O(1) and the sequencer uses no heap. The
+table and the step names are kept in flash (PROGMEM), step() returns a
+copy of an entry. The RAM that grows with the program, the durations and
+the repeat counters, belongs to the caller, so it is sized by the length
+of the program and not by kMaxSteps.
+
+*/
+
+#ifndef PROGRAM_H
+#define PROGRAM_H
+
+#include <Arduino.h>
+#include "duration.h"
+
+// The duration can be edited in the menu and is kept in the EEPROM
+#define STEP_SETTING 0x01
+// The reactor's AdaptivePolicy may end the step early or late
+#define STEP_ADAPTIVE 0x02
+
+struct Step
+{
+  // in flash
+  const char *name;
+  uint8_t relay_mask;
+  // default duration in ms
+  uint32_t duration;
+  uint8_t flags;
+  // step to continue with after a crash during this step
+  uint8_t resume;
+  // first step of the block to repeat and how often it runs again
+  uint8_t loop_to;
+  uint8_t repeat;
+};
+
+/*
+
+Ends a STEP_ADAPTIVE step on the transmembrane pressure instead of its
+duration. Once min_percent of the duration is over, the step ends as soon
+as the TMP reaches threshold, while it stays below the step goes on until
+max_percent. Without a valid reading the step keeps its duration.
+
+*/
+struct AdaptivePolicy
+{
+  // mbar
+  uint16_t threshold;
+  uint8_t min_percent;
+  uint16_t max_percent;
+};
+
+constexpr uint8_t CountSettings(const Step *steps, uint8_t count)
+{
+  return count == 0 ? 0
+    : ((steps[count - 1].flags & STEP_SETTING) ? 1 : 0) + CountSettings(steps, count - 1);
+}
+
+class Sequencer
+{
+public:
+  static const uint8_t kMaxSteps = 16;
+
+  // steps is in flash, durations and passes in RAM hold one entry per
+  // step, durations is filled with the defaults
+  void begin(const Step *steps, uint8_t count, Duration *durations, uint8_t *passes);
+
+  // Continue with the given step, all repeat counters start over
+  void start(uint8_t index);
+  void next();
+
+  uint8_t index() const { return current; }
+  uint8_t length() const { return count; }
+  Step step() const { return step(current); }
+  Step step(uint8_t index) const;
+  const __FlashStringHelper *name() const { return name(current); }
+  const __FlashStringHelper *name(uint8_t index) const
+  {
+    return (const __FlashStringHelper *) step(index).name;
+  }
+  Duration duration() const { return durations[current]; }
+
+  // Steps with STEP_SETTING in program order, settingStep() looks the
+  // setting up in the table
+  uint8_t settings() const { return setting_count; }
+  uint8_t settingStep(uint8_t setting) const;
+
+private:
+  const Step *steps = nullptr;
+  uint8_t count = 0;
+  Duration *durations = nullptr;
+  // how often each step jumped back to its loop_to
+  uint8_t *passes = nullptr;
+  uint8_t current = 0;
+  uint8_t setting_count = 0;
+};
+
+#endif
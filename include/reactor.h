@@ -0,0 +1,101 @@
+/*
+
+One membrane bioreactor: a cycle program on its own relay board
+
+A Reactor runs its program against absolute deadlines in UptimeUs(). The
+end of a step is added to the previous deadline, so the cycle doesn't
+drift when loop() is late. update() handles at most one pass through the
+program, steps that are already over end within the same call, and only
+records the mask of the last one. Sending it is up to the caller, who
+decides when the board may switch. How late each step ended goes into
+the Stats of the step, if the caller gave them.
+
+With an AdaptivePolicy, a STEP_ADAPTIVE step ends on the pressure
+given to pressure() within the bounds of the policy, the next step
+starts when it ended.
+
+status() is what the failsafe journal keeps for the reactor: 0 while it
+is stopped, otherwise the step to continue with after a crash + 1. For a
+step that continues with itself, elapsed() is what the checkpoints keep,
+resume() takes it back.
+
+*/
+
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include <Arduino.h>
+#include "program.h"
+#include "relay_driver.h"
+#include "duration.h"
+#include "pressure.h"
+
+class Reactor
+{
+public:
+  static const uint8_t kStopped = 0;
+
+  // How late the end of the step was detected
+  struct Stats
+  {
+    uint32_t transitions;
+    uint32_t late_max_us;
+    uint32_t late_total_us;
+    // adaptive steps that ended before or after their duration
+    uint32_t shortened;
+    uint32_t extended;
+  };
+
+  // program and policy are in flash, durations, passes and stats hold one
+  // entry per step, stats may be nullptr. Without a policy every step
+  // keeps its duration.
+  void begin(uint8_t address, const Step *program, uint8_t length, Duration *durations,
+    uint8_t *passes, Stats *stats, const AdaptivePolicy *policy = nullptr);
+
+  // Start the current step, or what was left of it when it was stopped
+  void start(uint64_t now);
+  // Switch the relays off and keep the rest of the step
+  void stop(uint64_t now);
+  // Back to the first step, stopped
+  void reset();
+  // Run again after a crash, the current step continues after done
+  void resume(uint64_t now, Duration done = Duration(0));
+
+  // Latest TMP in mbar or PressureSensor::kNoPressure
+  void pressure(int16_t mbar) { tmp = mbar; }
+  bool adaptive() const { return has_policy; }
+
+  // End the steps that are over, true if the relays have to change
+  bool update(uint64_t now);
+
+  bool running() const { return active; }
+  bool paused() const { return halted; }
+  Duration remaining(uint64_t now) const;
+  // Time since the running step started, pauses not counted
+  Duration elapsed(uint64_t now) const;
+  uint8_t status() const { return active ? sequencer.step().resume + 1 : kStopped; }
+  // nullptr if they aren't kept
+  const Stats *stats(uint8_t step) const { return step_stats ? &step_stats[step] : nullptr; }
+
+  Sequencer sequencer;
+  RelayDriver relays;
+
+private:
+  void startPhase(Duration duration, uint64_t now);
+  // When the running step ends, now if it is over early
+  uint64_t stepEnd(uint64_t now) const;
+
+  // end of the running step, the next one is added to it
+  uint64_t deadline = 0;
+  // what's left of the step while it is stopped
+  Duration interval;
+  bool active = false;
+  bool halted = false;
+  bool changed = false;
+  AdaptivePolicy policy = {};
+  bool has_policy = false;
+  int16_t tmp = PressureSensor::kNoPressure;
+  Stats *step_stats = nullptr;
+};
+
+#endif
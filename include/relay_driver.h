@@ -0,0 +1,96 @@
+/*
+
+Grove relay board driver with write coalescing and readback
+
+set() only records the wanted mask. flush() is called once per loop
+pass and sends it if it differs from what the board was last confirmed
+to have, so several changes within one pass cost a single transaction
+and repeating the current mask costs none.
+
+Every write is read back with a 1-byte read after CMD_CHANNEL_CTRL. The
+Seeed library doesn't use that read, getChannelState() returns its own
+copy, and the board firmware doesn't document what it answers, so the
+driver finds out. A read that returns a mask other than 0 as written
+shows the board answers with its channel register. As long as that
+hasn't happened, a write the board acknowledged on every attempt while
+no read matched turns the readback off. The writes then count as
+confirmed on their ACK alone, fault() only tells a board that doesn't
+answer, and verify() has the mask written again instead of reading it.
+
+A NACK or a mismatch is retried up to kRetries times within the same
+pass. After that the board is left alone for a backoff that starts at
+kBackoff ms and doubles up to kMaxBackoff, so a dead board doesn't cost
+four transactions per check and per flush. verify() reads the board
+while nothing changes. If the board lost its mask, e.g. after a
+brownout, verify() leaves the mask pending, and the next flush() sends
+it like any other change, so the caller's spacing between boards holds
+for the restore as well.
+
+*/
+
+#ifndef RELAY_DRIVER_H
+#define RELAY_DRIVER_H
+
+#include <Arduino.h>
+
+class RelayDriver
+{
+public:
+  static const uint8_t kRetries = 3;
+  static const uint16_t kBackoff = 500;
+  static const uint16_t kMaxBackoff = 16000;
+
+  void begin(uint8_t address);
+
+  // Wanted mask, sent by the next flush()
+  void set(uint8_t mask);
+  uint8_t mask() const { return wanted; }
+
+  // flush() has something to send now
+  bool changed() const { return pending && !(known && wanted == confirmed) && !waiting(); }
+  // Send the mask if it changed, false if the board didn't confirm it
+  bool flush();
+  // Read the board, a mask it lost is sent again by the next flush().
+  // false if the board didn't answer or its last write failed.
+  bool verify();
+
+  // The last write or check failed after all retries
+  bool fault() const { return failed; }
+  // false once the board turned out not to answer reads with its mask
+  bool readable() const { return readback != READBACK_OFF; }
+  void report(Print &out) const;
+
+  uint32_t requests = 0;
+  uint32_t writes = 0;
+  uint32_t skipped = 0;
+  uint32_t retries = 0;
+  uint32_t verify_failures = 0;
+
+private:
+  enum Readback : uint8_t
+  {
+    READBACK_UNKNOWN,
+    READBACK_ON,
+    READBACK_OFF
+  };
+
+  bool send(uint8_t mask);
+  bool readBack(uint8_t &mask);
+  bool commit();
+  bool confirm();
+  // In the backoff after a failure
+  bool waiting() const { return backoff && millis() - backoff_start < backoff; }
+
+  uint8_t address = 0x11;
+  uint8_t wanted = 0;
+  uint8_t confirmed = 0;
+  // confirmed is only valid once a write was read back
+  bool known = false;
+  bool pending = false;
+  bool failed = false;
+  Readback readback = READBACK_UNKNOWN;
+  uint16_t backoff = 0;
+  uint32_t backoff_start = 0;
+};
+
+#endif
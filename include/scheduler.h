@@ -0,0 +1,66 @@
+/*
+
+Cooperative task scheduler driven from loop()
+
+Periodic tasks keep their own deadline which is advanced by the period, so
+a slow loop iteration delays a run but never shifts the following ones.
+One-shot tasks run once after start() and can be armed again. Deadlines
+are compared with signed differences and survive the millis() wraparound
+after 49.7 days.
+
+Every task counts how late it ran (jitter) and how many periods it missed
+completely (overruns).
+
+*/
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <Arduino.h>
+
+class Scheduler
+{
+public:
+  static const uint8_t kMaxTasks = 8;
+  // idle() without an active task
+  static const uint32_t kNever = 0xFFFFFFFFUL;
+  // add() with all kMaxTasks taken, start() and stop() ignore it
+  static const uint8_t kNoTask = 0xFF;
+
+  struct Task
+  {
+    // in flash
+    const char *name;
+    void (*run)();
+    uint32_t period;
+    uint32_t due;
+    bool active;
+    // statistics
+    uint32_t runs;
+    uint32_t overruns;
+    uint32_t jitter_max;
+    uint32_t jitter_sum;
+  };
+
+  // A period of 0 adds a one-shot task, which stays idle until start().
+  // Returns kNoTask if the table is full.
+  uint8_t add(const char *name, void (*run)(), uint32_t period);
+  // Run the task after delay ms, periodic tasks continue from there
+  void start(uint8_t id, uint32_t delay);
+  void stop(uint8_t id);
+  bool active(uint8_t id) const { return id < count && tasks[id].active; }
+
+  // Run every task that is due, call it from loop()
+  void run();
+  // ms until the next task is due, 0 if one is, kNever without any
+  uint32_t idle() const;
+
+  const Task &task(uint8_t id) const { return tasks[id]; }
+  void report(Print &out) const;
+
+private:
+  Task tasks[kMaxTasks];
+  uint8_t count = 0;
+};
+
+#endif
@@ -0,0 +1,51 @@
+/*
+
+Settings record kept as a double-buffered A/B pair in the EEPROM
+
+Each copy is
+
+  [layout version][sequence][data ...][crc16 lo][crc16 hi]
+
+commit() always overwrites the copy that doesn't hold the newest data and
+writes the checksum last. A power loss during the write leaves a copy with
+a bad checksum, load() then falls back to the other one, so the data is
+either completely old or completely new.
+
+*/
+
+#ifndef SETTINGS_STORE_H
+#define SETTINGS_STORE_H
+
+#include <Arduino.h>
+#include "crc.h"
+
+class SettingsStore
+{
+public:
+  static const uint8_t kMaxSize = 64;
+
+  // Two copies of a size byte record, starting at address
+  void begin(int address, uint8_t size, uint8_t version);
+
+  // Copy the newest valid record to data, false if neither copy is valid
+  bool load(void *data);
+  // Read the record load() or commit() left again, one copy only
+  bool reload(void *data) const;
+  void commit(const void *data);
+
+  // First address behind both copies
+  int end() const { return start + 2 * record_size(); }
+
+private:
+  bool read(uint8_t copy, uint8_t &seq, uint8_t *data) const;
+  uint8_t record_size() const { return size + 4; }
+
+  int start = 0;
+  uint8_t size = 0;
+  uint8_t version = 0;
+  uint8_t current = 0;
+  uint8_t sequence = 0;
+  bool valid = false;
+};
+
+#endif
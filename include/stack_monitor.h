@@ -0,0 +1,26 @@
+/*
+
+Stack high-water mark
+
+Before main() runs, the RAM between the end of .bss and the top of the
+stack is filled with a pattern. The firmware uses no heap, so the bytes
+above .bss that still hold the pattern were never reached by the stack.
+StackUnused() counts them, which is the headroom left in the worst case
+seen since boot, interrupts included.
+
+The static part, .data and .bss, is checked at build time by
+scripts/memory_budget.py. On the host both functions return 0.
+
+*/
+
+#ifndef STACK_MONITOR_H
+#define STACK_MONITOR_H
+
+#include <Arduino.h>
+
+// Bytes between .bss and the stack that were never written
+uint16_t StackUnused();
+// Size of .data and .bss
+uint16_t StaticRam();
+
+#endif
@@ -0,0 +1,59 @@
+/*
+
+Binary telemetry records over the USB serial port
+
+Every record is a type byte, a sequence number, the payload and the
+CRC-16/CCITT-FALSE of the three, low byte first. It is COBS encoded, so
+the only zero byte on the wire is the 0x00 that ends each frame, and a
+reader that starts in the middle finds the next frame at the next zero.
+
+send() encodes a record into a ring buffer and pump() hands as much of
+the buffer to the port as it takes without blocking. When nobody reads
+the port the buffer fills up, further records are dropped and counted,
+and loop() goes on as before. The sequence number counts the dropped
+records too, so the reader sees where records are missing.
+
+Payloads are packed little-endian structs, see TelemetryType in main.cpp
+and scripts/telemetry.py for the decoder.
+
+*/
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <Arduino.h>
+
+class Telemetry
+{
+public:
+  static const uint8_t kBufferSize = 128;
+  // type, sequence number, payload and CRC
+  static const uint8_t kMaxPayload = 20;
+  static const uint8_t kMaxRecord = kMaxPayload + 4;
+  // COBS adds a byte per 254, plus the delimiter
+  static const uint8_t kMaxFrame = kMaxRecord + 2;
+
+  // false if the record didn't fit and was dropped
+  bool send(uint8_t type, const void *payload, uint8_t length);
+  // Write what the port accepts right now, call it from loop()
+  void pump(Print &out);
+
+  uint32_t sent() const { return records; }
+  uint32_t dropped() const { return drops; }
+  uint8_t pending() const { return used; }
+
+private:
+  uint8_t buffer[kBufferSize];
+  uint8_t head = 0;
+  uint8_t tail = 0;
+  uint8_t used = 0;
+  uint8_t sequence = 0;
+  uint32_t records = 0;
+  uint32_t drops = 0;
+};
+
+// COBS encode length bytes of data, returns the length of out without the
+// delimiter. out needs room for length + length / 254 + 1 bytes.
+uint8_t CobsEncode(const uint8_t *data, uint8_t length, uint8_t *out);
+
+#endif
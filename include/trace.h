@@ -0,0 +1,75 @@
+/*
+
+Input trace in RAM
+
+A ring of the last kRecords inputs and what they did, to replay a session
+from the field with scripts/trace_replay.py. The inputs are the detents
+of a loop pass, with the time of the first and the span to the last, and
+the button edges, timed by the input interrupt. Their effects are the
+phase changes of the reactors, step, run state and relays, and the LCD
+frame once the display shows what the inputs did, as a CRC-16 of its
+cells. All times are millis().
+
+report() prints the records oldest first and how many the ring lost
+since the boot.
+
+*/
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <Arduino.h>
+
+enum TraceType : uint8_t
+{
+  TRACE_TURN,
+  TRACE_PRESS,
+  TRACE_RELEASE,
+  TRACE_PHASE,
+  TRACE_FRAME
+};
+
+struct __attribute__((packed)) TraceRecord
+{
+  uint32_t ms;
+  // TraceType
+  uint8_t type;
+  // detents, or reactor << 2 | run state (0 stopped, 1 running, 2 paused)
+  int8_t arg;
+  // span of the detents in ms, step << 8 | relays, or the frame CRC
+  uint16_t value;
+};
+
+class Trace
+{
+public:
+  static const uint8_t kRecords = 48;
+
+  // Detents of one loop pass go into one record
+  void turn(uint32_t ms, int8_t direction);
+  void press(uint32_t ms) { add(TRACE_PRESS, ms); waiting = true; }
+  void release(uint32_t ms) { add(TRACE_RELEASE, ms); }
+  void phase(uint32_t ms, uint8_t reactor, uint8_t run, uint8_t step, uint8_t relays);
+  // The frame on the display, only kept as the effect of inputs
+  void frame(uint32_t ms, uint16_t crc);
+  // Ends the detents of the pass
+  void endPass();
+
+  void report(Print &out) const;
+
+private:
+  void add(uint8_t type, uint32_t ms, int8_t arg = 0, uint16_t value = 0);
+
+  TraceRecord records[kRecords];
+  uint8_t head = 0;
+  uint8_t count = 0;
+  uint16_t lost = 0;
+  // Detents not written yet
+  int8_t detents = 0;
+  uint32_t turn_start = 0;
+  uint32_t turn_end = 0;
+  // Inputs since the last frame
+  bool waiting = false;
+};
+
+#endif
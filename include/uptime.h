@@ -0,0 +1,19 @@
+/*
+
+64-bit microsecond uptime
+
+micros() wraps after 71.6 minutes. UptimeUs() accumulates its differences
+into a counter that never wraps, so deadlines can be added up without
+drift. It has to be called at least once per wrap period, loop() does
+that on every pass.
+
+*/
+
+#ifndef UPTIME_H
+#define UPTIME_H
+
+#include <Arduino.h>
+
+uint64_t UptimeUs();
+
+#endif
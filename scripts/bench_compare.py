@@ -0,0 +1,75 @@
+#!/usr/bin/env python3
+"""
+Comparison of two cycle count reports of bench/bench.c
+
+  bench_compare.py [--tolerance 2] baseline.json report.json
+
+Matches the counts by section, menu, edit and run state and screen and
+prints the ones whose mean or maximum changed, the largest change first.
+Counts that only one of the reports has are listed too, the scenario or
+the menus changed. The exit status is 1 if a mean or a maximum grew by
+more than the tolerance in percent.
+"""
+
+import argparse
+import json
+import sys
+
+KEY = ("section", "menu", "editing", "run", "entry", "position")
+
+
+def load(path):
+    with open(path) as f:
+        report = json.load(f)
+    return {tuple(s[k] for k in KEY): s for s in report["sections"]}
+
+
+def label(key):
+    section, menu, editing, run, entry, position = key
+    screen = "%s%d.%d" % ("edit " if editing else "", entry, position)
+    return "%-9s %-8s %-7s %-9s" % (section, menu, run, screen)
+
+
+def change(old, new):
+    return 100.0 * (new - old) / old if old else (0.0 if new == old else float("inf"))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0].strip())
+    parser.add_argument("baseline")
+    parser.add_argument("report")
+    parser.add_argument("--tolerance", type=float, default=2.0,
+                        help="percent a count may grow, default 2")
+    args = parser.parse_args()
+
+    baseline = load(args.baseline)
+    report = load(args.report)
+    rows = []
+    regressions = 0
+    for key in sorted(set(baseline) & set(report)):
+        old, new = baseline[key], report[key]
+        mean = change(old["mean"], new["mean"])
+        peak = change(old["max"], new["max"])
+        if not mean and not peak:
+            continue
+        worse = mean > args.tolerance or peak > args.tolerance
+        regressions += worse
+        rows.append((max(abs(mean), abs(peak)), key, old, new, mean, peak, worse))
+
+    for _, key, old, new, mean, peak, worse in sorted(rows, reverse=True):
+        print("%s  mean %7d -> %7d %+6.1f%%  max %7d -> %7d %+6.1f%%%s" % (
+            label(key), old["mean"], new["mean"], mean,
+            old["max"], new["max"], peak, "  REGRESSION" if worse else ""))
+    for key in sorted(set(baseline) - set(report)):
+        print("%s  only in the baseline" % label(key))
+    for key in sorted(set(report) - set(baseline)):
+        print("%s  new, mean %d max %d" % (label(key), report[key]["mean"],
+                                          report[key]["max"]))
+
+    print("bench: %d counts compared, %d changed, %d over %g%%" % (
+        len(set(baseline) & set(report)), len(rows), regressions, args.tolerance))
+    return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,75 @@
+"""
+Memory budget of the firmware, run by PlatformIO after linking
+
+Prints the flash and the static RAM (.data + .bss) of the ELF and what
+is left of the RAM for the stack. The build fails if the static RAM
+exceeds custom_ram_budget from platformio.ini, by default the RAM less
+512 bytes for the stack. The stack high-water mark can only be measured
+on the board, the DEBUG report prints it (see include/stack_monitor.h).
+
+Without PlatformIO it checks a linked ELF, the defaults are those of the
+leonardo env:
+
+    python3 scripts/memory_budget.py [--size avr-size] [--ram 2560]
+        [--flash 28672] [--budget 2048] firmware.elf
+"""
+
+import argparse
+import subprocess
+import sys
+
+try:
+    Import("env")
+except NameError:
+    env = None
+
+
+def section_sizes(size_tool, elf):
+    output = subprocess.check_output([size_tool, "-A", elf])
+    sizes = {}
+    for line in output.decode().splitlines():
+        fields = line.split()
+        if len(fields) >= 2 and fields[0].startswith(".") and fields[1].isdigit():
+            sizes[fields[0]] = int(fields[1])
+    return sizes
+
+
+def report(sizes, ram, flash, budget):
+    data = sizes.get(".data", 0)
+    bss = sizes.get(".bss", 0)
+    text = sizes.get(".text", 0)
+    static = data + bss
+
+    print("memory: flash %d of %d bytes" % (text + data, flash))
+    print("memory: .data %d + .bss %d = %d of %d bytes budget, %d left for the stack"
+          % (data, bss, static, budget, ram - static))
+    if static > budget:
+        sys.stderr.write("memory: static RAM exceeds the budget by %d bytes\n"
+                         % (static - budget))
+        return 1
+    return 0
+
+
+def check_budget(source, target, env):
+    sizes = section_sizes(env.subst("$SIZETOOL"), str(target[0]))
+    board = env.BoardConfig()
+    ram = int(board.get("upload.maximum_ram_size", 2560))
+    flash = int(board.get("upload.maximum_size", 28672))
+    budget = int(env.GetProjectOption("custom_ram_budget", ram - 512))
+    return report(sizes, ram, flash, budget)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Memory budget of a linked firmware")
+    parser.add_argument("elf")
+    parser.add_argument("--size", default="avr-size", help="size tool (default avr-size)")
+    parser.add_argument("--ram", type=int, default=2560)
+    parser.add_argument("--flash", type=int, default=28672)
+    parser.add_argument("--budget", type=int, default=2048)
+    args = parser.parse_args()
+    return report(section_sizes(args.size, args.elf), args.ram, args.flash, args.budget)
+
+
+if env is None:
+    sys.exit(main())
+env.AddPostAction("$BUILD_DIR/${PROGNAME}.elf", check_budget)
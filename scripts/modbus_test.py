@@ -0,0 +1,204 @@
+#!/usr/bin/env python3
+"""
+Modbus master test of the MODBUS build against the simulator
+
+  modbus_test.py .pio/build/native/program [simulator options]
+
+Runs the simulator with its serial port on a pty, acts as the SCADA master
+on the other end and walks through the register map in src/main.cpp: it
+writes the step durations, starts the first reactor with its coil, waits
+for a step change, stops it and saves the settings. It also checks that
+wrong addresses get an exception and that a request with a broken CRC or
+for another slave gets no answer. The simulator runs with --realtime, so
+its clock keeps pace with the master's timeouts, and the test takes a few
+seconds. Exits with 1 on the first failure.
+"""
+
+import os
+import pty
+import select
+import signal
+import struct
+import subprocess
+import sys
+import time
+import tty
+
+SLAVE = 1
+BLOCK = 32
+TIMEOUT = 1.0
+
+
+def crc16(data):
+    # CRC-16/MODBUS like Crc16Modbus() in src/crc.cpp
+    crc = 0xFFFF
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            crc = (crc >> 1) ^ 0xA001 if crc & 1 else crc >> 1
+    return crc
+
+
+class Master:
+    def __init__(self, fd):
+        self.fd = fd
+
+    def transact(self, pdu, slave=SLAVE, corrupt=False, expect_reply=True):
+        frame = bytes([slave]) + pdu
+        frame += struct.pack("<H", crc16(frame) ^ (0xFFFF if corrupt else 0))
+        os.write(self.fd, frame)
+        reply = self.receive(expect_reply)
+        if not expect_reply:
+            return None
+        if crc16(reply[:-2]) != struct.unpack("<H", reply[-2:])[0]:
+            raise AssertionError("reply with a bad CRC: %s" % reply.hex())
+        if reply[0] != slave:
+            raise AssertionError("reply from slave %d" % reply[0])
+        return reply[1:-2]
+
+    def receive(self, expect_reply):
+        reply = b""
+        deadline = time.monotonic() + TIMEOUT
+        while time.monotonic() < deadline:
+            if select.select([self.fd], [], [], 0.01)[0]:
+                reply += os.read(self.fd, 256)
+            elif reply:
+                # a pause after the first bytes ends the reply
+                return reply
+        if expect_reply:
+            raise AssertionError("no reply")
+        if reply:
+            raise AssertionError("unexpected reply %s" % reply.hex())
+        return reply
+
+    def request(self, function, payload):
+        pdu = self.transact(bytes([function]) + payload)
+        if pdu[0] == function | 0x80:
+            raise ModbusError(pdu[1])
+        if pdu[0] != function:
+            raise AssertionError("reply to function %d" % pdu[0])
+        return pdu[1:]
+
+    def read_inputs(self, address, count):
+        data = self.request(4, struct.pack(">HH", address, count))
+        return struct.unpack(">%dH" % count, data[1:])
+
+    def read_holding(self, address, count):
+        data = self.request(3, struct.pack(">HH", address, count))
+        return struct.unpack(">%dH" % count, data[1:])
+
+    def write_registers(self, address, values):
+        payload = struct.pack(">HHB", address, len(values), 2 * len(values))
+        payload += struct.pack(">%dH" % len(values), *values)
+        self.request(16, payload)
+
+    def write_coil(self, address, value):
+        self.request(5, struct.pack(">HH", address, 0xFF00 if value else 0))
+
+    def read_coils(self, address, count):
+        data = self.request(1, struct.pack(">HH", address, count))
+        return [bool(data[1 + i // 8] >> (i % 8) & 1) for i in range(count)]
+
+
+class ModbusError(Exception):
+    def __init__(self, code):
+        Exception.__init__(self, "exception %d" % code)
+        self.code = code
+
+
+def expect_exception(code, call, *args):
+    try:
+        call(*args)
+    except ModbusError as error:
+        if error.code != code:
+            raise AssertionError("exception %d instead of %d" % (error.code, code))
+        return
+    raise AssertionError("no exception %d" % code)
+
+
+def check(master):
+    settings = master.read_inputs(8, 1)[0]
+    assert settings > 0, "no step settings"
+    print("modbus: %d step settings" % settings)
+
+    # the high half waits for the low half of the same duration
+    before = master.read_holding(0, 2)
+    master.write_registers(0, [1])
+    assert master.read_holding(0, 2) == before, "high half written alone"
+    master.write_registers(1, [0x86A0])
+    assert master.read_holding(0, 2) == (1, 0x86A0), "latched high half lost"
+
+    # 3 s filtration, 5 s for the others
+    durations = [3000] + [5000] * (settings - 1)
+    registers = []
+    for ms in durations:
+        registers += [ms >> 16, ms & 0xFFFF]
+    master.write_registers(0, registers)
+    assert list(master.read_holding(0, 2 * settings)) == registers, "durations not written"
+
+    master.write_coil(0, True)
+    assert master.read_coils(0, 4) == [True, False, False, False], "not running"
+    step, status, state, relays, high, low = master.read_inputs(0, 6)
+    assert state == 1 and status > 0 and relays != 0, "inputs after start"
+    print("modbus: running step %d, relays 0x%02x, %d ms left"
+          % (step, relays, high << 16 | low))
+    expect_exception(6, master.write_registers, 0, registers[:2])
+
+    deadline = time.monotonic() + 10
+    while master.read_inputs(0, 1)[0] == step:
+        assert time.monotonic() < deadline, "the step didn't change"
+    print("modbus: step changed to %d" % master.read_inputs(0, 1)[0])
+
+    master.write_coil(0, False)
+    state, relays = master.read_inputs(2, 2)
+    assert state == 2 and relays == 0, "not paused"
+    master.write_coil(2, True)
+    master.write_coil(1, True)
+    assert master.read_inputs(0, 3) == (0, 0, 0), "not reset"
+
+    expect_exception(2, master.read_inputs, BLOCK * 8, 1)
+    # 256 blocks on, the reactor index of one byte would wrap to 0
+    expect_exception(2, master.read_inputs, BLOCK * 256, 1)
+    expect_exception(2, master.read_coils, BLOCK * 256, 1)
+    expect_exception(2, master.write_coil, BLOCK * 256, True)
+    expect_exception(2, master.read_holding, BLOCK * 256, 2)
+    expect_exception(2, master.write_coil, 7, True)
+    expect_exception(3, master.read_holding, 0, 100)
+    expect_exception(1, master.request, 43, b"\x0e\x01\x00")
+    master.transact(b"\x04\x00\x00\x00\x01", corrupt=True, expect_reply=False)
+    master.transact(b"\x04\x00\x00\x00\x01", slave=SLAVE + 1, expect_reply=False)
+    # still in sync after the requests that weren't answered
+    assert master.read_inputs(0, 1) == (0,)
+    print("modbus: exceptions and silent requests as expected")
+
+
+def main():
+    if len(sys.argv) < 2:
+        sys.stderr.write(__doc__)
+        return 2
+    master, slave = pty.openpty()
+    # binary, no line discipline on the way
+    tty.setraw(master)
+    tty.setraw(slave)
+    sim = subprocess.Popen(sys.argv[1:] + ["--duration", "1h", "--realtime",
+                                           "--serial", os.ttyname(slave)],
+                           stdout=subprocess.DEVNULL, start_new_session=True)
+    try:
+        # setup() has run once the first answer comes
+        time.sleep(0.2)
+        check(Master(master))
+    except AssertionError as error:
+        print("modbus: FAILED, %s" % error)
+        return 1
+    finally:
+        # with the firmware process the simulator forked
+        os.killpg(sim.pid, signal.SIGKILL)
+        sim.wait()
+        os.close(slave)
+        os.close(master)
+    print("modbus: passed")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
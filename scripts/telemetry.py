@@ -0,0 +1,225 @@
+#!/usr/bin/env python3
+"""
+Decoder for the telemetry records of the firmware (include/telemetry.h)
+
+Reads COBS frames from the serial port, checks the CRC and the length of
+every record and prints one line per record. A gap in the sequence numbers
+is printed as records missing, the loop records tell how many the firmware
+dropped, and the two have to agree. The crash records (include/forensics.h)
+only come at boot. A restart of the controller, seen by them or by the
+uptime going back, starts the sequence numbers and the drops over.
+
+  telemetry.py /dev/ttyACM0
+  telemetry.py --sim .pio/build/native/program [simulator options]
+
+With --sim the simulator of the native build runs with its serial port on
+a pty, the decoder reads the other end until it exits and then checks that
+no frame was corrupt, every periodic record type came by and the missing
+records match the drops. The exit status is 1 if not, which makes it a test
+of the stream without a board.
+"""
+
+import argparse
+import os
+import pty
+import select
+import struct
+import subprocess
+import sys
+import tty
+
+STATUS, STEP, LOOP, CRASH = 1, 2, 3, 4
+RECORDS = {
+    STATUS: ("status", "<BBBBBIII",
+             ("reactor", "step", "relays", "status", "paused",
+              "remaining_ms", "crashes", "uptime_ms")),
+    STEP: ("step", "<BBBI", ("reactor", "step", "relays", "uptime_ms")),
+    LOOP: ("loop", "<IIII", ("passes", "max_us", "dropped", "uptime_ms")),
+    CRASH: ("crash", "<BBBBHII", ("cause", "section", "reactor", "step",
+                                  "stack", "longest_us", "uptime_s")),
+}
+PERIODIC = (STATUS, STEP, LOOP)
+
+
+def crc16(data, crc=0xFFFF):
+    # CRC-16/CCITT-FALSE like Crc16() in src/crc.cpp
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else crc << 1
+            crc &= 0xFFFF
+    return crc
+
+
+def cobs_decode(frame):
+    out = bytearray()
+    i = 0
+    while i < len(frame):
+        code = frame[i]
+        if code == 0 or i + code > len(frame):
+            return None
+        out += frame[i + 1:i + code]
+        i += code
+        if code < 0xFF and i < len(frame):
+            out.append(0)
+    return bytes(out)
+
+
+class Decoder:
+    def __init__(self, quiet=False):
+        self.quiet = quiet
+        self.pending = bytearray()
+        self.sequence = None
+        self.kind = None
+        self.uptime_ms = 0
+        self.restarts = 0
+        self.missing = 0
+        self.missing_since_loop = 0
+        self.dropped = None
+        self.counts = dict.fromkeys(RECORDS, 0)
+        self.corrupt = 0
+        self.mismatches = 0
+
+    def feed(self, data):
+        self.pending += data
+        while True:
+            end = self.pending.find(b"\0")
+            if end < 0:
+                return
+            frame = bytes(self.pending[:end])
+            del self.pending[:end + 1]
+            if frame:
+                self.frame(frame)
+
+    def frame(self, frame):
+        record = cobs_decode(frame)
+        if record is None or len(record) < 4:
+            self.error("bad frame %s" % frame.hex())
+            return
+        body, crc = record[:-2], struct.unpack("<H", record[-2:])[0]
+        if crc16(body) != crc:
+            self.error("bad CRC %s" % record.hex())
+            return
+        kind, sequence, payload = body[0], body[1], body[2:]
+        if kind not in RECORDS or len(payload) != struct.calcsize(RECORDS[kind][1]):
+            self.error("unknown record %s" % record.hex())
+            return
+        name, layout, fields = RECORDS[kind]
+        values = dict(zip(fields, struct.unpack(layout, payload)))
+        if self.restarted(kind, values):
+            self.restarts += 1
+            self.sequence = None
+            self.dropped = None
+            self.missing_since_loop = 0
+            self.show("-- controller restarted")
+        if self.sequence is not None:
+            gap = (sequence - self.sequence - 1) & 0xFF
+            if gap:
+                self.missing += gap
+                self.missing_since_loop += gap
+                self.show("-- %d records missing" % gap)
+        self.sequence = sequence
+        self.kind = kind
+        self.counts[kind] += 1
+        self.show("%3d %-6s %s" % (sequence, name,
+                  " ".join("%s=%s" % (f, values[f]) for f in fields)))
+        if kind == LOOP:
+            self.loop(values["dropped"])
+
+    def restarted(self, kind, values):
+        # the crash records come first after a boot
+        if kind == CRASH:
+            return self.kind is not None and self.kind != CRASH
+        uptime_ms, self.uptime_ms = self.uptime_ms, values["uptime_ms"]
+        return self.kind != CRASH and values["uptime_ms"] < uptime_ms
+
+    def loop(self, dropped):
+        # only comparable while fewer than 256 went missing in between
+        if self.dropped is not None:
+            expected = dropped - self.dropped
+            if expected < 256 and expected != self.missing_since_loop:
+                self.mismatches += 1
+                sys.stderr.write("telemetry: %d records missing, but %d dropped\n"
+                                 % (self.missing_since_loop, expected))
+        self.dropped = dropped
+        self.missing_since_loop = 0
+
+    def error(self, message):
+        self.corrupt += 1
+        sys.stderr.write("telemetry: %s\n" % message)
+
+    def show(self, line):
+        if not self.quiet:
+            print(line)
+
+    def summary(self):
+        print("telemetry: %s, %d missing, %d corrupt, %d restarts" % (
+            ", ".join("%d %s" % (self.counts[k], RECORDS[k][0]) for k in RECORDS),
+            self.missing, self.corrupt, self.restarts))
+
+    def ok(self):
+        return (not self.corrupt and not self.mismatches
+                and all(self.counts[k] for k in PERIODIC))
+
+
+def read_port(path, decoder):
+    fd = os.open(path, os.O_RDONLY | os.O_NOCTTY)
+    tty.setraw(fd)
+    try:
+        while True:
+            data = os.read(fd, 4096)
+            if not data:
+                return
+            decoder.feed(data)
+    except KeyboardInterrupt:
+        pass
+    finally:
+        os.close(fd)
+
+
+def run_sim(command, decoder):
+    master, slave = pty.openpty()
+    # binary, no line discipline on the way
+    tty.setraw(slave)
+    tty.setraw(master)
+    sim = subprocess.Popen(command + ["--serial", os.ttyname(slave)])
+
+    def drain(timeout):
+        while select.select([master], [], [], timeout)[0]:
+            try:
+                decoder.feed(os.read(master, 4096))
+            except OSError:
+                return
+            timeout = 0
+
+    while sim.poll() is None:
+        drain(0.01)
+    drain(0)
+    os.close(slave)
+    os.close(master)
+    return sim.returncode
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0].strip())
+    parser.add_argument("port", nargs="?", help="serial port, e.g. /dev/ttyACM0")
+    parser.add_argument("--sim", nargs=argparse.REMAINDER,
+                        help="run the simulator with these arguments on a pty")
+    parser.add_argument("-q", "--quiet", action="store_true",
+                        help="only print the summary")
+    args = parser.parse_args()
+    if bool(args.port) == bool(args.sim):
+        parser.error("give either a port or --sim")
+
+    decoder = Decoder(args.quiet)
+    if args.sim:
+        status = run_sim(args.sim, decoder)
+        decoder.summary()
+        return 1 if status or not decoder.ok() else 0
+    read_port(args.port, decoder)
+    decoder.summary()
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,269 @@
+#!/usr/bin/env python3
+"""
+Replay of an input trace (include/trace.h) on the simulator
+
+  trace_replay.py trace.txt .pio/build/native/program [simulator options]
+  trace_replay.py --port /dev/ttyACM0 -o trace.txt
+
+The TRACE build prints its trace when it gets a 't' on the serial port.
+With --port the script asks the controller for it and saves it with -o,
+otherwise it takes the saved one and replays it: the button edges and the
+detents go into a simulator script at the times they were recorded, and
+a 't' at the time of the dump brings the trace of the replay. The native
+build has to have TRACE defined as well.
+
+Then the two traces are compared. The inputs have to be the same, every
+phase change with its step, run state and relays has to come back, and
+every LCD frame of the controller has to show up in the replay, all of
+them within the tolerance of their time. Detents that came in one loop
+pass are replayed evenly spaced. For every input the time to its first
+effect, a phase change or the frame that shows it, is printed for the
+controller and the replay. The exit status is 1 if the replay differs.
+
+The replay starts from the boot with the default settings, or the EEPROM
+image of --eeprom, so the trace must not have lost records since the
+boot.
+"""
+
+import argparse
+import os
+import re
+import select
+import subprocess
+import sys
+import tempfile
+import time
+import tty
+
+HEADER = re.compile(r"trace: (\d+) records, (\d+) lost, at (\d+) ms")
+RECORD = re.compile(r"trace (\d+) (\w+) ?(.*)")
+INPUTS = ("turn", "press", "release")
+EFFECTS = ("phase", "frame")
+# The input interrupt samples every 1.024 ms
+SAMPLE_US = 1024
+
+
+class Trace:
+    def __init__(self, lines):
+        self.records = []
+        self.lost = None
+        self.dump_ms = None
+        for line in lines:
+            header = HEADER.match(line.strip())
+            if header:
+                # the last dump counts
+                self.records = []
+                self.lost = int(header.group(2))
+                self.dump_ms = int(header.group(3))
+                continue
+            record = RECORD.match(line.strip())
+            if record and self.lost is not None:
+                self.records.append((int(record.group(1)), record.group(2),
+                                     record.group(3).split()))
+
+    def inputs(self):
+        return [r for r in self.records if r[1] in INPUTS]
+
+    def effects(self, kind):
+        return [r for r in self.records if r[1] == kind]
+
+    def detents(self):
+        # the inputs one detent at a time, a pass may take several
+        out = []
+        for ms, kind, args in self.inputs():
+            if kind == "turn":
+                out += ["right" if int(args[0]) > 0 else "left"] * abs(int(args[0]))
+            else:
+                out.append(kind)
+        return out
+
+    def latencies(self):
+        # time from every input to the first effect before the next input
+        out = []
+        pending = None
+        for ms, kind, args in self.records:
+            if kind in INPUTS:
+                if pending:
+                    out.append((pending, None))
+                pending = (ms, kind, args)
+            elif pending:
+                out.append((pending, (ms, kind, args)))
+                pending = None
+        if pending:
+            out.append((pending, None))
+        return out
+
+
+def fetch(port):
+    fd = os.open(port, os.O_RDWR | os.O_NOCTTY)
+    tty.setraw(fd)
+    try:
+        # whatever came before the request
+        while select.select([fd], [], [], 0.2)[0]:
+            os.read(fd, 4096)
+        os.write(fd, b"t")
+        text = b""
+        expected = None
+        deadline = time.monotonic() + 5
+        while time.monotonic() < deadline:
+            if select.select([fd], [], [], 0.1)[0]:
+                text += os.read(fd, 4096)
+            lines = text.decode("ascii", "replace").splitlines(True)
+            for line in lines:
+                header = HEADER.match(line.strip())
+                if header:
+                    expected = int(header.group(1))
+            complete = [l for l in lines if l.endswith("\n") and RECORD.match(l.strip())]
+            if expected is not None and len(complete) >= expected:
+                return [l for l in lines if l.startswith("trace")]
+        raise SystemExit("trace: no complete dump from %s" % port)
+    finally:
+        os.close(fd)
+
+
+def script(trace):
+    lines = []
+    records = trace.records
+    for i, (ms, kind, args) in enumerate(records):
+        # the edge half a sample before its time stamp
+        at_us = ms * 1000 - SAMPLE_US // 2
+        if kind == "press":
+            release = next((r[0] for r in records[i + 1:] if r[1] == "release"),
+                           trace.dump_ms)
+            lines.append("%dus press 0 %dms" % (at_us, release - ms))
+        elif kind == "turn":
+            detents, span = int(args[0]), int(args[1])
+            # four edges per detent, the first one at the time stamp
+            edge_us = 3000
+            if abs(detents) > 1:
+                edge_us = max(1100, span * 1000 // (abs(detents) - 1) // 4)
+            lines.append("%dus turn %d %dus" % (at_us - edge_us, detents, edge_us))
+    lines.append("%dms serial t" % trace.dump_ms)
+    return "\n".join(lines) + "\n"
+
+
+def replay(trace, command):
+    with tempfile.TemporaryDirectory() as directory:
+        path = os.path.join(directory, "replay.txt")
+        serial = os.path.join(directory, "serial.txt")
+        with open(path, "w") as f:
+            f.write(script(trace))
+        subprocess.run(command + ["--duration", "%dms" % (trace.dump_ms + 1000),
+                                  "--serial", serial, path],
+                       stdout=subprocess.DEVNULL)
+        with open(serial, errors="replace") as f:
+            return Trace(f.read().splitlines())
+
+
+def describe(record):
+    ms, kind, args = record
+    return "%s %s" % (kind, " ".join(args)) if args else kind
+
+
+def compare(device, replayed, tolerance):
+    failures = []
+    if device.detents() != replayed.detents():
+        failures.append("the inputs differ, %d detents and edges on the controller, "
+                        "%d in the replay" % (len(device.detents()), len(replayed.detents())))
+
+    phases, replayed_phases = device.effects("phase"), replayed.effects("phase")
+    for i, record in enumerate(phases):
+        if i >= len(replayed_phases):
+            failures.append("%d ms %s missing in the replay" % (record[0], describe(record)))
+            break
+        other = replayed_phases[i]
+        if record[2] != other[2] or abs(record[0] - other[0]) > tolerance:
+            failures.append("%d ms %s, replay %d ms %s" % (record[0], describe(record),
+                                                            other[0], describe(other)))
+            break
+    else:
+        for extra in replayed_phases[len(phases):]:
+            failures.append("%d ms %s only in the replay" % (extra[0], describe(extra)))
+            break
+
+    # the replay may show more frames, e.g. for detents the controller
+    # handled in one pass
+    frames = iter(replayed.effects("frame"))
+    for record in device.effects("frame"):
+        match = next((f for f in frames if f[2] == record[2]), None)
+        if match is None:
+            failures.append("%d ms %s missing in the replay" % (record[0], describe(record)))
+            break
+        if abs(match[0] - record[0]) > tolerance:
+            failures.append("%d ms %s, in the replay at %d ms" % (record[0], describe(record),
+                                                                 match[0]))
+            break
+    return failures
+
+
+def report_latencies(device, replayed):
+    ours = device.latencies()
+    theirs = replayed.latencies()
+    # side by side if the loop passes took the inputs the same way
+    aligned = ([(r[1], r[2][:1]) for r, e in ours]
+               == [(r[1], r[2][:1]) for r, e in theirs])
+    print("    time  input         effect                  controller    replay")
+    for n, (record, effect) in enumerate(ours):
+        other = theirs[n] if aligned else (None, None)
+        print("%8.3fs  %-12s  %-22s  %10s  %8s" % (
+            record[0] / 1000.0, describe(record),
+            describe(effect) if effect else "-",
+            "%d ms" % (effect[0] - record[0]) if effect else "-",
+            "%d ms" % (other[1][0] - other[0][0]) if other[1] else "-"))
+    for name, trace in (("controller", ours), ("replay", theirs)):
+        for kind in INPUTS:
+            values = [e[0] - r[0] for r, e in trace if e and r[1] == kind]
+            if values:
+                print("latency: %s %s mean %.1f ms, max %d ms over %d" % (
+                    name, kind, sum(values) / float(len(values)), max(values),
+                    len(values)))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0].strip())
+    parser.add_argument("trace", nargs="?", help="trace printed by the controller")
+    parser.add_argument("sim", nargs=argparse.REMAINDER,
+                        help="simulator of the native build and its options")
+    parser.add_argument("--port", help="fetch the trace from the controller")
+    parser.add_argument("-o", "--output", help="save the fetched trace")
+    parser.add_argument("--tolerance", type=int, default=100,
+                        help="ms an effect may be off, default 100")
+    args = parser.parse_args()
+
+    if args.port:
+        lines = fetch(args.port)
+        if args.output:
+            with open(args.output, "w") as f:
+                f.writelines(lines)
+        else:
+            sys.stdout.writelines(lines)
+        return 0
+    if not args.trace or not args.sim:
+        parser.error("give a trace and the simulator, or --port")
+
+    with open(args.trace, errors="replace") as f:
+        device = Trace(f.read().splitlines())
+    if device.lost is None:
+        print("trace: no dump in %s" % args.trace)
+        return 1
+    if device.lost:
+        print("trace: %d records were lost since the boot, the replay needs all of them"
+              % device.lost)
+        return 1
+    replayed = replay(device, args.sim)
+    if replayed.lost is None:
+        print("trace: the replay sent no trace, is TRACE defined in the native build?")
+        return 1
+
+    report_latencies(device, replayed)
+    failures = compare(device, replayed, args.tolerance)
+    for failure in failures:
+        print("trace: %s" % failure)
+    print("trace: %d records replayed, %d phase changes and %d frames compared, %s" % (
+        len(device.records), len(device.effects("phase")), len(device.effects("frame")),
+        "FAILED" if failures else "passed"))
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
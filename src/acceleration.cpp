@@ -0,0 +1,12 @@
+#include "acceleration.h"
+
+uint8_t Acceleration::factor(uint32_t time, int8_t direction)
+{
+  uint32_t interval = time - last_time;
+  bool continued = direction == last_direction;
+  last_time = time;
+  last_direction = direction;
+  if (!continued || interval >= kFastMs)
+    return 1;
+  return interval >= kSpinMs ? 10 : 60;
+}
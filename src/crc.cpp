@@ -0,0 +1,23 @@
+#include "crc.h"
+
+uint16_t Crc16(const uint8_t *data, uint16_t length, uint16_t crc)
+{
+  while (length--)
+  {
+    crc ^= (uint16_t) *data++ << 8;
+    for (uint8_t bit = 0; bit < 8; bit++)
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+  }
+  return crc;
+}
+
+uint16_t Crc16Modbus(const uint8_t *data, uint16_t length, uint16_t crc)
+{
+  while (length--)
+  {
+    crc ^= *data++;
+    for (uint8_t bit = 0; bit < 8; bit++)
+      crc = (crc & 0x0001) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+  }
+  return crc;
+}
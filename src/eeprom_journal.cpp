@@ -0,0 +1,98 @@
+#include "eeprom_journal.h"
+#include <EEPROM.h>
+
+void EEPROMJournal::begin(int from, int to, uint8_t size, uint8_t version)
+{
+  start = from;
+  payload_size = size;
+  this->version = version;
+  slot_count = (to - from) / (size + kOverhead);
+  empty = true;
+
+  uint8_t payload[kMaxPayload];
+  for (uint16_t slot = 0; slot < slot_count; slot++)
+  {
+    uint16_t sequence;
+    if (!load(slot, sequence, payload))
+      continue;
+    if (empty || (int16_t) (sequence - seq) > 0)
+    {
+      head = slot;
+      seq = sequence;
+      empty = false;
+    }
+  }
+  if (empty)
+  {
+    head = 0;
+    seq = 0;
+  }
+}
+
+bool EEPROMJournal::load(uint16_t slot, uint16_t &sequence, uint8_t *payload) const
+{
+  uint8_t record[kMaxPayload + kOverhead];
+  int addr = address(slot);
+  for (uint8_t i = 0; i < payload_size + kOverhead; i++)
+    record[i] = EEPROM.read(addr + i);
+  uint16_t crc = record[payload_size + 3] | (record[payload_size + 4] << 8);
+  if (record[0] != version || Crc16(record, payload_size + 3) != crc)
+    return false;
+  sequence = record[1] | (record[2] << 8);
+  memcpy(payload, record + 3, payload_size);
+  return true;
+}
+
+bool EEPROMJournal::read(void *payload) const
+{
+  uint16_t sequence;
+  return !empty && load(head, sequence, (uint8_t *) payload);
+}
+
+bool EEPROMJournal::readBack(uint16_t age, void *payload) const
+{
+  // The older records have the sequence numbers counting down behind the
+  // head, a slot that was never written or got torn ends the history
+  if (empty || age >= slot_count)
+    return false;
+  uint16_t slot = (head + slot_count - age) % slot_count;
+  uint16_t sequence;
+  return load(slot, sequence, (uint8_t *) payload)
+    && sequence == (uint16_t) (seq - age);
+}
+
+void EEPROMJournal::append(const void *payload)
+{
+  if (!empty)
+  {
+    head = (head + 1) % slot_count;
+    seq++;
+  }
+  store(payload);
+}
+
+void EEPROMJournal::rewrite(const void *payload)
+{
+  if (empty)
+    append(payload);
+  else
+    store(payload);
+}
+
+void EEPROMJournal::store(const void *payload)
+{
+  uint8_t record[kMaxPayload + kOverhead];
+  record[0] = version;
+  record[1] = seq & 0xFF;
+  record[2] = seq >> 8;
+  memcpy(record + 3, payload, payload_size);
+  uint16_t crc = Crc16(record, payload_size + 3);
+  record[payload_size + 3] = crc & 0xFF;
+  record[payload_size + 4] = crc >> 8;
+
+  // The checksum goes last, a torn record is never taken as valid
+  int addr = address(head);
+  for (uint8_t i = 0; i < payload_size + kOverhead; i++)
+    EEPROM.update(addr + i, record[i]);
+  empty = false;
+}
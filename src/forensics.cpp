@@ -0,0 +1,116 @@
+#include "forensics.h"
+#include <avr/io.h>
+
+volatile uint8_t Forensics::section = Forensics::kNoSection;
+
+void Forensics::begin(int from, const char *const *names)
+{
+  this->names = names;
+  ring.begin(from, from + size(), sizeof(CrashRecord), kVersion);
+
+  // The reset after a snapshot completes its record, MCUSR is gone by now
+  CrashRecord record;
+  if (ring.read(&record) && (record.cause & kSnapshot))
+  {
+    record.cause = _BV(WDRF);
+    ring.rewrite(&record);
+  }
+}
+
+void Forensics::passEnd()
+{
+  uint32_t us = micros() - pass_start;
+  uint32_t now = millis();
+  if (now - window_start >= kWindow)
+  {
+    last_max = window_max;
+    window_max = 0;
+    window_start = now;
+  }
+  if (us > window_max)
+    window_max = us;
+  in_pass = false;
+}
+
+uint32_t Forensics::longest() const
+{
+  uint32_t longest = window_max > last_max ? window_max : last_max;
+  uint32_t running = micros() - pass_start;
+  return (in_pass && running > longest) ? running : longest;
+}
+
+void Forensics::snapshot(uint8_t reactor, uint8_t step)
+{
+  CrashRecord record;
+  record.cause = kSnapshot;
+  record.section = section;
+  record.reactor = reactor;
+  record.step = step;
+  #ifdef __AVR__
+  record.stack = SP;
+  #else
+  record.stack = 0;
+  #endif
+  record.longest_us = longest();
+  record.uptime_s = millis() / 1000UL;
+  ring.append(&record);
+}
+
+uint8_t Forensics::count() const
+{
+  CrashRecord record;
+  uint8_t n = 0;
+  while (n < kRecords && ring.readBack(n, &record))
+    n++;
+  return n;
+}
+
+bool Forensics::record(uint8_t age, CrashRecord &record) const
+{
+  return ring.readBack(age, &record);
+}
+
+const __FlashStringHelper *Forensics::causeName(uint8_t cause)
+{
+  if (cause & (kSnapshot | _BV(WDRF)))
+    return F("WDT");
+  return F("???");
+}
+
+const __FlashStringHelper *Forensics::sectionName(uint8_t section) const
+{
+  if (!names || section == kNoSection)
+    return F("-");
+  return (const __FlashStringHelper *) pgm_read_ptr(&names[section]);
+}
+
+void Forensics::report(Print &out) const
+{
+  CrashRecord record;
+  uint8_t age = 0;
+  for (; age < kRecords && ring.readBack(age, &record); age++)
+  {
+    out.print(F("crash "));
+    out.print(age + 1);
+    out.print(F(": "));
+    out.print(causeName(record.cause));
+    out.print(F(" in "));
+    out.print(sectionName(record.section));
+    if (record.reactor != kNoReactor)
+    {
+      out.print(F(", reactor "));
+      out.print(record.reactor + 1);
+      out.print(F(" step "));
+      out.print(record.step + 1);
+    }
+    out.print(F(", longest pass "));
+    out.print(record.longest_us);
+    out.print(F(" us, stack 0x"));
+    out.print(record.stack, HEX);
+    out.print(F(", at "));
+    out.print(record.uptime_s);
+    out.println(F(" s"));
+  }
+  if (!age)
+    out.println(F("crash: none recorded"));
+}
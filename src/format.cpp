@@ -0,0 +1,80 @@
+#include "format.h"
+
+char *FormatUnsigned(char *out, uint32_t value, uint8_t width, uint8_t digits)
+{
+  // Digits from the back, then move them behind the padding
+  char tmp[10];
+  uint8_t count = 0;
+  do
+  {
+    uint8_t digit;
+    value = DivMod10(value, digit);
+    tmp[count++] = '0' + digit;
+  } while (value);
+  while (count < digits && count < sizeof(tmp))
+    tmp[count++] = '0';
+
+  while (count < width--)
+    *out++ = ' ';
+  while (count)
+    *out++ = tmp[--count];
+  *out = '\0';
+  return out;
+}
+
+char *FormatText(char *out, const __FlashStringHelper *text)
+{
+  strcpy_P(out, (const char *) text);
+  return out + strlen(out);
+}
+
+static uint32_t Seconds(uint32_t ms)
+{
+  uint8_t digit;
+  return DivMod10(DivMod10(DivMod10(ms, digit), digit), digit);
+}
+
+// Minutes and the seconds within the minute
+static uint32_t SplitMinute(uint32_t seconds, uint8_t &second)
+{
+  // seconds / 60 as seconds / 10 / 2 / 3, the division by 3 with shifts
+  // and adds like DivMod10
+  uint8_t digit;
+  uint32_t tens = DivMod10(seconds, digit);
+  uint32_t half = tens >> 1;
+  uint32_t q = (half >> 2) + (half >> 4);
+  q += q >> 4;
+  q += q >> 8;
+  q += q >> 16;
+  // 0 <= r <= 15
+  uint8_t r = half - ((q << 1) + q);
+  q += (11 * r) >> 5;
+  second = (tens - ((q << 2) + (q << 1))) * 10 + digit;
+  return q;
+}
+
+char *FormatSeconds(char *out, uint32_t ms, uint8_t width)
+{
+  return FormatUnsigned(out, Seconds(ms), width);
+}
+
+char *FormatClock(char *out, uint32_t ms)
+{
+  uint8_t second;
+  uint8_t minute;
+  uint32_t hours = SplitMinute(SplitMinute(Seconds(ms), second), minute);
+  out = FormatUnsigned(out, hours, 2, 2);
+  *out++ = ':';
+  out = FormatUnsigned(out, minute, 2, 2);
+  *out++ = ':';
+  return FormatUnsigned(out, second, 2, 2);
+}
+
+char *FormatMinSec(char *out, uint32_t ms)
+{
+  uint8_t second;
+  uint32_t minutes = SplitMinute(Seconds(ms), second);
+  out = FormatUnsigned(out, minutes, 2, 2);
+  *out++ = ':';
+  return FormatUnsigned(out, second, 2, 2);
+}
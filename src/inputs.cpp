@@ -0,0 +1,111 @@
+#include "inputs.h"
+
+namespace
+{
+  // Step for each (previous state << 2 | state), the state being A << 1 | B.
+  // No change and a jump over a state count 0.
+  const int8_t kQuadratureSteps[16] = {
+    0, -1, 1, 0,
+    1, 0, 0, -1,
+    -1, 0, 0, 1,
+    0, 1, -1, 0
+  };
+
+  // Keeps the compiler from moving queue accesses across the index update
+  inline void Barrier()
+  {
+    __asm__ __volatile__("" ::: "memory");
+  }
+}
+
+void Inputs::begin(uint8_t pin_a, uint8_t pin_b, uint8_t button_pin, uint8_t debounce_ms)
+{
+  this->pin_a = pin_a;
+  this->pin_b = pin_b;
+  this->button_pin = button_pin;
+  this->debounce_ms = debounce_ms;
+  pinMode(pin_a, INPUT_PULLUP);
+  pinMode(pin_b, INPUT_PULLUP);
+
+  // take over the initial state, a button held at power on is no press
+  quadrature = (digitalRead(pin_a) << 1) | digitalRead(pin_b);
+  button_stable = digitalRead(button_pin);
+
+  // Timer0 counts the millis(), its compare match A interrupt is unused.
+  // Halfway through the count it doesn't coincide with the overflow.
+  OCR0A = 0x80;
+  TIMSK0 |= _BV(OCIE0A);
+}
+
+void Inputs::sample()
+{
+  uint32_t now = millis();
+
+  uint8_t state = (digitalRead(pin_a) << 1) | digitalRead(pin_b);
+  int8_t step = kQuadratureSteps[(quadrature << 2) | state];
+  quadrature = state;
+  if (step)
+  {
+    if (steps == 0)
+      turn_time = now;
+    steps += step;
+    if (steps >= kStepsPerNotch)
+    {
+      steps = 0;
+      push(ENCODER_RIGHT, turn_time);
+    }
+    else if (steps <= -kStepsPerNotch)
+    {
+      steps = 0;
+      push(ENCODER_LEFT, turn_time);
+    }
+  }
+
+  // A new button level has to be read debounce_ms times in a row
+  uint8_t level = digitalRead(button_pin);
+  if (level == button_stable)
+  {
+    button_count = 0;
+  }
+  else
+  {
+    if (button_count == 0)
+      button_time = now;
+    if (++button_count >= debounce_ms)
+    {
+      button_stable = level;
+      button_count = 0;
+      push(level == LOW ? BUTTON_PRESS : BUTTON_RELEASE, button_time);
+    }
+  }
+}
+
+void Inputs::push(uint8_t type, uint32_t time)
+{
+  uint8_t next = (head + 1) & (kQueueSize - 1);
+  if (next == tail)
+  {
+    dropped_events++;
+    return;
+  }
+  queue[head].type = type;
+  queue[head].time = time;
+  Barrier();
+  head = next;
+
+  uint8_t depth = (head - tail) & (kQueueSize - 1);
+  if (depth > peak_depth)
+    peak_depth = depth;
+}
+
+bool Inputs::pop(InputEvent &event)
+{
+  uint8_t index = tail;
+  if (index == head)
+    return false;
+  Barrier();
+  event = queue[index];
+  Barrier();
+  tail = (index + 1) & (kQueueSize - 1);
+  return true;
+}
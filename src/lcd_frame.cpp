@@ -0,0 +1,101 @@
+#include "lcd_frame.h"
+#include "crc.h"
+
+void LcdFrame::begin(rgb_lcd &lcd)
+{
+  this->lcd = &lcd;
+  clear();
+  invalidate();
+}
+
+void LcdFrame::clear()
+{
+  memset(next, ' ', sizeof(next));
+  col = 0;
+  row = 0;
+}
+
+void LcdFrame::setCursor(uint8_t col, uint8_t row)
+{
+  this->col = col;
+  this->row = row % kRows;
+}
+
+size_t LcdFrame::write(uint8_t c)
+{
+  // Text beyond the last column is dropped like on the LCD itself
+  if (col < kCols)
+    next[row][col] = c;
+  col++;
+  return 1;
+}
+
+void LcdFrame::notify(const __FlashStringHelper *line1, const __FlashStringHelper *line2)
+{
+  const char *lines[kRows] = {(const char *) line1, (const char *) line2};
+  memset(toast, ' ', sizeof(toast));
+  for (uint8_t r = 0; r < kRows; r++)
+  {
+    if (!lines[r])
+      continue;
+    for (uint8_t c = 0; c < kCols; c++)
+    {
+      char ch = pgm_read_byte(lines[r] + c);
+      if (!ch)
+        break;
+      toast[r][c] = ch;
+    }
+  }
+  toast_active = true;
+}
+
+void LcdFrame::dismiss()
+{
+  // the next flush sends the cells where the menu differs from the message
+  toast_active = false;
+}
+
+void LcdFrame::invalidate()
+{
+  // No character on the screen ever matches 0, so every cell is resent
+  memset(shown, 0, sizeof(shown));
+}
+
+bool LcdFrame::flush(uint8_t budget)
+{
+  char (*frame)[kCols] = toast_active ? toast : next;
+  for (uint8_t r = 0; r < kRows; r++)
+  {
+    for (uint8_t c = 0; c < kCols; c++)
+    {
+      if (frame[r][c] == shown[r][c])
+        continue;
+      if (lcd_row != r || lcd_col != c)
+      {
+        if (!budget--)
+          return false;
+        lcd->setCursor(c, r);
+        lcd_col = c;
+        lcd_row = r;
+      }
+      if (!budget--)
+        return false;
+      lcd->write(frame[r][c]);
+      shown[r][c] = frame[r][c];
+      lcd_col++;
+    }
+  }
+  return true;
+}
+
+void LcdFrame::flushAll()
+{
+  while (!flush())
+  {
+  }
+}
+
+uint16_t LcdFrame::crc() const
+{
+  return Crc16((const uint8_t *) shown, sizeof(shown));
+}
@@ -27,89 +27,255 @@ Created:
 
 #include <Arduino.h>
 #include <Wire.h>
-#include <ClickEncoder.h>
-#include <TimerOne.h>
 #include "rgb_lcd.h"
+#include "lcd_frame.h"
+#include "scheduler.h"
+#include "eeprom_journal.h"
+#include "settings_store.h"
+#include "program.h"
+#include "uptime.h"
+#include "duration.h"
+#include "format.h"
+#include "relay_driver.h"
+#include "reactor.h"
+#include "pressure.h"
+#include "inputs.h"
+#include "acceleration.h"
+#include "profiler.h"
+#include "telemetry.h"
+#include "modbus.h"
+#include "forensics.h"
+#include "bench.h"
+#include "trace.h"
+#include "menu.h"
+#include "stack_monitor.h"
 #include <multi_channel_relay.h>
 #include <limits.h>
 #include <EEPROM.h>
 #include <avr/wdt.h>
+#include <avr/sleep.h>
 
 //#define DEBUG
-#define SERIALDEBUG(a) Serial.print(#a); Serial.print(": "); Serial.println(a);
-#define SERIALDEBUG_ Serial.print("\n");
+#define SERIALDEBUG(a) Serial.print(F(#a)); Serial.print(F(": ")); Serial.println(a);
+#define SERIALDEBUG_ Serial.print(F("\n"));
+
+// Time the sections of loop(), see "Diagnostics" in the crash log
+//#define PROFILE
+// Mark the same sections for the cycle counts on simavr instead, see
+// "Cycle counts" in src/README.md
+//#define BENCH
+#if defined(BENCH) && defined(PROFILE)
+#error "BENCH and PROFILE both time the sections"
+#endif
+#ifdef PROFILE
+#define PROFILE_SECTION(id) ProfileScope profile_scope(profiler, id);
+#elif defined(BENCH)
+#define PROFILE_SECTION(id) BenchScope bench_scope(id);
+#else
+#define PROFILE_SECTION(id)
+#endif
+// The section a watchdog snapshot names, timed with PROFILE as well. The
+// interrupts only use PROFILE_SECTION().
+#define LOOP_SECTION(id) SectionMark section_mark(id); PROFILE_SECTION(id)
+
+// Binary status records over the USB serial port, see TelemetryType and
+// scripts/telemetry.py. The port carries either these or the DEBUG text.
+//#define TELEMETRY
+#if defined(TELEMETRY) && (defined(DEBUG) || defined(PROFILE))
+#error "TELEMETRY shares the serial port with DEBUG and PROFILE"
+#endif
+
+// Modbus RTU slave on the USB serial port, see the register map at
+// ModbusReadInput(). It needs the port to itself as well.
+//#define MODBUS
+#if defined(MODBUS) && (defined(TELEMETRY) || defined(DEBUG) || defined(PROFILE))
+#error "MODBUS shares the serial port with TELEMETRY, DEBUG and PROFILE"
+#endif
+const uint8_t modbus_address = 1;
+
+// Inputs and their effects in a RAM ring, a 't' sent to the serial port
+// prints it, see scripts/trace_replay.py
+//#define TRACE
+#if defined(TRACE) && (defined(TELEMETRY) || defined(MODBUS))
+#error "TRACE shares the serial port with TELEMETRY and MODBUS"
+#endif
+
+// Sleep between the deadlines instead of running loop() all the time,
+// comment it out for the busy loop
+#define IDLE_SLEEP
+// Longest sleep, well within the 8 s of the watchdog
+const uint32_t max_idle = 1000;
 
 // Grove Encoder
 #define ENCODER_PIN1 A0
 #define ENCODER_PIN2 A1
-#define WITHOUT_BUTTON
-ClickEncoder *encoder;
-int16_t encoder_last, encoder_value;
+
+// Pressure transducer for the TMP, ends the filtration on the pressure
+// instead of the timer, see filtration_policy
+//#define TMP_SENSOR
+const uint8_t tmp_pin = A2;
+uint32_t tmp_interval = 100;
+PressureSensor tmp_sensor;
+
 
 // Grove Button
 const uint8_t button_pin = 5;
 const uint8_t button_led_pin = 4;
 const bool breath_mode = true;
-uint8_t button_state;
-uint8_t button_last_state = HIGH;
 uint8_t button_led_state = LOW;
 uint16_t button_led_fade_value = 0; // could maybe deleted
 uint8_t button_led_fade_step = 50; // could maybe deleted
 uint8_t button_led_fade_interval = 20; // could maybe deleted
-uint32_t last_debounce_time = 0;
-uint32_t debounce_delay = 50;
-uint32_t last_led_fade_time = 0; // rename to last_led_ping
+uint8_t debounce_delay = 50;
+Inputs inputs;
+Acceleration acceleration;
+uint32_t button_led_breath_interval = 700;
+uint32_t relay_verify_interval = 100;
+// a board switches this long after another one at the earliest
+uint32_t relay_stagger = 20;
 
 Multi_Channel_Relay relay;
 rgb_lcd lcd;
+LcdFrame screen;
+// the last flush() sent everything
+bool lcd_synced = true;
+
+Scheduler tasks;
+uint8_t task_refresh;
+uint8_t task_button_led;
+uint8_t task_toast;
+// The tasks setup() adds: refresh, button led, toast, relay check,
+// checkpoint and the ones of the build options
+constexpr uint8_t task_count = 5
+  #ifdef TMP_SENSOR
+  + 1
+  #endif
+  #ifdef DEBUG
+  + 1
+  #endif
+  #ifdef TELEMETRY
+  + 1
+  #endif
+  ;
+static_assert(task_count <= Scheduler::kMaxTasks, "too many tasks");
+const uint32_t toast_duration = 2000;
 
-uint8_t menu_main = 1;
-int8_t menu_settings = -1;
-bool state_running = false;
-bool update_menu_again = false;
+Menu menu;
 uint8_t menu_setting_pos = 0;
 bool menu_setting_edit = false;
 
-enum MenuMain
+enum MainEntries
 {
-  BEGIN_MM, // could maybe deleted
-  START_STOP_MM,
-  SETTINGS_MM,
-  END_MM // could maybe deleted
+  // only with more than one reactor
+  REACTOR_ME,
+  START_STOP_ME,
+  SETTINGS_ME
 };
 
-enum MenuSettings
-{
-  BEGIN_MS, // could maybe delted
-  RETURN_MS,
-  FILTRATION_MS,
-  GAS_JET_MS,
-  PRESSURE_RELIEF_MS,
-  WAITING_MS,
-  EEPROM_SAVE_MS,
-  EEPROM_LOAD_MS,
-  RESET_MS,
-  FAILSAVE_MS,
-  END_MS, // could maybe deleted
-  COUNTER_MS
+/*
+
+The cycle, edit this table for a different recipe. Steps with STEP_SETTING
+get a menu entry and keep their duration in the EEPROM, so increase
+settings_version when they change.
+
+A double backflush would be
+
+  {step_gas_jet, CHANNLE3_BIT, 0, STEP_SETTING, 2, 0, 0},
+  {step_close_all, 0, 2000UL, 0, 2, 2, 1},
+
+which runs the gas jet and the following pause twice. The table and the
+names are kept in flash.
+
+*/
+const char step_filtration[] PROGMEM = "Filtration";
+const char step_close_all[] PROGMEM = "Close All";
+const char step_gas_jet[] PROGMEM = "Gas-Jet";
+const char step_pressure_relief[] PROGMEM = "Pressure Relief";
+const char step_waiting[] PROGMEM = "Waiting";
+
+constexpr Step program[] PROGMEM = {
+  // name, relays, default ms, flags, resume, loop to, repeat
+  {step_filtration, CHANNLE1_BIT, 0, STEP_SETTING | STEP_ADAPTIVE, 0, 0, 0},
+  {step_close_all, 0, 2000UL, 0, 2, 0, 0},
+  {step_gas_jet, CHANNLE3_BIT, 0, STEP_SETTING, 2, 0, 0},
+  {step_close_all, 0, 2000UL, 0, 4, 0, 0},
+  {step_pressure_relief, CHANNLE2_BIT, 0, STEP_SETTING, 4, 0, 0},
+  {step_waiting, 0, 0, STEP_SETTING, 5, 0, 0}
 };
+constexpr uint8_t program_length = sizeof(program) / sizeof(program[0]);
+static_assert(program_length <= Sequencer::kMaxSteps, "program too long");
 
-struct State
-{
-  char name[17];
-  uint32_t interval;
-  uint8_t relay_setting;
-} state_list[6];
+// With TMP_SENSOR the filtration ends at 250 mbar, but runs at least half
+// and at most three times its set duration
+constexpr AdaptivePolicy filtration_policy PROGMEM = {250, 50, 300};
+
+/*
 
-enum StateIndex
+The reactors, each with its own relay board and program. A single board
+is moved to its address at boot. With several, every board must already
+have its address (Multi_Channel_Relay::changeI2CAddress()) and the main
+menu gets an entry to switch between them. REACTOR_BANK runs eight
+reactors on the boards 0x11 to 0x18. The TMP sensor belongs to the
+reactors with a policy.
+
+*/
+//#define REACTOR_BANK
+
+struct ReactorConfig
 {
-  FILTRATION,
-  CLOSE_ALL1,
-  GAS_JET,
-  CLOSE_ALL2,
-  PRESSURE_RELIEF,
-  WAITING
+  uint8_t address;
+  const Step *program;
+  uint8_t length;
+  // nullptr for a fixed schedule
+  const AdaptivePolicy *policy;
+};
+
+constexpr ReactorConfig reactor_configs[] PROGMEM = {
+  // relay board, program, policy
+  {0x11, program, program_length, &filtration_policy},
+  #ifdef REACTOR_BANK
+  {0x12, program, program_length, nullptr},
+  {0x13, program, program_length, nullptr},
+  {0x14, program, program_length, nullptr},
+  {0x15, program, program_length, nullptr},
+  {0x16, program, program_length, nullptr},
+  {0x17, program, program_length, nullptr},
+  {0x18, program, program_length, nullptr},
+  #endif
 };
+constexpr uint8_t reactor_count = sizeof(reactor_configs) / sizeof(reactor_configs[0]);
+
+constexpr uint8_t MaxLength(const ReactorConfig *configs, uint8_t count)
+{
+  return count == 0 ? 0
+    : (configs[count - 1].length > MaxLength(configs, count - 1)
+      ? configs[count - 1].length : MaxLength(configs, count - 1));
+}
+
+constexpr uint8_t MaxSettings(const ReactorConfig *configs, uint8_t count)
+{
+  return count == 0 ? 0
+    : (CountSettings(configs[count - 1].program, configs[count - 1].length)
+        > MaxSettings(configs, count - 1)
+      ? CountSettings(configs[count - 1].program, configs[count - 1].length)
+      : MaxSettings(configs, count - 1));
+}
+
+constexpr uint8_t max_length = MaxLength(reactor_configs, reactor_count);
+constexpr uint8_t max_settings = MaxSettings(reactor_configs, reactor_count);
+
+Reactor reactors[reactor_count];
+Duration step_durations[reactor_count][max_length];
+uint8_t step_passes[reactor_count][max_length];
+#ifdef DEBUG
+// How late the steps ended, only DEBUG reports them
+Reactor::Stats step_stats[reactor_count][max_length];
+#endif
+// The reactor shown and edited in the menu
+uint8_t selected = 0;
+// A bit per relay board that failed its last check, marked on the LCD
+uint8_t relay_faults = 0;
+static_assert(reactor_count <= 8, "one fault bit per relay board");
 
 enum Action
 {
@@ -118,850 +284,1681 @@ enum Action
   SELECT
 };
 
-bool execute = false;
-uint8_t state_index = 0;
-uint32_t time_start = 0;
-uint32_t interval = 0;
-
 enum TimeSetting
 {
   MINUTE,
   HOUR
 };
 
-char buf[17] = {'\0'};
-char hour[3] = {'\0'};
-char min[3] = {'\0'};
-char sec[3] = {'\0'}; // increase size to 10
-char remaining[10] = {'\0'}; // delete it and replace with sec
-
-struct Failsafe
-{
-  bool status_filtration;
-  bool status_gas_jet;
-  bool status_pressure_relief;
-  bool status_waiting;
-  uint32_t filtration_interval;
-  uint32_t gas_jet_interval;
-  uint32_t pressure_relief_interval;
-  uint32_t waiting_interval;
-  uint32_t counter;
-  bool error;
+// One LCD row, shared by everything that formats numbers for it
+char line[LcdFrame::kCols + 1] = {'\0'};
+
+/*
+
+Failsafe record, one journal record whenever it changes. A step that
+continues with itself after a crash checkpoints its elapsed time every
+checkpoint_interval, and a restart continues with the rest of it. Every
+checkpoint is a journal record, so the interval is the wear budget of
+the checkpoints: a 4 h filtration with 5 min adds 48 records to the 6
+of the cycle. A step that was resumed crash_resumes times in a row
+without a checkpoint in between is skipped, so a crash loop can't hold
+up the backflush.
+
+*/
+const uint32_t checkpoint_interval = 5UL * 60UL * 1000UL;
+const uint8_t crash_resumes = 2;
+// how often the task looks for a checkpoint that is due
+const uint32_t checkpoint_check = 10000;
+
+struct FailsafeRecord
+{
+  // Reactor::status() of every reactor
+  uint8_t statuses[reactor_count];
+  // elapsed time of the step in checkpoint_interval
+  uint8_t progress[reactor_count];
+  // restarts into the step since its last checkpoint
+  uint8_t strikes[reactor_count];
 } failsafe;
+static_assert(sizeof(FailsafeRecord) <= EEPROMJournal::kMaxPayload, "too many reactors");
+// Increase failsafe_version whenever FailsafeRecord changes, a record of
+// another layout is discarded and every reactor comes up stopped.
+// 1: statuses only, 2: progress and strikes of the checkpoints
+const uint8_t failsafe_version = 2;
+// the reactor was running when the controller crashed
+bool crashed[reactor_count];
+// step index the progress and strikes of the record count for, steps
+// that resume the same one share a status
+uint8_t status_steps[reactor_count];
+
+#ifdef TELEMETRY
+/*
+
+The records on the serial port. TelemetryTask sends the status of one
+reactor per telemetry_interval, and the loop statistics after the last
+one. A step record follows every step change. The CrashRecords go out
+once at boot, the oldest first.
+
+*/
+enum TelemetryType : uint8_t
+{
+  STATUS_TM = 1,
+  STEP_TM,
+  LOOP_TM,
+  CRASH_TM
+};
+
+struct __attribute__((packed)) StatusRecord
+{
+  uint8_t reactor;
+  uint8_t step;
+  uint8_t relays;
+  // Reactor::status(), 0 while stopped
+  uint8_t status;
+  uint8_t paused;
+  uint32_t remaining_ms;
+  uint32_t crashes;
+  uint32_t uptime_ms;
+};
+
+struct __attribute__((packed)) StepRecord
+{
+  uint8_t reactor;
+  uint8_t step;
+  uint8_t relays;
+  uint32_t uptime_ms;
+};
+
+struct __attribute__((packed)) LoopRecord
+{
+  // since the last loop record
+  uint32_t passes;
+  uint32_t max_us;
+  // records that didn't fit into the buffer so far
+  uint32_t dropped;
+  uint32_t uptime_ms;
+};
+
+Telemetry telemetry;
+uint32_t telemetry_interval = 1000;
+uint32_t loop_passes = 0;
+uint32_t loop_max_us = 0;
+#endif
+
+// Everything in the EEPROM except the failsafe status, one record per
+// reactor. Increase settings_version whenever the layout changes. The
+// records are read when they are needed, a copy of all of them would
+// take 36 bytes of RAM per reactor, only the crash counters are kept.
+const uint8_t settings_version = 1;
+struct StoredSettings
+{
+  // saved by SettingsSave()
+  uint32_t intervals[max_settings];
+  // intervals of the running cycle, restored after a crash
+  uint32_t failsafe_intervals[max_settings];
+  uint32_t failsafe_counter;
+};
+uint32_t failsafe_counters[reactor_count];
+static_assert(sizeof(StoredSettings) <= SettingsStore::kMaxSize, "too many settings");
 
 struct EEPROMAddresses
 {
-  // settings
-  int s_filtration;
-  int s_gas_jet;
-  int s_pressure_relief;
-  int s_waiting;
-  // failsafe
-  int fs_status_filtration;
-  int fs_status_gas_jet;
-  int fs_status_pressure_relief;
-  int fs_status_waiting;
-  int fs_interval_filtration;
-  int fs_interval_gas_jet;
-  int fs_interval_pressure_relief;
-  int fs_interval_waiting;
-  int fs_counter;
+  int settings;
+  int fs_journal;
+  // the crash records at the end
+  int crashes;
 } addr;
 
-// Grove Encoder
-void timerIsr() {
-  encoder->service();
+SettingsStore settings_stores[reactor_count];
+// Failsafe records, see FailsafeRecord
+EEPROMJournal status_journal;
+
+// Sections of the loop for the crash records, the profiler and the bench,
+// the names in the same order
+enum ProfileSections
+{
+  PROFILE_LOOP,
+  PROFILE_INPUT,
+  PROFILE_ACTION,
+  PROFILE_MENU,
+  PROFILE_LCD,
+  PROFILE_EEPROM,
+  PROFILE_RELAY,
+  PROFILE_WDT,
+  PROFILE_INPUT_ISR,
+  PROFILE_FAILSAFE,
+  PROFILE_SECTIONS
+};
+const char section_loop[] PROGMEM = "loop";
+const char section_input[] PROGMEM = "input";
+const char section_action[] PROGMEM = "action";
+const char section_menu[] PROGMEM = "menu";
+const char section_lcd[] PROGMEM = "lcd";
+const char section_eeprom[] PROGMEM = "eeprom";
+const char section_relay[] PROGMEM = "relay";
+const char section_wdt[] PROGMEM = "wdt";
+const char section_input_isr[] PROGMEM = "input isr";
+const char section_failsafe[] PROGMEM = "failsafe";
+const char *const section_names[PROFILE_SECTIONS] PROGMEM = {
+  section_loop, section_input, section_action, section_menu, section_lcd,
+  section_eeprom, section_relay, section_wdt, section_input_isr, section_failsafe
+};
+
+Forensics forensics;
+// The reactor the loop handled last, for the crash records
+volatile uint8_t handled_reactor = Forensics::kNoReactor;
+
+#ifdef TRACE
+Trace trace;
+// Last traced phase of every reactor, run state << 16 | step << 8 | relays
+uint32_t traced_phases[reactor_count];
+#endif
+
+#ifdef PROFILE
+static_assert(PROFILE_SECTIONS <= Profiler::kMaxSections, "too many sections");
+Profiler profiler;
+uint8_t diagnostics_section = 0;
+
+ISR(TIMER1_OVF_vect)
+{
+  Profiler::overflow();
 }
+#endif
 
-void CalcEEPROMAdresses()
+// Grove Encoder and Button
+ISR(TIMER0_COMPA_vect)
+{
+  PROFILE_SECTION(PROFILE_INPUT_ISR)
+  inputs.sample();
+}
+
+// First watchdog timeout, the loop hung for 8 s
+ISR(WDT_vect)
+{
+  uint8_t r = handled_reactor;
+  forensics.snapshot(r, r < reactor_count ? reactors[r].sequencer.index() : 0);
+  // reset right away instead of after another timeout
+  wdt_enable(WDTO_15MS);
+  for (;;)
+    delayMicroseconds(1000);
+}
+
+#ifdef TMP_SENSOR
+// Conversion started by the Timer0 compare match
+ISR(ADC_vect)
+{
+  tmp_sensor.sample(ADC);
+}
+#endif
+
+Reactor &Selected()
+{
+  return reactors[selected];
+}
+
+bool AnyRunning()
+{
+  for (uint8_t r = 0; r < reactor_count; r++)
+    if (reactors[r].running())
+      return true;
+  return false;
+}
+
+Duration Remaining()
+{
+  /*
+  Time left of the step of the selected reactor
+  */
+  return Selected().remaining(UptimeUs());
+}
+
+void ToastTask()
 {
-  addr.s_filtration = 0;
-  addr.s_gas_jet = sizeof(state_list[StateIndex::FILTRATION].interval);
-  addr.s_pressure_relief = addr.s_gas_jet + sizeof(state_list[StateIndex::GAS_JET].interval);
-  addr.s_waiting = addr.s_pressure_relief + sizeof(state_list[StateIndex::PRESSURE_RELIEF].interval);
-  addr.fs_status_filtration = addr.s_waiting + sizeof(state_list[StateIndex::WAITING].interval);
-  addr.fs_status_gas_jet = addr.fs_status_filtration + sizeof(failsafe.status_filtration);
-  addr.fs_status_pressure_relief = addr.fs_status_gas_jet + sizeof(failsafe.status_gas_jet);
-  addr.fs_status_waiting = addr.fs_status_pressure_relief + sizeof(failsafe.status_pressure_relief);
-  addr.fs_interval_filtration = addr.fs_status_waiting + sizeof(failsafe.status_waiting);
-  addr.fs_interval_gas_jet = addr.fs_interval_filtration + sizeof(failsafe.filtration_interval);
-  addr.fs_interval_pressure_relief = addr.fs_interval_gas_jet + sizeof(failsafe.gas_jet_interval);
-  addr.fs_interval_waiting = addr.fs_interval_pressure_relief + sizeof(failsafe.pressure_relief_interval);
-  addr.fs_counter = addr.fs_interval_waiting + sizeof(failsafe.waiting_interval);
+  screen.dismiss();
 }
 
-void SettingsSave()
+void Notify(const __FlashStringHelper *message)
 {
   /*
-  Save the time settings in the EEPROM
+  Show a message over the current screen for toast_duration without
+  blocking the loop
   */
-  EEPROM.put(addr.s_filtration, state_list[StateIndex::FILTRATION].interval);
-  EEPROM.put(addr.s_gas_jet, state_list[StateIndex::GAS_JET].interval);
-  EEPROM.put(addr.s_pressure_relief, state_list[StateIndex::PRESSURE_RELIEF].interval);
-  EEPROM.put(addr.s_waiting, state_list[StateIndex::WAITING].interval);
-  lcd.clear();
-  lcd.print("Settings Saved");
-  delay(2000);
+  screen.notify(message);
+  tasks.start(task_toast, toast_duration);
 }
 
-void SettingsLoad()
+void updateMenu();
+
+void RelayTask()
 {
   /*
-  Load the time settings in the EEPROM
+  Read one relay board back per run, FlushRelays() restores the channels
+  after a brownout
   */
-  if (failsafe.error)
-  {
-    state_list[StateIndex::FILTRATION].interval = failsafe.filtration_interval;
-    state_list[StateIndex::GAS_JET].interval = failsafe.gas_jet_interval;
-    state_list[StateIndex::PRESSURE_RELIEF].interval = failsafe.pressure_relief_interval;;
-    state_list[StateIndex::WAITING].interval = failsafe.waiting_interval;
-  }
-  else
+  LOOP_SECTION(PROFILE_RELAY)
+  static uint8_t board = 0;
+  handled_reactor = board;
+  uint8_t bit = 1 << board;
+  uint8_t faults = reactors[board].relays.verify()
+    ? relay_faults & ~bit : relay_faults | bit;
+  // the message once when the board fails, the mark stays until it answers
+  if (faults & ~relay_faults)
+    Notify(F("Relay Error"));
+  if (faults != relay_faults)
   {
-    EEPROM.get(addr.s_filtration, state_list[StateIndex::FILTRATION].interval);
-    EEPROM.get(addr.s_gas_jet, state_list[StateIndex::GAS_JET].interval);
-    EEPROM.get(addr.s_pressure_relief, state_list[StateIndex::PRESSURE_RELIEF].interval);
-    EEPROM.get(addr.s_waiting, state_list[StateIndex::WAITING].interval);
+    relay_faults = faults;
+    updateMenu();
   }
+  board = (board + 1) % reactor_count;
+}
 
-  lcd.clear();
-  lcd.print("Settings Loaded");
-  delay(2000);
+#ifdef TMP_SENSOR
+void SensorTask()
+{
+  /*
+  Hand the filtered TMP to the reactors with a policy, they fall back to
+  their timers while there is no valid reading
+  */
+  static bool valid = true;
+  int16_t tmp = tmp_sensor.mbar();
+  for (uint8_t r = 0; r < reactor_count; r++)
+    if (reactors[r].adaptive())
+      reactors[r].pressure(tmp);
+  if (valid && tmp == PressureSensor::kNoPressure)
+    Notify(F("Sensor Error"));
+  valid = tmp != PressureSensor::kNoPressure;
 }
+#endif
 
-bool CheckFailsafe()
+void FlushRelays()
 {
   /*
-  Check if the microcontroler crashed and continue the execution
+  Send the changed relay masks, at most one board per call. Another board
+  only switches relay_stagger ms after the last one, so the inrush of
+  simultaneous steps is spread out. The boards take turns.
   */
-  failsafe.error = false;
-  EEPROM.get(addr.fs_status_filtration, failsafe.status_filtration);
-  EEPROM.get(addr.fs_status_gas_jet, failsafe.status_gas_jet);
-  EEPROM.get(addr.fs_status_pressure_relief, failsafe.status_pressure_relief);
-  EEPROM.get(addr.fs_status_waiting, failsafe.status_waiting);
-  EEPROM.get(addr.fs_interval_filtration, failsafe.filtration_interval);
-  EEPROM.get(addr.fs_interval_gas_jet, failsafe.gas_jet_interval);
-  EEPROM.get(addr.fs_interval_pressure_relief, failsafe.pressure_relief_interval);
-  EEPROM.get(addr.fs_interval_waiting, failsafe.waiting_interval);
-  EEPROM.get(addr.fs_counter, failsafe.counter);
-  
-  if (failsafe.status_filtration)
-  {
-    state_index = StateIndex::FILTRATION;
-    failsafe.error = true;
-    EEPROM.put(addr.fs_status_filtration, false);
-  }
-  if (failsafe.status_gas_jet)
-  {
-    state_index = StateIndex::GAS_JET;
-    failsafe.error = true;
-    EEPROM.put(addr.fs_status_gas_jet, false);
-  }
-  if (failsafe.status_pressure_relief)
-  {
-    state_index = StateIndex::PRESSURE_RELIEF;
-    failsafe.error = true;
-    EEPROM.put(addr.fs_status_pressure_relief, false);
-  }
-  if (failsafe.status_waiting)
+  LOOP_SECTION(PROFILE_RELAY)
+  static uint8_t next = 0;
+  static uint8_t last = 0;
+  static uint32_t switched = 0;
+  bool sent = false;
+  for (uint8_t n = 0; n < reactor_count; n++)
   {
-    state_index = StateIndex::WAITING;
-    failsafe.error = true;
-    EEPROM.put(addr.fs_status_waiting, false);
+    uint8_t r = (next + n) % reactor_count;
+    RelayDriver &board = reactors[r].relays;
+    handled_reactor = r;
+    if (board.changed())
+    {
+      if (sent || (r != last && millis() - switched < relay_stagger))
+        continue;
+      sent = true;
+      last = r;
+      switched = millis();
+      next = (r + 1) % reactor_count;
+    }
+    board.flush();
   }
+}
 
-  if (failsafe.error)
-  {
-    state_running = true;
-    EEPROM.put(addr.fs_counter, ++failsafe.counter);
-    return false;
-  }
-  else
+void CalcEEPROMAdresses()
+{
+  // A/B copies of the settings of each reactor, the journal takes the rest
+  // of the EEPROM up to the crash records
+  addr.settings = 0;
+  int address = addr.settings;
+  for (uint8_t r = 0; r < reactor_count; r++)
   {
-    return true;
+    settings_stores[r].begin(address, sizeof(StoredSettings), settings_version);
+    address = settings_stores[r].end();
   }
-  
+  addr.fs_journal = address;
+  addr.crashes = EEPROM.length() - Forensics::size();
 }
 
-void SetEEPROMStatus(int address)
+void ReadSettings(uint8_t r, StoredSettings &settings)
 {
-  bool status = false;
-  bool set_status = false;
-
-  set_status = (addr.fs_status_filtration == address);
-  EEPROM.get(addr.fs_status_filtration, status);
-  if (status != set_status)
-    EEPROM.put(addr.fs_status_filtration, set_status);
-
-  set_status = (addr.fs_status_gas_jet == address);
-  EEPROM.get(addr.fs_status_gas_jet, status);
-  if (status !=  set_status)
-    EEPROM.put(addr.fs_status_gas_jet, set_status);
-
-  set_status = (addr.fs_status_pressure_relief == address);
-  EEPROM.get(addr.fs_status_pressure_relief, status);
-  if (status != set_status)
-    EEPROM.put(addr.fs_status_pressure_relief, set_status);
-
-  set_status = (addr.fs_status_waiting == address);
-  EEPROM.get(addr.fs_status_waiting, status);
-  if (status != set_status)
-    EEPROM.put(addr.fs_status_waiting, set_status);
+  /*
+  The settings record of a reactor, all 0 if neither copy is valid
+  */
+  if (!settings_stores[r].reload(&settings))
+    memset(&settings, 0, sizeof(settings));
 }
 
-void SaveIntervalsToEEPROM()
+void SettingsSave(uint8_t r)
 {
-  uint32_t fs_interval = 0;
-  EEPROM.get(addr.fs_interval_filtration, fs_interval);
-  if (fs_interval != state_list[StateIndex::FILTRATION].interval)
-    EEPROM.put(addr.fs_interval_filtration, state_list[StateIndex::FILTRATION].interval);
-
-  EEPROM.get(addr.fs_interval_gas_jet, fs_interval);
-  if (fs_interval != state_list[StateIndex::GAS_JET].interval)
-    EEPROM.put(addr.fs_interval_gas_jet, state_list[StateIndex::GAS_JET].interval);
-    
-  EEPROM.get(addr.fs_interval_pressure_relief, fs_interval);
-  if (fs_interval != state_list[StateIndex::PRESSURE_RELIEF].interval)
-    EEPROM.put(addr.fs_interval_pressure_relief, state_list[StateIndex::PRESSURE_RELIEF].interval);
-
-  EEPROM.get(addr.fs_interval_waiting, fs_interval);
-  if (fs_interval != state_list[StateIndex::WAITING].interval)
-    EEPROM.put(addr.fs_interval_waiting, state_list[StateIndex::WAITING].interval);
+  /*
+  Save the time settings of a reactor in the EEPROM
+  */
+  LOOP_SECTION(PROFILE_EEPROM)
+  Sequencer &sequencer = reactors[r].sequencer;
+  StoredSettings settings;
+  ReadSettings(r, settings);
+  for (uint8_t i = 0; i < sequencer.settings(); i++)
+    settings.intervals[i] = step_durations[r][sequencer.settingStep(i)].ms();
+  settings_stores[r].commit(&settings);
+  Notify(F("Settings Saved"));
 }
 
-void Reset()
+void LoadIntervals(uint8_t r)
 {
   /*
-  Reset all settings to the initial conditions except the timings
+  Time settings of a reactor, they were read from the EEPROM at boot. A
+  reactor that was running at a crash continues with the intervals of
+  the interrupted cycle.
   */
-  state_running = false;
-  interval = 0;
-  state_index = 0;
-  menu_main = MenuMain::START_STOP_MM;
-  menu_settings = -1;
-  execute = false;
-  update_menu_again = false;
-  menu_setting_pos = 0;
-  menu_setting_edit = false;
-  // Reset EEPROM to status 0
-  SetEEPROMStatus(0);
-  relay.channelCtrl(0);
+  Sequencer &sequencer = reactors[r].sequencer;
+  StoredSettings settings;
+  ReadSettings(r, settings);
+  for (uint8_t i = 0; i < sequencer.settings(); i++)
+    step_durations[r][sequencer.settingStep(i)] = crashed[r]
+      ? settings.failsafe_intervals[i]
+      : settings.intervals[i];
 }
 
-void menuSetting(const char name[], uint32_t time, TimeSetting time_setting)
+void SettingsLoad(uint8_t r)
 {
   /*
-  Display time settings for given state on the LCD
+  Load the time settings of a reactor
+  */
+  LoadIntervals(r);
+  Notify(F("Settings Loaded"));
+}
 
-  name:         Name of the setting which is displayed on the LCD
-  time:         Time in milli seconds
-  time_setting: Specifies what's the first displayed value
-                TimeSetting::HOUR
-                TimeSetting::MINUTE
+void SaveStatus()
+{
+  /*
+  Append the failsafe record to the journal if it changed
   */
-  hour[0] = '\0';
-  min[0] = '\0';
-  sec[0] = '\0';
-  buf[0] = '\0';
+  LOOP_SECTION(PROFILE_FAILSAFE)
+  FailsafeRecord last;
+  if (!status_journal.read(&last))
+    memset(&last, 0, sizeof(last));
+  if (memcmp(&failsafe, &last, sizeof(last)))
+    status_journal.append(&failsafe);
+}
 
-  lcd.clear();
-  (menu_setting_edit) ? lcd.print(" ") : lcd.print(">");
-  lcd.print(name);
-  lcd.setCursor(0, 1);
+void SetStatus(uint8_t r, uint8_t status)
+{
+  // Another step starts without checkpoints
+  uint8_t step = reactors[r].sequencer.index();
+  if (failsafe.statuses[r] == status && status_steps[r] == step)
+    return;
+  failsafe.statuses[r] = status;
+  status_steps[r] = step;
+  failsafe.progress[r] = 0;
+  failsafe.strikes[r] = 0;
+}
 
-  if (time_setting == TimeSetting::HOUR)
-  {
-    sprintf(hour, "%3.2d", (int) (time / 1000UL / 60UL / 60UL));
-    sprintf(min, "%.2d", (int) (time / 1000UL / 60UL % 60UL));
-  }
-  else if (time_setting == TimeSetting::MINUTE)
+void CheckpointTask()
+{
+  /*
+  Keep the elapsed time of the steps that continue with themselves after
+  a crash, one record per checkpoint_interval of them
+  */
+  uint64_t now = UptimeUs();
+  bool changed = false;
+  for (uint8_t r = 0; r < reactor_count; r++)
   {
-    sprintf(min, "%3.2d", (int) (time / 1000UL / 60UL));
-    sprintf(sec, "%.2d", (int) (time / 1000UL % 60UL));
+    Sequencer &sequencer = reactors[r].sequencer;
+    if (!reactors[r].running() || sequencer.step().resume != sequencer.index())
+      continue;
+    // a record of another step doesn't count for this one
+    if (status_steps[r] != sequencer.index())
+    {
+      SetStatus(r, reactors[r].status());
+      changed = true;
+    }
+    uint32_t done = reactors[r].elapsed(now).ms() / checkpoint_interval;
+    uint8_t progress = done < 0xFF ? done : 0xFF;
+    if (progress == failsafe.progress[r])
+      continue;
+    failsafe.progress[r] = progress;
+    failsafe.strikes[r] = 0;
+    changed = true;
   }
-
-  (menu_setting_edit && menu_setting_pos == 0)
-    ? strcpy(buf, ">")
-    : strcpy(buf, " ");
-  strcat(buf, (time_setting == TimeSetting::HOUR) ? hour : min);
-  strcat(buf, (time_setting == TimeSetting::HOUR) ? "h " : "min ");
-  (menu_setting_edit && menu_setting_pos == 1)
-    ? strcat(buf, ">")
-    : strcat(buf, " ");
-  strcat(buf, (time_setting == TimeSetting::HOUR) ? min : sec);
-  strcat(buf, (time_setting == TimeSetting::HOUR) ? "min" : "sec");
-  lcd.print(buf);
+  if (changed)
+    SaveStatus();
 }
 
-void updateMenu() {
+bool CheckFailsafe()
+{
   /*
-  Display the whole menu on the LCD
+  Check if the microcontroler crashed during a cycle, the reactors that
+  were running continue with the interrupted step after its last
+  checkpoint. They stay running in the record with one more strike, a
+  step with more than crash_resumes goes on with the next one.
   */
-  if (menu_settings == -1)
+  bool crash = false;
+  StoredSettings settings;
+  for (uint8_t r = 0; r < reactor_count; r++)
   {
-    switch (menu_main)
-    {
-    /*
-
-    case MenuMain::BEGIN_MM
-    could be deleted because it should never reach this state
-    it's constrained in executeAction
-
-    */
-    case MenuMain::BEGIN_MM:
-      menu_main = MenuMain::START_STOP_MM;
-      update_menu_again = true;
-      break;
-    case MenuMain::START_STOP_MM:
-      lcd.clear();
-      if (state_running)
-      {
-        lcd.print(" ");
-        lcd.print(state_list[state_index].name);
-        lcd.setCursor(0, 1);
-        //lcd.print(">Stop   Settings");
-        lcd.print(">Stop ");
-        remaining[0] = {'\0'}; // replace with sec and increase size of sec to 10
-        if (interval > 0)
-          sprintf(remaining,
-            "%9d",
-            (int)((interval - (millis() - time_start)) / 1000UL));
-        else
-          sprintf(remaining,
-            "%9d",
-            (int)((state_list[state_index].interval - (millis() - time_start)) / 1000UL));
-        lcd.print(remaining);
-        lcd.print("s");
-      }
-      else
-      {
-        lcd.print(" ");
-        if (interval > 0)
-          lcd.print(state_list[state_index].name);
-        else
-          lcd.print("Ready");;
-
-        lcd.setCursor(0, 1);
-
-        if (interval > 0)
-          lcd.print(">Resume Settings");
-        else
-          lcd.print(">Start  Settings");
-      }
-      break;
-    case MenuMain::SETTINGS_MM:
-      lcd.clear();
-      if (state_running)
-      {
-        lcd.print(" ");
-        lcd.print(state_list[state_index].name);
-        lcd.setCursor(0, 1);
-        lcd.print(" Stop  >Settings");
-      }
-      else
-      {
-        lcd.print(" ");
-        if (interval > 0)
-          lcd.print(state_list[state_index].name);
-        else
-          lcd.print("Ready");;
-
-        lcd.setCursor(0, 1);
-
-        if (interval > 0)
-          lcd.print(" Resume>Settings");
-        else
-          lcd.print(" Start >Settings");
-      }
-      break;
-    /*
-
-    case MenuMain::END_MM
-    could be deleted because it should never reach this state
-    it's constrained in executeAction
-
-    */
-    case MenuMain::END_MM:
-      menu_main = 1;
-      update_menu_again = true;
-      break;
-    }
+    if (!settings_stores[r].load(&settings))
+      memset(&settings, 0, sizeof(settings));
+    failsafe_counters[r] = settings.failsafe_counter;
   }
-  else
+  status_journal.begin(addr.fs_journal, addr.crashes, sizeof(failsafe), failsafe_version);
+  if (!status_journal.read(&failsafe))
+    memset(&failsafe, 0, sizeof(failsafe));
+
+  for (uint8_t r = 0; r < reactor_count; r++)
   {
-    switch (menu_settings)
+    Sequencer &sequencer = reactors[r].sequencer;
+    crashed[r] = failsafe.statuses[r] != Reactor::kStopped
+      && failsafe.statuses[r] <= sequencer.length();
+    if (!crashed[r])
     {
-    /*
-
-    MenuSettings::BEGIN_MS
-    could maybe deleted
-
-    */
-    case MenuSettings::BEGIN_MS:
-      menu_settings = MenuSettings::COUNTER_MS - 2;
-      update_menu_again = true;
-      break;
-    case MenuSettings::RETURN_MS:
-      lcd.clear();
-      lcd.print(">Return");
-      break;
-    case MenuSettings::FILTRATION_MS:
-      menuSetting("Filtration",
-        state_list[StateIndex::FILTRATION].interval,
-        TimeSetting::MINUTE);
-      break;
-    case MenuSettings::GAS_JET_MS:
-      menuSetting("Gas-Jet",
-        state_list[StateIndex::GAS_JET].interval,
-        TimeSetting::MINUTE);
-      break;
-    case MenuSettings::PRESSURE_RELIEF_MS:
-      menuSetting("Pressure Relief",
-        state_list[StateIndex::PRESSURE_RELIEF].interval,
-        TimeSetting::MINUTE);
-      break;
-    case MenuSettings::WAITING_MS:
-      menuSetting("Waiting",
-        state_list[StateIndex::WAITING].interval,
-        TimeSetting::MINUTE);
-      break;
-    case MenuSettings::EEPROM_SAVE_MS:
-      lcd.clear();
-      lcd.print(">Save Settings");
-      break;
-    case MenuSettings::EEPROM_LOAD_MS:
-      lcd.clear();
-      lcd.print(">Load Settings");
-      break;
-    case MenuSettings::RESET_MS:
-      lcd.clear();
-      lcd.print(">Reset Cycles");
-      break;
-    case MenuSettings::FAILSAVE_MS:
-      lcd.clear();
-      lcd.print(">Crashes");
-      lcd.setCursor(0, 1);
-      lcd.print(failsafe.counter);
-      break;
-    /*
-
-    MenuSettings::END_MS
-    could maybe deleted
-
-    */
-    case MenuSettings::END_MS:
-      menu_settings = 1;
-      update_menu_again = true;
-      break;
+      SetStatus(r, Reactor::kStopped);
+      continue;
     }
+    crash = true;
+    sequencer.start(failsafe.statuses[r] - 1);
+    status_steps[r] = sequencer.index();
+    if (++failsafe.strikes[r] <= crash_resumes)
+      continue;
+    sequencer.next();
+    SetStatus(r, sequencer.step().resume + 1);
+    #ifdef DEBUG
+    Serial.print(F("reactor "));
+    Serial.print(r + 1);
+    Serial.println(F(": crashed in the same step again, skipped"));
+    #endif
+  }
+
+  if (!crash)
+    return true;
+  SaveStatus();
+  for (uint8_t r = 0; r < reactor_count; r++)
+  {
+    if (!crashed[r])
+      continue;
+    ReadSettings(r, settings);
+    settings.failsafe_counter = ++failsafe_counters[r];
+    settings_stores[r].commit(&settings);
   }
+  return false;
 }
 
-void executeAction(Action action)
+void SaveIntervalsToEEPROM(uint8_t r)
 {
   /*
-  Handling of the user inputs regarding the programm state
+  Keep the intervals of a reactor for the failsafe, only written if
+  changed
   */
-  if (menu_settings == -1)
+  LOOP_SECTION(PROFILE_EEPROM)
+  Sequencer &sequencer = reactors[r].sequencer;
+  StoredSettings settings;
+  ReadSettings(r, settings);
+  bool changed = false;
+  for (uint8_t i = 0; i < sequencer.settings(); i++)
   {
-    switch (menu_main)
+    uint32_t duration = step_durations[r][sequencer.settingStep(i)].ms();
+    if (settings.failsafe_intervals[i] != duration)
     {
-    case MenuMain::START_STOP_MM:
-      // Action: SELECT Start, SELECT Stop, LEFT/RIGHT menu_main
-      if (state_running && action == Action::SELECT)
-      {
-        state_running = false;
-
-        SetEEPROMStatus(0);
-
-        if (interval > 0)
-          interval = interval - (millis() - time_start);
-        else
-          interval = state_list[state_index].interval - (millis() - time_start);
-
-        // Turn off all relays
-        relay.channelCtrl(0);
-        #ifdef DEBUG
-        Serial.println("Relays all off.");
-        #endif
-      }
-      else if (!state_running && action == Action::SELECT)
-      {
-        state_running = true;
-        execute = true;
-      }
-      if (!state_running && action == Action::RIGHT) menu_main++;
-      break;
-    case MenuMain::SETTINGS_MM:
-      // Action: SELECT Settings, LEFT/RIGHT manu_main
-      if (action == Action::SELECT)
-      {
-        menu_settings = 1;
-        menu_main = 1;
-      }
-      if (action == Action::LEFT) menu_main--;
-      break;
-    default:
-      break;
+      settings.failsafe_intervals[i] = duration;
+      changed = true;
     }
   }
-  else
-  {
-    switch (menu_settings)
-    {
-    case MenuSettings::RETURN_MS:
-      // Action: SELECT Return to Main Menu, LEFT/RIGHT menu_settings
-      if (action == Action::SELECT) 
-      {
-        menu_settings = -1;
-        SaveIntervalsToEEPROM();
-      }
-      /*
-
-      Action::LEFT
-      set menu_settings to it's max value to go to the
-      last menu entry
-
-      */
-      if (action == Action::LEFT) menu_settings--;
-      if (action == Action::RIGHT) menu_settings++;
-      break;
-    case MenuSettings::EEPROM_SAVE_MS:
-      if (action == Action::SELECT) SettingsSave(); 
-      if (action == Action::LEFT) menu_settings--;
-      if (action == Action::RIGHT) menu_settings++;
-      break;
-    case MenuSettings::EEPROM_LOAD_MS:
-      if (action == Action::SELECT) SettingsLoad();
-      if (action == Action::LEFT) menu_settings--;
-      if (action == Action::RIGHT) menu_settings++;
-      break;
-    case MenuSettings::RESET_MS:
-      if (action == Action::SELECT) Reset();
-      if (action == Action::LEFT) menu_settings--;
-      if (action == Action::RIGHT) menu_settings++;
-      break;
-    case MenuSettings::FAILSAVE_MS:
-      if (action == Action::SELECT)
-      {
-        // Nothing will happen
-      };
-      if (action == Action::LEFT) menu_settings--;
-      if (action == Action::RIGHT) menu_settings = MenuSettings::RETURN_MS;
-      break;
-    default:
-      // Settings Menu: every time based setting
-      // Action: SELECT menu_settings_edit, LEFT/RIGHT menu_settings
-      if (menu_setting_edit && menu_setting_pos == 0 && action == Action::SELECT)
-      {
-        menu_setting_pos = 1;
-      }
-      else if (menu_setting_edit && menu_setting_pos == 1 && action == Action::SELECT)
-      {
-        menu_setting_pos = 0;
-        menu_setting_edit = false;
-      }
-      else if (!menu_setting_edit && action == Action::SELECT)
-      {
-        menu_setting_edit = true;
-      }
+  if (changed)
+    settings_stores[r].commit(&settings);
+}
 
-      int state_list_menu_index;
+// Defined with the menu tables below
+void OpenMain(uint8_t entry = MainEntries::START_STOP_ME);
+void OpenSettings(uint8_t entry = 0);
 
-      switch (menu_settings)
-      {
-        case MenuSettings::FILTRATION_MS:
-          state_list_menu_index = StateIndex::FILTRATION;
-          break;
+void Reset(uint8_t r)
+{
+  /*
+  Reset a reactor to the initial conditions except the timings
+  */
+  reactors[r].reset();
+  // Reset EEPROM to status 0
+  SetStatus(r, Reactor::kStopped);
+  SaveStatus();
+}
 
-        case MenuSettings::GAS_JET_MS:
-          state_list_menu_index = StateIndex::GAS_JET;
-          break;
+void menuSetting(const __FlashStringHelper *name, Duration time, TimeSetting time_setting)
+{
+  /*
+  Display time settings for given state on the LCD
 
-        case MenuSettings::PRESSURE_RELIEF_MS:
-          state_list_menu_index = StateIndex::PRESSURE_RELIEF;
-          break;
+  name:         Name of the setting which is displayed on the LCD
+  time:         Duration of the setting
+  time_setting: Specifies what's the first displayed value
+                TimeSetting::HOUR
+                TimeSetting::MINUTE
+  */
+  bool hours = (time_setting == TimeSetting::HOUR);
+
+  screen.print(menu_setting_edit ? ' ' : '>');
+  screen.print(name);
+  screen.setCursor(0, 1);
+
+  char *p = line;
+  *p++ = (menu_setting_edit && menu_setting_pos == 0) ? '>' : ' ';
+  p = FormatUnsigned(p, hours ? time.minutes() / 60UL : time.minutes(), 3, 2);
+  p = FormatText(p, hours ? F("h ") : F("min "));
+  *p++ = (menu_setting_edit && menu_setting_pos == 1) ? '>' : ' ';
+  p = FormatUnsigned(p, hours ? time.minutes() % 60UL : time.secondOfMinute(), 2, 2);
+  FormatText(p, hours ? F("min") : F("sec"));
+  screen.print(line);
+}
 
-        case MenuSettings::WAITING_MS:
-          state_list_menu_index = StateIndex::WAITING;
-          break;
-      }
+/*
 
-      if (menu_setting_edit && menu_setting_pos == 0 && action == Action::LEFT)
-      {
-        // decrease first time value
-        if ((menu_settings == MenuSettings::FILTRATION_MS
-        || menu_settings == MenuSettings::GAS_JET_MS
-        || menu_settings == MenuSettings::PRESSURE_RELIEF_MS
-        || menu_settings == MenuSettings::WAITING_MS)
-        && (state_list[state_list_menu_index].interval >= 1000UL * 60UL))
-          state_list[state_list_menu_index].interval -= 1000UL * 60UL;
-      }
-      else if (menu_setting_edit && menu_setting_pos == 0 && action == Action::RIGHT)
-      {
-        // increase first time value
-        if ((menu_settings == MenuSettings::FILTRATION_MS
-        || menu_settings == MenuSettings::GAS_JET_MS
-        || menu_settings == MenuSettings::PRESSURE_RELIEF_MS
-        || menu_settings == MenuSettings::WAITING_MS)
-        && (state_list[state_list_menu_index].interval + 1000UL * 60UL <= ULONG_MAX))
-          state_list[state_list_menu_index].interval += 1000UL * 60UL;
+Main menu: the step of the selected reactor and Start/Stop, Settings
 
-      }
-      else if (menu_setting_edit && menu_setting_pos == 1 && action == Action::LEFT)
-      {
-        // decrease second time value
-        if ((menu_settings == MenuSettings::FILTRATION_MS
-        || menu_settings == MenuSettings::GAS_JET_MS
-        || menu_settings == MenuSettings::PRESSURE_RELIEF_MS
-        || menu_settings == MenuSettings::WAITING_MS)
-        && (state_list[state_list_menu_index].interval >= 1000UL))
-          state_list[state_list_menu_index].interval -= 1000UL;
-      }
-      else if (menu_setting_edit && menu_setting_pos == 1 && action == Action::RIGHT)
-      {
-        // increase second time value
-        if ((menu_settings == MenuSettings::FILTRATION_MS
-        || menu_settings == MenuSettings::GAS_JET_MS
-        || menu_settings == MenuSettings::PRESSURE_RELIEF_MS
-        || menu_settings == MenuSettings::WAITING_MS)
-        && (state_list[state_list_menu_index].interval + 1000UL <= ULONG_MAX))
-          state_list[state_list_menu_index].interval += 1000UL;
-      }
-      else if (!menu_setting_edit && action == Action::LEFT)
-      {
-        menu_settings--;
-      }
-      else if (!menu_setting_edit && action == Action::RIGHT)
-      {
-        menu_settings++;
-      }
-      break;
-    }
+*/
+void RenderMain(uint8_t)
+{
+  Reactor &reactor = Selected();
+  uint8_t entry = menu.entry();
+  screen.print((entry == MainEntries::REACTOR_ME) ? '>' : ' ');
+  if (reactor_count > 1)
+  {
+    FormatUnsigned(line, selected + 1, 1);
+    screen.print(line);
+    screen.print(' ');
+  }
+  if (reactor.running() || reactor.paused())
+    screen.print(reactor.sequencer.name());
+  else
+    screen.print(F("Ready"));
+  screen.setCursor(0, 1);
+
+  char cursor = (entry == MainEntries::START_STOP_ME) ? '>' : ' ';
+  bool settings = (entry == MainEntries::SETTINGS_ME);
+  if (reactor.running() && settings)
+  {
+    screen.print(F(" Stop  >Settings"));
+  }
+  else if (reactor.running())
+  {
+    char *p = line;
+    *p++ = cursor;
+    p = FormatText(p, F("Stop "));
+    p = FormatSeconds(p, Remaining().ms(), 9);
+    FormatText(p, F("s"));
+    screen.print(line);
+  }
+  else
+  {
+    screen.print(cursor);
+    screen.print(reactor.paused() ? F("Resume") : F("Start "));
+    screen.print(settings ? '>' : ' ');
+    screen.print(F("Settings"));
   }
-  #ifdef DEBUG
-  SERIALDEBUG(menu_main)
-  SERIALDEBUG(menu_settings)
-  SERIALDEBUG(menu_setting_pos)
-  SERIALDEBUG(menu_setting_edit)
-  SERIALDEBUG(state_running)
-  SERIALDEBUG(time_start)
-  SERIALDEBUG(interval)
-  SERIALDEBUG(state_index)
-  SERIALDEBUG(action)
-  SERIALDEBUG(execute)
-  SERIALDEBUG_
-  #endif
 }
 
-void setup()
+uint8_t ReactorPositions()
 {
-  // Grove Button
-  pinMode(button_pin, INPUT);
-  pinMode(button_led_pin, OUTPUT);
-  digitalWrite(button_led_pin, button_led_state);
+  return (reactor_count > 1) ? 1 : 0;
+}
 
-  // Grove LCD
-  lcd.begin(16, 2);
-  lcd.setRGB(255, 255, 255);
-  lcd.print("Initialize...");
-  
-  // Grove Encoder
-  encoder = new ClickEncoder(ENCODER_PIN1, ENCODER_PIN2, -1, 4, LOW);
-  encoder->setDoubleClickEnabled(false);
-  encoder->setButtonHeldEnabled(false);
-  encoder->setAccelerationEnabled(true);
-  Timer1.initialize(1000);
-  Timer1.attachInterrupt(timerIsr); 
+void NextReactor(uint8_t)
+{
+  selected = (selected + 1) % reactor_count;
+}
+
+bool EditStartStop(uint8_t, int8_t direction, uint32_t)
+{
+  // Settings can't be reached while the cycle runs
+  return direction > 0 && Selected().running();
+}
 
+void Stop(uint8_t r)
+{
+  // Turn off all relays, what's left of the step is kept
+  reactors[r].stop(UptimeUs());
+  SetStatus(r, Reactor::kStopped);
+  SaveStatus();
   #ifdef DEBUG
-  Serial.begin(9600);
-  while (!Serial) {}
+  Serial.println(F("Relays all off."));
   #endif
+}
 
-  // Grove Relay
-  // Scan I2C device detect device address
-  uint8_t relay_old_address = relay.scanI2CDevice();
-  #ifdef DEBUG
-  Serial.print("relay old address: ");
-  Serial.println(relay_old_address);
-  //if ((0x00 == relay_old_address) || (0xff == relay_old_address))
-  //{
-  //  Serial.println("Grove Relay old address!");
-  //  while(1);
-  //}
+void StartStop(uint8_t)
+{
+  if (Selected().running())
+    Stop(selected);
+  else
+    Selected().start(UptimeUs());
+}
+
+void EnterSettings(uint8_t)
+{
+  OpenSettings();
+}
+
+/*
+
+Settings menu: one entry per step with STEP_SETTING and the EEPROM
+
+*/
+void ReturnToMain(uint8_t)
+{
+  OpenMain();
+  SaveIntervalsToEEPROM(selected);
+}
+
+uint8_t StepPositions()
+{
+  return Selected().sequencer.settings();
+}
+
+void RenderStep(uint8_t setting)
+{
+  Sequencer &sequencer = Selected().sequencer;
+  uint8_t step = sequencer.settingStep(setting);
+  menuSetting(sequencer.name(step), step_durations[selected][step], TimeSetting::MINUTE);
+}
+
+bool EditStep(uint8_t setting, int8_t direction, uint32_t amount)
+{
+  /*
+  Change the minutes or seconds of a step while it is edited
+  amount: ms to add or subtract, 0 for one minute or second
+  */
+  if (!menu_setting_edit)
+    return false;
+  Duration &duration = step_durations[selected][Selected().sequencer.settingStep(setting)];
+  if (!amount)
+    amount = (menu_setting_pos == 0) ? 1000UL * 60UL : 1000UL;
+  if (direction > 0)
+    duration += amount;
+  else
+    duration -= amount;
+  return true;
+}
+
+void SelectStep(uint8_t)
+{
+  // edit the minutes, then the seconds, then leave, each field starts slow
+  acceleration.reset();
+  if (!menu_setting_edit)
+  {
+    menu_setting_edit = true;
+  }
+  else if (menu_setting_pos == 0)
+  {
+    menu_setting_pos = 1;
+  }
+  else
+  {
+    menu_setting_pos = 0;
+    menu_setting_edit = false;
+  }
+}
+
+void SaveSettings(uint8_t)
+{
+  SettingsSave(selected);
+}
+
+void LoadSettings(uint8_t)
+{
+  SettingsLoad(selected);
+}
+
+void ResetCycles(uint8_t)
+{
+  Reset(selected);
+  OpenMain();
+  menu_setting_pos = 0;
+  menu_setting_edit = false;
+}
+
+void RenderCrashes(uint8_t)
+{
+  screen.setCursor(0, 1);
+  screen.print(failsafe_counters[selected]);
+}
+
+/*
+
+Crash log, a press on "Crashes" opens it. One position per record, the
+newest first: the reset cause and the loop section, then the reactor, its
+step and the longest loop pass in ms.
+
+*/
+void OpenCrashLog(uint8_t);
+void LeaveCrashLog(uint8_t);
+
+uint8_t CrashPositions()
+{
+  return forensics.count();
+}
+
+void RenderCrash(uint8_t age)
+{
+  CrashRecord record;
+  if (!forensics.record(age, record))
+    return;
+  char *p = line;
+  *p++ = '>';
+  p = FormatUnsigned(p, age + 1, 1);
+  *p++ = ' ';
+  p = FormatText(p, Forensics::causeName(record.cause));
+  *p++ = ' ';
+  *p = '\0';
+  screen.print(line);
+  screen.print(forensics.sectionName(record.section));
+  screen.setCursor(0, 1);
+
+  // " R8 S16 ^99999ms" at the most, the numbers of a stray record are
+  // capped so the row fits line
+  p = line;
+  if (record.reactor == Forensics::kNoReactor)
+  {
+    p = FormatText(p, F(" R- S-"));
+  }
+  else
+  {
+    p = FormatText(p, F(" R"));
+    p = FormatUnsigned(p, record.reactor < 9 ? record.reactor + 1 : 9, 1);
+    p = FormatText(p, F(" S"));
+    p = FormatUnsigned(p, record.step < 99 ? record.step + 1 : 99, 1);
+  }
+  p = FormatText(p, F(" ^"));
+  uint32_t longest_ms = record.longest_us / 1000UL;
+  p = FormatUnsigned(p, longest_ms < 99999UL ? longest_ms : 99999UL, 5);
+  FormatText(p, F("ms"));
+  screen.print(line);
+}
+
+#ifdef PROFILE
+/*
+
+Diagnostics, reached from the crash log
+
+*/
+void OpenDiagnostics(uint8_t);
+
+void RenderDiagnostics(uint8_t)
+{
+  // mean and max of one section in us
+  const Profiler::Section &section = profiler.section(diagnostics_section);
+  uint32_t mean = section.runs ? section.total / section.runs : 0;
+  screen.print((const __FlashStringHelper *) section.name);
+  screen.setCursor(0, 1);
+  char *p = FormatText(line, F("~"));
+  p = FormatUnsigned(p, mean / Profiler::kCountsPerUs, 6);
+  p = FormatText(p, F(" ^"));
+  FormatUnsigned(p, section.max / Profiler::kCountsPerUs, 7);
+  screen.print(line);
+}
+
+bool EditDiagnostics(uint8_t, int8_t direction, uint32_t)
+{
+  if (direction < 0 && diagnostics_section > 0)
+    diagnostics_section--;
+  if (direction > 0 && diagnostics_section + 1 < profiler.sections())
+    diagnostics_section++;
+  return true;
+}
+
+void LeaveDiagnostics(uint8_t);
+#endif
+
+const char label_return[] PROGMEM = "Return";
+const char label_save[] PROGMEM = "Save Settings";
+const char label_load[] PROGMEM = "Load Settings";
+const char label_reset[] PROGMEM = "Reset Cycles";
+const char label_crashes[] PROGMEM = "Crashes";
+const char label_diagnostics[] PROGMEM = "Diagnostics";
+
+// label, render, edit, action, count, positions
+const MenuEntry main_menu[] PROGMEM = {
+  {nullptr, RenderMain, nullptr, NextReactor, 0, ReactorPositions},
+  {nullptr, RenderMain, EditStartStop, StartStop, 1, nullptr},
+  {nullptr, RenderMain, nullptr, EnterSettings, 1, nullptr}
+};
+
+const MenuEntry settings_menu[] PROGMEM = {
+  {label_return, nullptr, nullptr, ReturnToMain, 1, nullptr},
+  {nullptr, RenderStep, EditStep, SelectStep, 0, StepPositions},
+  {label_save, nullptr, nullptr, SaveSettings, 1, nullptr},
+  {label_load, nullptr, nullptr, LoadSettings, 1, nullptr},
+  {label_reset, nullptr, nullptr, ResetCycles, 1, nullptr},
+  {label_crashes, RenderCrashes, nullptr, OpenCrashLog, 1, nullptr}
+};
+const uint8_t settings_crashes = sizeof(settings_menu) / sizeof(settings_menu[0]) - 1;
 
-  Serial.println("Start write address");
+const MenuEntry crash_menu[] PROGMEM = {
+  {nullptr, RenderCrash, nullptr, LeaveCrashLog, 0, CrashPositions},
+  #ifdef PROFILE
+  {label_diagnostics, nullptr, nullptr, OpenDiagnostics, 1, nullptr},
   #endif
-  relay.changeI2CAddress(relay_old_address, 0x11);
-  #ifdef DEBUG
-  Serial.println("End write address");
+  {label_return, nullptr, nullptr, LeaveCrashLog, 1, nullptr}
+};
+
+void OpenCrashLog(uint8_t)
+{
+  menu.open(crash_menu, sizeof(crash_menu) / sizeof(crash_menu[0]), true);
+}
+
+void LeaveCrashLog(uint8_t)
+{
+  OpenSettings(settings_crashes);
+}
+
+#ifdef PROFILE
+const MenuEntry diagnostics_menu[] PROGMEM = {
+  {nullptr, RenderDiagnostics, EditDiagnostics, LeaveDiagnostics, 1, nullptr}
+};
+
+void OpenDiagnostics(uint8_t)
+{
+  diagnostics_section = 0;
+  menu.open(diagnostics_menu, 1, false);
+}
+
+void LeaveDiagnostics(uint8_t)
+{
+  // dump all sections over serial
+  profiler.report(Serial);
+  OpenSettings(settings_crashes);
+}
+#endif
+
+void OpenMain(uint8_t entry)
+{
+  menu.open(main_menu, sizeof(main_menu) / sizeof(main_menu[0]), false, entry);
+}
+
+void OpenSettings(uint8_t entry)
+{
+  menu.open(settings_menu, sizeof(settings_menu) / sizeof(settings_menu[0]), true, entry);
+}
+
+#ifdef BENCH
+void BenchState()
+{
+  // Menu, edit and run state and the screen for the cycle counts
+  const MenuEntry *entries = menu.entries();
+  uint8_t shown = (entries == settings_menu) ? 1 : ((entries == crash_menu) ? 2 : 0);
+  uint8_t run = Selected().running() ? 1 : (Selected().paused() ? 2 : 0);
+  BenchScope::State(shown << 4 | menu_setting_edit << 3 | run,
+                    menu.entry() << 4 | (menu.position() & 0x0F));
+}
+#endif
 
-  // Read firmware  version
-  Serial.print("firmware version: ");
-  Serial.print("0x");
-  Serial.print(relay.getFirmwareVersion(), HEX);
-  Serial.println();
+void updateMenu() {
+  /*
+  Display the whole menu on the LCD
+  */
+  #ifdef BENCH
+  BenchState();
+  #endif
+  LOOP_SECTION(PROFILE_MENU)
+  // The menus don't share any text, redraw every cell
+  static const MenuEntry *layout = nullptr;
+  if (menu.entries() != layout)
+  {
+    screen.invalidate();
+    layout = menu.entries();
+  }
+
+  screen.clear();
+  menu.draw(screen);
+  if (relay_faults)
+  {
+    screen.setCursor(LcdFrame::kCols - 1, 0);
+    screen.print('!');
+  }
+}
+
+void executeAction(Action action, uint32_t amount = 0)
+{
+  /*
+  Handling of the user inputs regarding the programm state
+  amount: ms to add or subtract when a time setting is edited, 0 for one
+          minute or second
+  */
+  LOOP_SECTION(PROFILE_ACTION)
+  if (action == Action::SELECT)
+    menu.select();
+  else
+    menu.turn((action == Action::RIGHT) ? 1 : -1, amount);
+  #ifdef DEBUG
+  SERIALDEBUG(menu.entry())
+  SERIALDEBUG(menu.position())
+  SERIALDEBUG(menu_setting_pos)
+  SERIALDEBUG(menu_setting_edit)
+  SERIALDEBUG(selected)
+  SERIALDEBUG(Selected().running())
+  SERIALDEBUG(Remaining().ms())
+  SERIALDEBUG(Selected().paused())
+  SERIALDEBUG(Selected().sequencer.index())
+  SERIALDEBUG(action)
+  SERIALDEBUG_
   #endif
+}
 
-  // Initial Relay State Turned off
-  relay.channelCtrl(0);
+void RefreshTask()
+{
+  // Countdown of the running state, once per second
+  if (Selected().running())
+    updateMenu();
+}
 
-  // Setup Relays
-  strcpy(state_list[StateIndex::FILTRATION].name, "Filtration");
-  state_list[StateIndex::FILTRATION].relay_setting = CHANNLE1_BIT;
+void ButtonLedTask()
+{
+  // Grove Button LED breathing while a cycle runs
+  if (AnyRunning() && breath_mode)
+  {
+    digitalWrite(button_led_pin, button_led_state);
+    button_led_state = !button_led_state;
+  }
+  else
+  {
+    digitalWrite(button_led_pin, LOW);
+  }
+}
 
-  strcpy(state_list[StateIndex::CLOSE_ALL1].name, "Close All");
-  state_list[StateIndex::CLOSE_ALL1].interval = 2UL * 1000UL;
-  state_list[StateIndex::CLOSE_ALL1].relay_setting = 0;
+#ifdef MODBUS
+/*
 
-  strcpy(state_list[StateIndex::GAS_JET].name, "Gas-Jet");
-  state_list[StateIndex::GAS_JET].relay_setting = CHANNLE3_BIT;
+Modbus register map, one block of modbus_block addresses per reactor, the
+first reactor at 0. 32-bit values take two registers, high word first.
+
+Input registers (4)
+  +0     step index
+  +1     Reactor::status(), 0 while stopped
+  +2     0 stopped, 1 running, 2 paused
+  +3     relay mask
+  +4 +5  ms left of the step
+  +6 +7  crash counter
+  +8     number of step settings
+
+Holding registers (3, 6, 16)
+  +2i +2i+1  duration of step setting i in ms, only written while the
+             reactor doesn't run. The high half takes effect with the
+             low half, write both in one request or high before low.
+
+Coils (1, 5, 15)
+  +0  running, 1 starts or resumes, 0 stops
+  +1  1 resets the reactor, reads 0
+  +2  1 saves the settings, reads 0
+  +3  1 loads the settings while the reactor doesn't run, reads 0
 
-  strcpy(state_list[StateIndex::CLOSE_ALL2].name, "Close All");
-  state_list[StateIndex::CLOSE_ALL2].interval = 2UL * 1000UL;
-  state_list[StateIndex::CLOSE_ALL2].relay_setting = 0;
+*/
+const uint16_t modbus_block = 32;
+ModbusSlave modbus;
 
-  strcpy(state_list[StateIndex::PRESSURE_RELIEF].name, "Pressure Relief");
-  state_list[StateIndex::PRESSURE_RELIEF].relay_setting = CHANNLE2_BIT;
+enum ModbusCoils
+{
+  RUNNING_MC,
+  RESET_MC,
+  SAVE_MC,
+  LOAD_MC,
+  COUNT_MC
+};
 
-  strcpy(state_list[StateIndex::WAITING].name, "Waiting");
-  state_list[StateIndex::WAITING].relay_setting = 0;
+uint8_t ModbusReadInput(uint16_t address, uint16_t &value)
+{
+  uint16_t r = address / modbus_block;
+  if (r >= reactor_count)
+    return ModbusException::ILLEGAL_ADDRESS;
+  Reactor &reactor = reactors[r];
+  uint32_t remaining = reactor.remaining(UptimeUs()).ms();
+  switch (address % modbus_block)
+  {
+  case 0: value = reactor.sequencer.index(); break;
+  case 1: value = reactor.status(); break;
+  case 2: value = reactor.running() ? 1 : (reactor.paused() ? 2 : 0); break;
+  case 3: value = reactor.relays.mask(); break;
+  case 4: value = remaining >> 16; break;
+  case 5: value = remaining & 0xFFFF; break;
+  case 6: value = failsafe_counters[r] >> 16; break;
+  case 7: value = failsafe_counters[r] & 0xFFFF; break;
+  case 8: value = reactor.sequencer.settings(); break;
+  default: return ModbusException::ILLEGAL_ADDRESS;
+  }
+  return ModbusException::NONE;
+}
 
-  CalcEEPROMAdresses();
-  CheckFailsafe();
-  SettingsLoad();
-  updateMenu();
+Duration *ModbusSetting(uint16_t address)
+{
+  // nullptr if there is no setting at the address
+  uint16_t r = address / modbus_block;
+  uint8_t i = (address % modbus_block) / 2;
+  if (r >= reactor_count || i >= reactors[r].sequencer.settings())
+    return nullptr;
+  return &step_durations[r][reactors[r].sequencer.settingStep(i)];
+}
 
-  // Watchdog Timer 8 seconds
-  wdt_enable(WDTO_8S);
+uint8_t ModbusReadHolding(uint16_t address, uint16_t &value)
+{
+  Duration *duration = ModbusSetting(address);
+  if (!duration)
+    return ModbusException::ILLEGAL_ADDRESS;
+  value = (address % 2) ? duration->ms() & 0xFFFF : duration->ms() >> 16;
+  return ModbusException::NONE;
 }
 
-void loop()
+// the high half of a duration written last and its address
+const uint16_t modbus_no_latch = 0xFFFF;
+uint16_t modbus_latch_address = modbus_no_latch;
+uint16_t modbus_latch;
+
+uint8_t ModbusWriteHolding(uint16_t address, uint16_t value)
 {
-  if (update_menu_again)
+  /*
+  The high half of a duration is latched and the duration changes with
+  its low half, so the step never runs with the halves of two different
+  values. A low half without the high half before it keeps the high half
+  of the duration. The loop keeps the failsafe copy after the request.
+  */
+  Duration *duration = ModbusSetting(address);
+  if (!duration)
+    return ModbusException::ILLEGAL_ADDRESS;
+  if (reactors[address / modbus_block].running())
+    return ModbusException::DEVICE_BUSY;
+  if (address % 2 == 0)
   {
-    updateMenu();
-    update_menu_again = false;
+    modbus_latch_address = address;
+    modbus_latch = value;
+    return ModbusException::NONE;
   }
+  uint16_t high = duration->ms() >> 16;
+  if (modbus_latch_address == address - 1)
+    high = modbus_latch;
+  modbus_latch_address = modbus_no_latch;
+  *duration = Duration((uint32_t) high << 16 | value);
+  return ModbusException::NONE;
+}
 
-  // Grove Encoder
-  encoder_value += encoder->getValue();
-  if (encoder_value != encoder_last) {
-    if (encoder_value > encoder_last)
-    {
-      executeAction(Action::RIGHT);
-      updateMenu();
-    }
-    else if (encoder_value < encoder_last)
-    {
-      executeAction(Action::LEFT);
-      updateMenu();
-    }
-    encoder_last = encoder_value;
+uint8_t ModbusReadCoil(uint16_t address, bool &value)
+{
+  uint16_t r = address / modbus_block;
+  uint8_t coil = address % modbus_block;
+  if (r >= reactor_count || coil >= COUNT_MC)
+    return ModbusException::ILLEGAL_ADDRESS;
+  value = coil == RUNNING_MC && reactors[r].running();
+  return ModbusException::NONE;
+}
+
+uint8_t ModbusWriteCoil(uint16_t address, bool value)
+{
+  uint16_t r = address / modbus_block;
+  uint8_t coil = address % modbus_block;
+  if (r >= reactor_count || coil >= COUNT_MC)
+    return ModbusException::ILLEGAL_ADDRESS;
+  Reactor &reactor = reactors[r];
+  switch (coil)
+  {
+  case RUNNING_MC:
+    if (value && !reactor.running())
+      reactor.start(UptimeUs());
+    else if (!value && reactor.running())
+      Stop(r);
+    break;
+  case RESET_MC:
+    if (value)
+      Reset(r);
+    break;
+  case SAVE_MC:
+    if (value)
+      SettingsSave(r);
+    break;
+  case LOAD_MC:
+    if (value && reactor.running())
+      return ModbusException::DEVICE_BUSY;
+    if (value)
+      SettingsLoad(r);
+    break;
   }
+  return ModbusException::NONE;
+}
 
-  // Grove Button
-  uint8_t button_reading = digitalRead(button_pin);
-  if (button_reading != button_last_state)
-    last_debounce_time = millis();
-  
-  if ((millis() - last_debounce_time) > debounce_delay)
+const ModbusMap modbus_map PROGMEM = {
+  ModbusReadCoil, ModbusWriteCoil, ModbusReadInput, ModbusReadHolding, ModbusWriteHolding
+};
+
+void HandleModbus()
+{
+  /*
+  One request per pass at most, after a write the changed settings are
+  kept for the failsafe and the screen shows the new state
+  */
+  if (!modbus.poll(Serial, millis()))
+    return;
+  for (uint8_t r = 0; r < reactor_count; r++)
+    SaveIntervalsToEEPROM(r);
+  updateMenu();
+}
+#endif
+
+#ifdef TELEMETRY
+void SendCrashes()
+{
+  CrashRecord record;
+  for (uint8_t age = forensics.count(); age-- > 0;)
+    if (forensics.record(age, record))
+      telemetry.send(CRASH_TM, &record, sizeof(record));
+}
+
+void TelemetryTask()
+{
+  /*
+  Status of the next reactor, the loop statistics after the last one
+  */
+  static uint8_t r = 0;
+  Reactor &reactor = reactors[r];
+  StatusRecord status;
+  status.reactor = r;
+  status.step = reactor.sequencer.index();
+  status.relays = reactor.relays.mask();
+  status.status = reactor.status();
+  status.paused = reactor.paused();
+  status.remaining_ms = reactor.remaining(UptimeUs()).ms();
+  status.crashes = failsafe_counters[r];
+  status.uptime_ms = millis();
+  telemetry.send(STATUS_TM, &status, sizeof(status));
+  r = (r + 1) % reactor_count;
+  if (r)
+    return;
+
+  LoopRecord stats;
+  stats.passes = loop_passes;
+  stats.max_us = loop_max_us;
+  stats.dropped = telemetry.dropped();
+  stats.uptime_ms = millis();
+  telemetry.send(LOOP_TM, &stats, sizeof(stats));
+  loop_passes = 0;
+  loop_max_us = 0;
+}
+#endif
+
+#ifdef DEBUG
+void ReportTask()
+{
+  tasks.report(Serial);
+  forensics.report(Serial);
+  for (uint8_t r = 0; r < reactor_count; r++)
+    reactors[r].relays.report(Serial);
+  Serial.print(F("inputs: queue peak "));
+  Serial.print(inputs.peak());
+  Serial.print(F(", dropped "));
+  Serial.println(inputs.dropped());
+  FormatClock(line, millis());
+  Serial.print(F("uptime "));
+  Serial.print(line);
+  FormatMinSec(line, Remaining().ms());
+  Serial.print(F(", "));
+  Serial.print(Selected().sequencer.name());
+  Serial.print(F(" "));
+  Serial.print(line);
+  Serial.println(F(" left"));
+  Serial.print(F("memory: static "));
+  Serial.print(StaticRam());
+  Serial.print(F(" bytes, stack never reached "));
+  Serial.print(StackUnused());
+  Serial.println(F(" bytes"));
+  for (uint8_t r = 0; r < reactor_count; r++)
   {
-    if (button_reading != button_state)
+    Sequencer &sequencer = reactors[r].sequencer;
+    for (uint8_t i = 0; i < sequencer.length(); i++)
     {
-      button_state = button_reading;
-      if (button_state == LOW)
+      const Reactor::Stats &stats = *reactors[r].stats(i);
+      Serial.print(F("reactor "));
+      Serial.print(r + 1);
+      Serial.print(' ');
+      Serial.print(sequencer.name(i));
+      Serial.print(F(": transitions "));
+      Serial.print(stats.transitions);
+      Serial.print(F(", late mean "));
+      Serial.print(stats.transitions ? stats.late_total_us / stats.transitions : 0);
+      Serial.print(F(" us max "));
+      Serial.print(stats.late_max_us);
+      Serial.print(F(" us"));
+      #ifdef TMP_SENSOR
+      if (reactors[r].adaptive() && (sequencer.step(i).flags & STEP_ADAPTIVE))
       {
-        executeAction(Action::SELECT);
-        updateMenu();
-        if (state_running)
-          button_led_state = HIGH;
-        else
-          button_state = LOW;
-        button_led_fade_value = 0; // could maybe deleted
-        last_led_fade_time = millis();
+        Serial.print(F(", shortened "));
+        Serial.print(stats.shortened);
+        Serial.print(F(", extended "));
+        Serial.print(stats.extended);
       }
+      #endif
+      Serial.println();
     }
   }
-  button_last_state = button_reading;  
+  #ifdef TMP_SENSOR
+  Serial.print(F("tmp: "));
+  Serial.print(tmp_sensor.mbar());
+  Serial.print(F(" mbar, "));
+  Serial.print(tmp_sensor.samples());
+  Serial.println(F(" samples"));
+  #endif
+  SERIALDEBUG_
+}
+#endif
 
-  if (state_running)
+bool EditingTime()
+{
+  // A time setting is open for editing
+  return menu_setting_edit;
+}
+
+void TurnEncoder(int16_t detents, int32_t amount)
+{
+  /*
+  Apply the detents of one loop pass at once
+  detents: signed number of detents to move through the menu
+  amount:  accelerated change of the edited time setting in ms
+  */
+  if (EditingTime())
   {
-    // Grove Button LED
-    if (breath_mode)
+    if (amount != 0)
     {
-      if (millis() - last_led_fade_time > 700)
-      {
-        last_led_fade_time = millis();
-        digitalWrite(button_led_pin, button_led_state);
-        button_led_state = !button_led_state;
-      }
+      executeAction(amount > 0 ? Action::RIGHT : Action::LEFT,
+        amount > 0 ? amount : -amount);
+      updateMenu();
     }
-    // Next State only one time execution
-    if (execute)
+    return;
+  }
+  for (int16_t i = 0; i < abs(detents); i++)
+  {
+    executeAction(detents > 0 ? Action::RIGHT : Action::LEFT);
+    updateMenu();
+  }
+}
+
+void ButtonPressed()
+{
+  /*
+  The button was pushed down, it was stable for debounce_delay
+  */
+  executeAction(Action::SELECT);
+  updateMenu();
+  if (AnyRunning())
+    button_led_state = HIGH;
+  button_led_fade_value = 0; // could maybe deleted
+  // restart the breathing, switch the LED off right away when stopped
+  tasks.start(task_button_led, AnyRunning() ? button_led_breath_interval : 0);
+}
+
+#ifdef TRACE
+void TraceInput(const InputEvent &event)
+{
+  // Timed by the input interrupt
+  if (event.type == InputEventType::BUTTON_PRESS)
+    trace.press(event.time);
+  else if (event.type == InputEventType::BUTTON_RELEASE)
+    trace.release(event.time);
+  else
+    trace.turn(event.time, (event.type == InputEventType::ENCODER_RIGHT) ? 1 : -1);
+}
+
+void TracePhases()
+{
+  // Phase changes of the pass, once the relays are switched
+  uint32_t ms = millis();
+  for (uint8_t r = 0; r < reactor_count; r++)
+  {
+    Reactor &reactor = reactors[r];
+    uint8_t run = reactor.running() ? 1 : (reactor.paused() ? 2 : 0);
+    uint8_t step = reactor.sequencer.index();
+    uint8_t relays = reactor.relays.mask();
+    uint32_t phase = (uint32_t) run << 16 | (uint16_t) step << 8 | relays;
+    if (phase == traced_phases[r])
+      continue;
+    traced_phases[r] = phase;
+    trace.phase(ms, r, run, step, relays);
+  }
+}
+#endif
+
+void HandleInputs()
+{
+  /*
+  Grove Encoder and Button, everything queued since the last pass. The
+  detents before a press are summed up and applied in one go.
+  */
+  LOOP_SECTION(PROFILE_INPUT)
+  InputEvent event;
+  int16_t detents = 0;
+  int32_t amount = 0;
+  while (inputs.pop(event))
+  {
+    #ifdef TRACE
+    TraceInput(event);
+    #endif
+    if (event.type == InputEventType::ENCODER_LEFT
+      || event.type == InputEventType::ENCODER_RIGHT)
     {
-      execute = false;
-      time_start = millis();
-      relay.channelCtrl(state_list[state_index].relay_setting);
+      int8_t direction = (event.type == InputEventType::ENCODER_RIGHT) ? 1 : -1;
+      detents += direction;
+      amount += (int32_t) direction * acceleration.factor(event.time, direction)
+        * ((menu_setting_pos == 0) ? 60000L : 1000L);
+      continue;
     }
-    if ((interval > 0 && millis() - time_start >= interval)
-    || (interval == 0 && millis() - time_start >= state_list[state_index].interval))
+    TurnEncoder(detents, amount);
+    detents = 0;
+    amount = 0;
+    if (event.type == InputEventType::BUTTON_PRESS)
+      ButtonPressed();
+  }
+  TurnEncoder(detents, amount);
+  #ifdef TRACE
+  trace.endPass();
+  #endif
+}
+
+void setup()
+{
+  // A watchdog reset leaves the watchdog running, the bootloader already
+  // cleared the other flags
+  MCUSR = 0;
+  wdt_disable();
+
+  #ifdef PROFILE
+  // before the interrupts that are timed
+  profiler.begin();
+  for (uint8_t id = 0; id < PROFILE_SECTIONS; id++)
+    profiler.add((const char *) pgm_read_ptr(&section_names[id]));
+  profiler.calibrate();
+  Serial.begin(9600);
+  #endif
+
+  // Grove Button
+  pinMode(button_pin, INPUT);
+  pinMode(button_led_pin, OUTPUT);
+  digitalWrite(button_led_pin, button_led_state);
+
+  // Grove LCD
+  lcd.begin(16, 2);
+  lcd.setRGB(255, 255, 255);
+  screen.begin(lcd);
+  screen.print(F("Initialize..."));
+  screen.flushAll();
+  
+  // Grove Encoder and Button
+  inputs.begin(ENCODER_PIN1, ENCODER_PIN2, button_pin, debounce_delay);
+  #ifdef TMP_SENSOR
+  // converts on the compare match of the inputs
+  tmp_sensor.begin(tmp_pin);
+  #endif
+
+  #ifdef DEBUG
+  Serial.begin(9600);
+  while (!Serial) {}
+  #endif
+  #ifdef TRACE
+  Serial.begin(9600);
+  #endif
+
+  // Grove Relay
+  // A single board is moved to the address of its reactor, the boards of
+  // a bank keep theirs
+  ReactorConfig configs[reactor_count];
+  memcpy_P(configs, reactor_configs, sizeof(configs));
+  if (reactor_count == 1)
+  {
+    // Scan I2C device detect device address
+    uint8_t relay_old_address = relay.scanI2CDevice();
+    #ifdef DEBUG
+    Serial.print(F("relay old address: "));
+    Serial.println(relay_old_address);
+    //if ((0x00 == relay_old_address) || (0xff == relay_old_address))
+    //{
+    //  Serial.println(F("Grove Relay old address!"));
+    //  while(1);
+    //}
+
+    Serial.println(F("Start write address"));
+    #endif
+    relay.changeI2CAddress(relay_old_address, configs[0].address);
+    #ifdef DEBUG
+    Serial.println(F("End write address"));
+
+    // Read firmware  version
+    Serial.print(F("firmware version: "));
+    Serial.print(F("0x"));
+    Serial.print(relay.getFirmwareVersion(), HEX);
+    Serial.println();
+    #endif
+  }
+
+  // Initial Relay State Turned off, setup the programs
+  for (uint8_t r = 0; r < reactor_count; r++)
+  {
+    #ifdef DEBUG
+    Reactor::Stats *stats = step_stats[r];
+    #else
+    Reactor::Stats *stats = nullptr;
+    #endif
+    reactors[r].begin(configs[r].address, configs[r].program, configs[r].length,
+      step_durations[r], step_passes[r], stats, configs[r].policy);
+    reactors[r].relays.set(0);
+    reactors[r].relays.flush();
+  }
+
+  task_refresh = tasks.add(PSTR("refresh"), RefreshTask, 1000);
+  task_button_led = tasks.add(PSTR("button led"), ButtonLedTask, button_led_breath_interval);
+  task_toast = tasks.add(PSTR("toast"), ToastTask, 0);
+  tasks.add(PSTR("relay check"), RelayTask, relay_verify_interval);
+  tasks.add(PSTR("checkpoint"), CheckpointTask, checkpoint_check);
+  #ifdef TMP_SENSOR
+  tasks.add(PSTR("tmp"), SensorTask, tmp_interval);
+  #endif
+  #ifdef DEBUG
+  tasks.add(PSTR("report"), ReportTask, 60000);
+  #endif
+  #ifdef MODBUS
+  Serial.begin(115200);
+  modbus.begin(modbus_address, &modbus_map);
+  #endif
+  #ifdef TELEMETRY
+  // doesn't wait for a host, the records are dropped until one reads them
+  Serial.begin(115200);
+  tasks.add(PSTR("telemetry"), TelemetryTask, telemetry_interval);
+  #endif
+
+  CalcEEPROMAdresses();
+  forensics.begin(addr.crashes, section_names);
+  #ifdef DEBUG
+  forensics.report(Serial);
+  #endif
+  #ifdef TELEMETRY
+  SendCrashes();
+  #endif
+  CheckFailsafe();
+  for (uint8_t r = 0; r < reactor_count; r++)
+    LoadIntervals(r);
+  Notify(F("Settings Loaded"));
+  // the interrupted steps continue after their last checkpoint with the
+  // intervals they were running with
+  for (uint8_t r = 0; r < reactor_count; r++)
+    if (crashed[r])
+      reactors[r].resume(UptimeUs(), failsafe.progress[r] * checkpoint_interval);
+  OpenMain();
+  updateMenu();
+
+  // Watchdog Timer 8 seconds, the first timeout calls ISR(WDT_vect) and
+  // the next one resets
+  wdt_enable(WDTO_8S);
+  WDTCSR |= _BV(WDIE);
+}
+
+#ifdef IDLE_SLEEP
+bool Wanted()
+{
+  // Work that came in while asleep
+  if (inputs.pending())
+    return true;
+  #if defined(MODBUS) || defined(PROFILE) || defined(TRACE)
+  if (Serial.available() > 0)
+    return true;
+  #endif
+  return false;
+}
+
+uint32_t IdleTime()
+{
+  /*
+  ms until the next deadline: a task, the end of a step or max_idle. 0
+  while the LCD, a relay board or the serial port still has something to
+  send.
+  */
+  if (!lcd_synced || Wanted())
+    return 0;
+  for (uint8_t r = 0; r < reactor_count; r++)
+    if (reactors[r].relays.changed())
+      return 0;
+  #ifdef TELEMETRY
+  if (telemetry.pending())
+    return 0;
+  #endif
+  #ifdef MODBUS
+  if (modbus.busy())
+    return 0;
+  #endif
+  uint32_t wait = tasks.idle();
+  if (wait > max_idle)
+    wait = max_idle;
+  uint64_t now = UptimeUs();
+  for (uint8_t r = 0; r < reactor_count; r++)
+  {
+    uint32_t left = reactors[r].remaining(now).ms();
+    if (reactors[r].running() && left < wait)
+      wait = left;
+  }
+  return wait;
+}
+
+void Idle(uint32_t ms)
+{
+  /*
+  Sleep for ms in SLEEP_MODE_IDLE. Every interrupt wakes the CPU, the
+  Timer0 ones at least once per ms; it only stays awake for an input or a
+  byte on the serial port. The check and the sleep are atomic, sleep_cpu()
+  runs before an interrupt enabled by sei() can slip in between.
+  */
+  uint32_t start = millis();
+  set_sleep_mode(SLEEP_MODE_IDLE);
+  #ifndef __AVR__
+  // the simulator skips the interrupts up to it while nothing happens
+  sleep_deadline(start + ms);
+  #endif
+  while (millis() - start < ms)
+  {
+    cli();
+    if (Wanted())
     {
-      // start from the beginning if the max value is reached
-      if (state_index < sizeof(state_list)/sizeof(state_list[0]) - 1)
-        state_index++;
-      else
-        state_index = 0;
-
-      // Failsafe Start 
-      switch (state_index)
-      {
-        case StateIndex::FILTRATION:
-          SetEEPROMStatus(addr.fs_status_filtration);
-          EEPROM.put(addr.fs_status_filtration, true);
-          break;
-        case StateIndex::CLOSE_ALL1:
-          SetEEPROMStatus(addr.fs_status_gas_jet);
-          EEPROM.put(addr.fs_status_gas_jet, true);
-          break;
-        case StateIndex::GAS_JET:
-          SetEEPROMStatus(addr.fs_status_gas_jet);
-          EEPROM.put(addr.fs_status_gas_jet, true);
-          break;
-        case StateIndex::CLOSE_ALL2:
-          SetEEPROMStatus(addr.fs_status_pressure_relief);
-          EEPROM.put(addr.fs_status_pressure_relief, true);
-          break;
-        case StateIndex::PRESSURE_RELIEF:
-          SetEEPROMStatus(addr.fs_status_pressure_relief);
-          EEPROM.put(addr.fs_status_pressure_relief, true);
-          break;
-        case StateIndex::WAITING:
-          SetEEPROMStatus(addr.fs_status_waiting);
-          EEPROM.put(addr.fs_status_waiting, true);
-          break;
-      }
-      // Failsafe End
-
-      execute = true;
-      time_start = millis();
-      interval = 0;
-      #ifdef DEBUG
-      Serial.print("state_index: ");
-      Serial.println(state_index);
-      Serial.print("state name: ");
-      Serial.println(state_list[state_index].name);
-      #endif
+      sei();
+      return;
     }
-    if (millis() % 1000 == 0)
-      updateMenu();
+    sleep_enable();
+    sei();
+    sleep_cpu();
+    sleep_disable();
   }
-  else
+}
+#endif
+
+void Pass()
+{
+  /*
+  Everything that is due: inputs, steps, relays, tasks and the LCD
+  */
+  #ifdef BENCH
+  BenchState();
+  #endif
+  LOOP_SECTION(PROFILE_LOOP)
+  forensics.passStart();
+  #ifdef TELEMETRY
+  uint32_t pass_start = micros();
+  #endif
+  HandleInputs();
+  #ifdef MODBUS
+  HandleModbus();
+  #endif
+
+  // Steps that are over end within this pass, one failsafe record covers
+  // the changes of all reactors
+  uint64_t now = UptimeUs();
+  bool changed = false;
+  for (uint8_t r = 0; r < reactor_count; r++)
   {
-    digitalWrite(button_led_pin, LOW);
+    handled_reactor = r;
+    if (!reactors[r].update(now))
+      continue;
+    SetStatus(r, reactors[r].status());
+    changed = true;
+    #ifdef DEBUG
+    Serial.print(F("reactor "));
+    Serial.print(r + 1);
+    Serial.print(F(" step: "));
+    Serial.print(reactors[r].sequencer.index());
+    Serial.print(' ');
+    Serial.println(reactors[r].sequencer.name());
+    #endif
+    #ifdef TELEMETRY
+    StepRecord step;
+    step.reactor = r;
+    step.step = reactors[r].sequencer.index();
+    step.relays = reactors[r].relays.mask();
+    step.uptime_ms = now / 1000ULL;
+    telemetry.send(STEP_TM, &step, sizeof(step));
+    #endif
   }
+  // Changes of this pass in one transaction
+  FlushRelays();
+  // Failsafe, after switching, the EEPROM write would delay the relays
+  if (changed)
+    SaveStatus();
+  tasks.run();
+  #ifdef TRACE
+  TracePhases();
+  #endif
+
+  // Grove LCD, send what changed since the last frame
+  {
+    LOOP_SECTION(PROFILE_LCD)
+    lcd_synced = screen.flush();
+  }
+  #ifdef TRACE
+  if (lcd_synced)
+    trace.frame(millis(), screen.crc());
+  #endif
+
+  #if defined(PROFILE) || defined(TRACE)
+  // p for the profile, c for the crash records, t for the trace
+  int command = Serial.available() ? Serial.read() : -1;
+  #endif
+  #ifdef PROFILE
+  if (command == 'p')
+    profiler.report(Serial);
+  else if (command == 'c')
+    forensics.report(Serial);
+  #endif
+  #ifdef TRACE
+  if (command == 't')
+    trace.report(Serial);
+  #endif
+
+  #ifdef TELEMETRY
+  telemetry.pump(Serial);
+  loop_passes++;
+  uint32_t pass_us = micros() - pass_start;
+  if (pass_us > loop_max_us)
+    loop_max_us = pass_us;
+  #endif
 
   // Watchdog reset
-  wdt_reset();
+  {
+    LOOP_SECTION(PROFILE_WDT)
+    wdt_reset();
+  }
+  forensics.passEnd();
+}
+
+void loop()
+{
+  Pass();
+  #ifdef IDLE_SLEEP
+  Idle(IdleTime());
+  #endif
 }
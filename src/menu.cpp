@@ -0,0 +1,98 @@
+#include "menu.h"
+
+void Menu::open(const MenuEntry *entries, uint8_t length, bool wrap, uint8_t entry)
+{
+  table = entries;
+  this->length = length;
+  this->wrap = wrap;
+  current = entry < length ? entry : 0;
+  offset = 0;
+  if (length && count(current) == 0 && !move(1))
+    move(-1);
+}
+
+void Menu::load(uint8_t index, MenuEntry &entry) const
+{
+  memcpy_P(&entry, &table[index], sizeof(entry));
+}
+
+uint8_t Menu::count(uint8_t index) const
+{
+  MenuEntry entry;
+  load(index, entry);
+  return entry.positions ? entry.positions() : entry.count;
+}
+
+bool Menu::move(int8_t direction)
+{
+  // within an entry that stands for several positions
+  if (direction > 0 && offset + 1 < count(current))
+  {
+    offset++;
+    return true;
+  }
+  if (direction < 0 && offset > 0)
+  {
+    offset--;
+    return true;
+  }
+
+  uint8_t index = current;
+  for (uint8_t n = 0; n < length; n++)
+  {
+    if (direction > 0 && index + 1 < length)
+      index++;
+    else if (direction < 0 && index > 0)
+      index--;
+    else if (wrap)
+      index = (direction > 0) ? 0 : length - 1;
+    else
+      return false;
+
+    uint8_t positions = count(index);
+    if (positions)
+    {
+      current = index;
+      offset = (direction > 0) ? 0 : positions - 1;
+      return true;
+    }
+  }
+  return false;
+}
+
+void Menu::turn(int8_t direction, uint32_t amount)
+{
+  if (!length)
+    return;
+  MenuEntry entry;
+  load(current, entry);
+  if (entry.edit && entry.edit(offset, direction, amount))
+    return;
+  move(direction);
+}
+
+void Menu::select()
+{
+  if (!length)
+    return;
+  MenuEntry entry;
+  load(current, entry);
+  // the action may open another menu
+  if (entry.action)
+    entry.action(offset);
+}
+
+void Menu::draw(Print &out) const
+{
+  if (!length)
+    return;
+  MenuEntry entry;
+  load(current, entry);
+  if (entry.label)
+  {
+    out.print('>');
+    out.print((const __FlashStringHelper *) entry.label);
+  }
+  if (entry.render)
+    entry.render(offset);
+}
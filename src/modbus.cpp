@@ -0,0 +1,243 @@
+#include "modbus.h"
+#include "crc.h"
+
+namespace
+{
+  uint16_t Word(const uint8_t *data)
+  {
+    return (uint16_t) data[0] << 8 | data[1];
+  }
+
+  void PutWord(uint8_t *data, uint16_t value)
+  {
+    data[0] = value >> 8;
+    data[1] = value & 0xFF;
+  }
+}
+
+void ModbusSlave::begin(uint8_t address, const ModbusMap *map)
+{
+  this->address = address;
+  memcpy_P(&this->map, map, sizeof(ModbusMap));
+  length = 0;
+  discarding = false;
+  answer_length = 0;
+  answer_sent = 0;
+}
+
+uint16_t ModbusSlave::expected() const
+{
+  if (length < 2)
+    return 0;
+  uint8_t function = request[1];
+  if (function >= 1 && function <= 6)
+    return 8;
+  if (function == 15 || function == 16)
+    return length < 7 ? 0 : 9 + request[6];
+  // unknown, ends with the gap
+  return 0;
+}
+
+bool ModbusSlave::poll(Stream &port, uint32_t now)
+{
+  send(port);
+  if (answer_sent < answer_length)
+    return false;
+
+  bool wrote = false;
+  // the master went quiet in the middle of a request
+  if ((length || discarding) && now - last_byte >= kGap)
+  {
+    if (!discarding)
+      wrote = handle();
+    length = 0;
+    discarding = false;
+  }
+
+  for (uint8_t n = 0; n < kMaxBytesPerPoll && port.available() > 0; n++)
+  {
+    int c = port.read();
+    if (c < 0)
+      break;
+    last_byte = now;
+    if (discarding)
+      continue;
+    if (length == kMaxRequest)
+    {
+      // too long for us, skip the rest of it
+      bad++;
+      length = 0;
+      discarding = true;
+      continue;
+    }
+    request[length++] = c;
+    uint16_t size = expected();
+    if (size && length >= size)
+    {
+      // one request per call, its answer goes out first
+      wrote |= handle();
+      break;
+    }
+  }
+  send(port);
+  return wrote;
+}
+
+bool ModbusSlave::handle()
+{
+  uint8_t size = length;
+  length = 0;
+  if (size < 4)
+  {
+    bad++;
+    return false;
+  }
+  uint16_t crc = Crc16Modbus(request, size - 2);
+  if (request[size - 2] != (crc & 0xFF) || request[size - 1] != (crc >> 8))
+  {
+    bad++;
+    return false;
+  }
+  uint8_t target = request[0];
+  uint8_t function = request[1];
+  bool broadcast = target == 0;
+  // for another slave, or a read nobody would answer
+  if ((!broadcast && target != address)
+    || (broadcast && (function == 1 || function == 3 || function == 4)))
+    return false;
+
+  handled++;
+  answer[0] = address;
+  answer[1] = function;
+  bool wrote = false;
+  uint8_t exception = execute(size - 2, wrote);
+  if (broadcast)
+  {
+    answer_length = 0;
+    return wrote;
+  }
+  if (exception)
+  {
+    refused++;
+    answer[1] = function | 0x80;
+    answer[2] = exception;
+    reply(3);
+  }
+  return wrote;
+}
+
+uint8_t ModbusSlave::execute(uint8_t size, bool &wrote)
+{
+  uint8_t function = request[1];
+  uint16_t start = Word(request + 2);
+  uint16_t count = Word(request + 4);
+  switch (function)
+  {
+  case 1:
+  {
+    if (count < 1 || count > kMaxCoils)
+      return ModbusException::ILLEGAL_VALUE;
+    uint8_t bytes = (count + 7) / 8;
+    answer[2] = bytes;
+    memset(answer + 3, 0, bytes);
+    for (uint8_t i = 0; i < count; i++)
+    {
+      bool value;
+      uint8_t exception = map.readCoil(start + i, value);
+      if (exception)
+        return exception;
+      if (value)
+        answer[3 + i / 8] |= 1 << (i % 8);
+    }
+    reply(3 + bytes);
+    return ModbusException::NONE;
+  }
+  case 3:
+  case 4:
+  {
+    if (count < 1 || count > kMaxRegisters)
+      return ModbusException::ILLEGAL_VALUE;
+    answer[2] = 2 * count;
+    for (uint8_t i = 0; i < count; i++)
+    {
+      uint16_t value;
+      uint8_t exception = (function == 3)
+        ? map.readHolding(start + i, value)
+        : map.readInput(start + i, value);
+      if (exception)
+        return exception;
+      PutWord(answer + 3 + 2 * i, value);
+    }
+    reply(3 + 2 * count);
+    return ModbusException::NONE;
+  }
+  case 5:
+  case 6:
+  {
+    // count is the value
+    uint8_t exception;
+    if (function == 5)
+    {
+      if (count != 0xFF00 && count != 0x0000)
+        return ModbusException::ILLEGAL_VALUE;
+      exception = map.writeCoil(start, count == 0xFF00);
+    }
+    else
+    {
+      exception = map.writeHolding(start, count);
+    }
+    if (exception)
+      return exception;
+    wrote = true;
+    // the answer echoes the request
+    memcpy(answer + 2, request + 2, 4);
+    reply(6);
+    return ModbusException::NONE;
+  }
+  case 15:
+  case 16:
+  {
+    uint8_t bytes = request[6];
+    uint8_t limit = (function == 15) ? kMaxCoils : kMaxRegisters;
+    uint8_t needed = (function == 15) ? (count + 7) / 8 : 2 * count;
+    if (count < 1 || count > limit || bytes != needed || size != 7 + bytes)
+      return ModbusException::ILLEGAL_VALUE;
+    for (uint8_t i = 0; i < count; i++)
+    {
+      uint8_t exception = (function == 15)
+        ? map.writeCoil(start + i, request[7 + i / 8] & (1 << (i % 8)))
+        : map.writeHolding(start + i, Word(request + 7 + 2 * i));
+      if (exception)
+        return exception;
+      wrote = true;
+    }
+    memcpy(answer + 2, request + 2, 4);
+    reply(6);
+    return ModbusException::NONE;
+  }
+  default:
+    return ModbusException::ILLEGAL_FUNCTION;
+  }
+}
+
+void ModbusSlave::reply(uint8_t length)
+{
+  uint16_t crc = Crc16Modbus(answer, length);
+  answer[length] = crc & 0xFF;
+  answer[length + 1] = crc >> 8;
+  answer_length = length + 2;
+  answer_sent = 0;
+}
+
+void ModbusSlave::send(Stream &port)
+{
+  if (answer_sent >= answer_length)
+    return;
+  int room = port.availableForWrite();
+  if (room <= 0)
+    return;
+  uint8_t chunk = answer_length - answer_sent;
+  if (chunk > room)
+    chunk = room;
+  answer_sent += port.write(answer + answer_sent, chunk);
+}
@@ -0,0 +1,62 @@
+#include "pressure.h"
+
+void PressureSensor::begin(uint8_t pin)
+{
+  uint8_t channel = analogPinToChannel(pin - A0);
+  filter = 0;
+  count = 0;
+  // no digital input buffer on the analog pin
+  if (channel < 8)
+    DIDR0 |= _BV(channel);
+  else
+    DIDR2 |= _BV(channel - 8);
+  // AVcc reference, right adjusted
+  ADMUX = _BV(REFS0) | (channel & 0x07);
+  // start on Timer0 compare match A
+  ADCSRB = (channel & 0x08 ? _BV(MUX5) : 0) | _BV(ADTS1) | _BV(ADTS0);
+  // 16 MHz / 128 = 125 kHz ADC clock, auto trigger, interrupt
+  ADCSRA = _BV(ADEN) | _BV(ADATE) | _BV(ADIF) | _BV(ADIE)
+    | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);
+}
+
+void PressureSensor::sample(uint16_t counts)
+{
+  // the first sample seeds the filter, it doesn't ramp up from 0
+  if (!count)
+    filter = (uint32_t) counts << kFilterShift;
+  else
+    filter += counts - (filter >> kFilterShift);
+  count++;
+}
+
+uint32_t PressureSensor::read() const
+{
+  uint8_t sreg = SREG;
+  cli();
+  uint32_t value = filter;
+  SREG = sreg;
+  return value;
+}
+
+int16_t PressureSensor::mbar() const
+{
+  uint32_t value = read();
+  if (!samples() || value < ((uint32_t) kMinCounts << kFilterShift)
+    || value > ((uint32_t) kMaxCounts << kFilterShift))
+    return kNoPressure;
+  if (value < ((uint32_t) kZero << kFilterShift))
+    return 0;
+  // at most 2^18 * 1000, rounded
+  uint32_t scaled = (value - ((uint32_t) kZero << kFilterShift)) * kFullScale;
+  uint32_t span = (uint32_t) kSpan << kFilterShift;
+  return (scaled + span / 2) / span;
+}
+
+uint32_t PressureSensor::samples() const
+{
+  uint8_t sreg = SREG;
+  cli();
+  uint32_t value = count;
+  SREG = sreg;
+  return value;
+}
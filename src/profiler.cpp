@@ -0,0 +1,103 @@
+#include "profiler.h"
+
+volatile uint16_t Profiler::overflows = 0;
+
+void Profiler::begin()
+{
+  // Normal mode, clk/8
+  TCCR1A = 0;
+  TCCR1B = _BV(CS11);
+  TCNT1 = 0;
+  overflows = 0;
+  TIFR1 = _BV(TOV1);
+  TIMSK1 = _BV(TOIE1);
+}
+
+uint8_t Profiler::add(const char *name)
+{
+  Section &section = table[count];
+  memset(&section, 0, sizeof(section));
+  section.name = name;
+  return count++;
+}
+
+void Profiler::calibrate()
+{
+  // 64 empty sections, recorded like real ones into a section of their own
+  const uint8_t kRuns = 64;
+  uint8_t id = add(PSTR("overhead"));
+  uint32_t start = now();
+  for (uint8_t i = 0; i < kRuns; i++)
+  {
+    ProfileScope scope(*this, id);
+  }
+  empty = (now() - start) / kRuns;
+}
+
+uint32_t Profiler::now()
+{
+  uint8_t sreg = SREG;
+  cli();
+  uint16_t low = TCNT1;
+  uint16_t high = overflows;
+  // An overflow since interrupts were disabled is still pending. If the
+  // count is low, it happened before TCNT1 was read.
+  if ((TIFR1 & _BV(TOV1)) && low < 0x8000)
+    high++;
+  SREG = sreg;
+  return ((uint32_t) high << 16) | low;
+}
+
+void Profiler::record(uint8_t id, uint32_t counts)
+{
+  Section &section = table[id];
+  if (section.runs == 0 || counts < section.min)
+    section.min = counts;
+  if (counts > section.max)
+    section.max = counts;
+  section.total += counts;
+  section.runs++;
+
+  uint8_t bucket = 0;
+  while (bucket < kBuckets - 1 && (counts >> (bucket + 1)))
+    bucket++;
+  if (section.histogram[bucket] < 0xFFFF)
+    section.histogram[bucket]++;
+}
+
+void Profiler::reset()
+{
+  for (uint8_t id = 0; id < count; id++)
+  {
+    const char *name = table[id].name;
+    memset(&table[id], 0, sizeof(table[id]));
+    table[id].name = name;
+  }
+}
+
+void Profiler::report(Print &out) const
+{
+  for (uint8_t id = 0; id < count; id++)
+  {
+    const Section &section = table[id];
+    out.print((const __FlashStringHelper *) section.name);
+    out.print(F(": runs "));
+    out.print(section.runs);
+    out.print(F(", min "));
+    out.print(section.min / kCountsPerUs);
+    out.print(F(" us mean "));
+    out.print(section.runs ? (uint32_t) (section.total / section.runs) / kCountsPerUs : 0);
+    out.print(F(" us max "));
+    out.print(section.max / kCountsPerUs);
+    out.print(F(" us, log2 histogram"));
+    for (uint8_t bucket = 0; bucket < kBuckets; bucket++)
+    {
+      out.print(' ');
+      out.print(section.histogram[bucket]);
+    }
+    out.println();
+  }
+  out.print(F("overhead per section: "));
+  out.print(empty);
+  out.println(F(" counts of 0.5 us"));
+}
@@ -0,0 +1,53 @@
+#include "program.h"
+
+void Sequencer::begin(const Step *steps, uint8_t count, Duration *durations, uint8_t *passes)
+{
+  this->steps = steps;
+  this->count = count;
+  this->durations = durations;
+  this->passes = passes;
+  setting_count = 0;
+  for (uint8_t i = 0; i < count; i++)
+  {
+    Step entry = step(i);
+    durations[i] = entry.duration;
+    if (entry.flags & STEP_SETTING)
+      setting_count++;
+  }
+  start(0);
+}
+
+uint8_t Sequencer::settingStep(uint8_t setting) const
+{
+  for (uint8_t i = 0; i < count; i++)
+    if ((pgm_read_byte(&steps[i].flags) & STEP_SETTING) && setting-- == 0)
+      return i;
+  return count;
+}
+
+Step Sequencer::step(uint8_t index) const
+{
+  Step entry;
+  memcpy_P(&entry, &steps[index], sizeof(entry));
+  return entry;
+}
+
+void Sequencer::start(uint8_t index)
+{
+  current = index < count ? index : 0;
+  memset(passes, 0, count);
+}
+
+void Sequencer::next()
+{
+  Step entry = step(current);
+  if (passes[current] < entry.repeat)
+  {
+    passes[current]++;
+    current = entry.loop_to;
+    return;
+  }
+  // the block is done, it starts over the next time it is reached
+  passes[current] = 0;
+  current = (current + 1 < count) ? current + 1 : 0;
+}
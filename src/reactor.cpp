@@ -0,0 +1,136 @@
+#include "reactor.h"
+
+namespace
+{
+  // Time from now until end, 0 if it is over
+  Duration Left(uint64_t end, uint64_t now)
+  {
+    if (now >= end)
+      return Duration(0);
+    uint64_t left_ms = (end - now) / 1000ULL;
+    return Duration(left_ms < Duration::kMax ? left_ms : Duration::kMax);
+  }
+}
+
+void Reactor::begin(uint8_t address, const Step *program, uint8_t length, Duration *durations,
+  uint8_t *passes, Stats *stats, const AdaptivePolicy *policy)
+{
+  relays.begin(address);
+  sequencer.begin(program, length, durations, passes);
+  step_stats = stats;
+  if (step_stats)
+    memset(step_stats, 0, length * sizeof(Stats));
+  has_policy = policy != nullptr;
+  if (has_policy)
+    memcpy_P(&this->policy, policy, sizeof(AdaptivePolicy));
+}
+
+void Reactor::startPhase(Duration duration, uint64_t now)
+{
+  deadline = now + duration.ms() * 1000ULL;
+  changed = true;
+}
+
+void Reactor::start(uint64_t now)
+{
+  active = true;
+  startPhase(halted ? interval : sequencer.duration(), now);
+  halted = false;
+}
+
+void Reactor::stop(uint64_t now)
+{
+  // an extension beyond the duration isn't kept
+  if (active)
+    interval = Left(deadline, now);
+  halted = true;
+  active = false;
+  changed = false;
+  relays.set(0);
+}
+
+void Reactor::reset()
+{
+  active = false;
+  halted = false;
+  changed = false;
+  interval = 0;
+  sequencer.start(0);
+  relays.set(0);
+}
+
+void Reactor::resume(uint64_t now, Duration done)
+{
+  halted = false;
+  active = true;
+  startPhase(sequencer.duration() - done, now);
+}
+
+Duration Reactor::remaining(uint64_t now) const
+{
+  if (!active)
+    return interval;
+  return Left(stepEnd(now), now);
+}
+
+Duration Reactor::elapsed(uint64_t now) const
+{
+  // the step started its duration before the deadline, for a resumed step
+  // that is before the boot
+  return Duration((now + sequencer.duration().ms() * 1000ULL - deadline) / 1000ULL);
+}
+
+uint64_t Reactor::stepEnd(uint64_t now) const
+{
+  if (!has_policy || tmp == PressureSensor::kNoPressure
+    || !(sequencer.step().flags & STEP_ADAPTIVE))
+    return deadline;
+  // deadline is the end after the duration, the bounds count from the
+  // start, which lies before the boot for a resumed step
+  uint64_t duration = sequencer.duration().ms() * 1000ULL;
+  uint64_t since = now + duration - deadline;
+  uint64_t earliest = duration * policy.min_percent / 100U;
+  uint64_t latest = duration * policy.max_percent / 100U;
+  if ((uint16_t) tmp < policy.threshold)
+    return now + latest - since;
+  if (since < earliest)
+    return now + earliest - since;
+  return since < latest ? now : now + latest - since;
+}
+
+bool Reactor::update(uint64_t now)
+{
+  if (!active)
+    return false;
+  // Steps that are already over, like a 0 s one, end within this call
+  for (uint8_t n = 0; n < sequencer.length(); n++)
+  {
+    uint64_t end = stepEnd(now);
+    if (now < end)
+      break;
+    // How late the step ended, the next deadline doesn't depend on it
+    if (step_stats)
+    {
+      Stats &stats = step_stats[sequencer.index()];
+      uint32_t late = now - end;
+      stats.transitions++;
+      stats.late_total_us += late;
+      if (late > stats.late_max_us)
+        stats.late_max_us = late;
+      if (end < deadline)
+        stats.shortened++;
+      else if (end > deadline)
+        stats.extended++;
+    }
+
+    // the program starts over after the last step
+    sequencer.next();
+    deadline = end + sequencer.duration().ms() * 1000ULL;
+    changed = true;
+  }
+  if (!changed)
+    return false;
+  changed = false;
+  relays.set(sequencer.step().relay_mask);
+  return true;
+}
@@ -0,0 +1,143 @@
+#include "relay_driver.h"
+#include <Wire.h>
+#include <multi_channel_relay.h>
+
+void RelayDriver::begin(uint8_t address)
+{
+  this->address = address;
+  known = false;
+  pending = false;
+  failed = false;
+  readback = READBACK_UNKNOWN;
+  backoff = 0;
+}
+
+void RelayDriver::set(uint8_t mask)
+{
+  requests++;
+  // an earlier request of this loop pass is replaced, not sent
+  if (pending)
+    skipped++;
+  wanted = mask;
+  pending = true;
+}
+
+bool RelayDriver::flush()
+{
+  if (!pending)
+    return !failed;
+  // the mask stays pending until the backoff is over
+  if (waiting())
+    return false;
+  pending = false;
+  if (known && wanted == confirmed)
+  {
+    skipped++;
+    return true;
+  }
+  return commit();
+}
+
+bool RelayDriver::verify()
+{
+  if (waiting())
+    return false;
+  uint8_t state = 0;
+  bool answered = readback == READBACK_OFF || readBack(state);
+  if (readback != READBACK_OFF)
+  {
+    if (known && answered && state == confirmed)
+      return true;
+    verify_failures++;
+  }
+  // the next flush() writes the mask again, in its turn between the boards
+  known = false;
+  pending = true;
+  return answered && !failed;
+}
+
+bool RelayDriver::commit()
+{
+  bool acknowledged = true;
+  for (uint8_t attempt = 0; attempt <= kRetries; attempt++)
+  {
+    if (attempt)
+      retries++;
+    if (!send(wanted))
+    {
+      acknowledged = false;
+      verify_failures++;
+      continue;
+    }
+    if (readback == READBACK_OFF)
+      return confirm();
+    uint8_t state;
+    if (readBack(state) && state == wanted)
+    {
+      // 0 is what a board without a readback may answer as well
+      if (wanted)
+        readback = READBACK_ON;
+      return confirm();
+    }
+    verify_failures++;
+  }
+  if (acknowledged && readback == READBACK_UNKNOWN)
+  {
+    readback = READBACK_OFF;
+    return confirm();
+  }
+  // unknown until a later write or verify() gets through
+  known = false;
+  failed = true;
+  if (!backoff)
+    backoff = kBackoff;
+  else if (backoff < kMaxBackoff / 2)
+    backoff *= 2;
+  else
+    backoff = kMaxBackoff;
+  backoff_start = millis();
+  return false;
+}
+
+bool RelayDriver::confirm()
+{
+  confirmed = wanted;
+  known = true;
+  failed = false;
+  backoff = 0;
+  return true;
+}
+
+bool RelayDriver::send(uint8_t mask)
+{
+  writes++;
+  Wire.beginTransmission(address);
+  Wire.write(CMD_CHANNEL_CTRL);
+  Wire.write(mask);
+  return Wire.endTransmission() == 0;
+}
+
+bool RelayDriver::readBack(uint8_t &mask)
+{
+  if (Wire.requestFrom(address, (uint8_t) 1) != 1)
+    return false;
+  mask = Wire.read();
+  return true;
+}
+
+void RelayDriver::report(Print &out) const
+{
+  out.print(F("relay: requests "));
+  out.print(requests);
+  out.print(F(", writes "));
+  out.print(writes);
+  out.print(F(", skipped "));
+  out.print(skipped);
+  out.print(F(", retries "));
+  out.print(retries);
+  out.print(F(", verify failures "));
+  out.print(verify_failures);
+  if (!readable())
+    out.print(F(", no readback"));
+  out.println();
+}
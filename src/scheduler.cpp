@@ -0,0 +1,99 @@
+#include "scheduler.h"
+
+uint8_t Scheduler::add(const char *name, void (*run)(), uint32_t period)
+{
+  if (count == kMaxTasks)
+    return kNoTask;
+  uint8_t id = count++;
+  Task &task = tasks[id];
+  memset(&task, 0, sizeof(task));
+  task.name = name;
+  task.run = run;
+  task.period = period;
+  if (period > 0)
+    start(id, period);
+  return id;
+}
+
+void Scheduler::start(uint8_t id, uint32_t delay)
+{
+  if (id >= count)
+    return;
+  tasks[id].due = millis() + delay;
+  tasks[id].active = true;
+}
+
+void Scheduler::stop(uint8_t id)
+{
+  if (id >= count)
+    return;
+  tasks[id].active = false;
+}
+
+void Scheduler::run()
+{
+  for (uint8_t id = 0; id < count; id++)
+  {
+    Task &task = tasks[id];
+    if (!task.active)
+      continue;
+    uint32_t late = millis() - task.due;
+    // not due yet, the difference wrapped around
+    if ((int32_t) late < 0)
+      continue;
+
+    task.runs++;
+    task.jitter_sum += late;
+    if (late > task.jitter_max)
+      task.jitter_max = late;
+
+    if (task.period > 0)
+    {
+      // Skip the periods that were missed completely instead of running
+      // the task several times in a row
+      uint32_t missed = late / task.period;
+      task.overruns += missed;
+      task.due += (missed + 1) * task.period;
+    }
+    else
+    {
+      task.active = false;
+    }
+    task.run();
+  }
+}
+
+uint32_t Scheduler::idle() const
+{
+  uint32_t now = millis();
+  uint32_t wait = kNever;
+  for (uint8_t id = 0; id < count; id++)
+  {
+    const Task &task = tasks[id];
+    if (!task.active)
+      continue;
+    int32_t left = task.due - now;
+    if (left <= 0)
+      return 0;
+    if ((uint32_t) left < wait)
+      wait = left;
+  }
+  return wait;
+}
+
+void Scheduler::report(Print &out) const
+{
+  for (uint8_t id = 0; id < count; id++)
+  {
+    const Task &task = tasks[id];
+    out.print((const __FlashStringHelper *) task.name);
+    out.print(F(": runs "));
+    out.print(task.runs);
+    out.print(F(", jitter mean "));
+    out.print(task.runs ? task.jitter_sum / task.runs : 0);
+    out.print(F(" ms max "));
+    out.print(task.jitter_max);
+    out.print(F(" ms, overruns "));
+    out.println(task.overruns);
+  }
+}
@@ -0,0 +1,72 @@
+#include "settings_store.h"
+#include <EEPROM.h>
+
+void SettingsStore::begin(int address, uint8_t size, uint8_t version)
+{
+  start = address;
+  this->size = size;
+  this->version = version;
+  valid = false;
+}
+
+bool SettingsStore::read(uint8_t copy, uint8_t &seq, uint8_t *data) const
+{
+  uint8_t record[kMaxSize + 4];
+  int addr = start + copy * record_size();
+  for (uint8_t i = 0; i < record_size(); i++)
+    record[i] = EEPROM.read(addr + i);
+
+  uint16_t crc = record[size + 2] | (record[size + 3] << 8);
+  if (record[0] != version || Crc16(record, size + 2) != crc)
+    return false;
+  seq = record[1];
+  memcpy(data, record + 2, size);
+  return true;
+}
+
+bool SettingsStore::load(void *data)
+{
+  uint8_t a[kMaxSize];
+  uint8_t b[kMaxSize];
+  uint8_t seq_a, seq_b;
+  bool valid_a = read(0, seq_a, a);
+  bool valid_b = read(1, seq_b, b);
+
+  valid = valid_a || valid_b;
+  if (!valid)
+    return false;
+
+  // B wins if it is the only valid copy or the newer one
+  current = (!valid_a || (valid_b && (int8_t) (seq_b - seq_a) > 0)) ? 1 : 0;
+  sequence = current ? seq_b : seq_a;
+  memcpy(data, current ? b : a, size);
+  return true;
+}
+
+bool SettingsStore::reload(void *data) const
+{
+  uint8_t seq;
+  return valid && read(current, seq, (uint8_t *) data);
+}
+
+void SettingsStore::commit(const void *data)
+{
+  uint8_t record[kMaxSize + 4];
+  if (valid)
+  {
+    current ^= 1;
+    sequence++;
+  }
+  record[0] = version;
+  record[1] = sequence;
+  memcpy(record + 2, data, size);
+  uint16_t crc = Crc16(record, size + 2);
+  record[size + 2] = crc & 0xFF;
+  record[size + 3] = crc >> 8;
+
+  // The checksum goes last, a torn copy is never taken as valid
+  int addr = start + current * record_size();
+  for (uint8_t i = 0; i < record_size(); i++)
+    EEPROM.update(addr + i, record[i]);
+  valid = true;
+}
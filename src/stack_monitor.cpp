@@ -0,0 +1,66 @@
+#include "stack_monitor.h"
+
+#ifdef __AVR__
+
+// Set up by the linker: start and end of the static data, top of the RAM
+extern uint8_t __data_start;
+extern uint8_t _end;
+extern uint8_t __stack;
+
+// The pattern, a literal in the assembler below as well
+#define STACK_PAINT 0xC5
+#define STACK_STRING(x) #x
+#define STACK_LITERAL(x) STACK_STRING(x)
+
+static const uint8_t kPaint = STACK_PAINT;
+
+// Runs in .init1, before the stack pointer and r1 are set up, so it only
+// uses the registers it loads itself. A naked function may only hold
+// basic asm, without operands.
+void StackPaint() __attribute__((naked, used, section(".init1")));
+
+void StackPaint()
+{
+  __asm__ __volatile__(
+    "    ldi r30, lo8(_end)\n"
+    "    ldi r31, hi8(_end)\n"
+    "    ldi r24, " STACK_LITERAL(STACK_PAINT) "\n"
+    "    ldi r25, hi8(__stack)\n"
+    "    rjmp 2f\n"
+    "1:  st Z+, r24\n"
+    "2:  cpi r30, lo8(__stack)\n"
+    "    cpc r31, r25\n"
+    "    brlo 1b\n"
+    "    breq 1b\n");
+}
+
+uint16_t StackUnused()
+{
+  const uint8_t *p = &_end;
+  uint16_t count = 0;
+  while (p <= &__stack && *p == kPaint)
+  {
+    p++;
+    count++;
+  }
+  return count;
+}
+
+uint16_t StaticRam()
+{
+  return &_end - &__data_start;
+}
+
+#else
+
+uint16_t StackUnused()
+{
+  return 0;
+}
+
+uint16_t StaticRam()
+{
+  return 0;
+}
+
+#endif
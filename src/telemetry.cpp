@@ -0,0 +1,70 @@
+#include "telemetry.h"
+#include "crc.h"
+
+uint8_t CobsEncode(const uint8_t *data, uint8_t length, uint8_t *out)
+{
+  // code is where the distance to the next zero goes
+  uint8_t code = 0;
+  uint8_t n = 1;
+  for (uint8_t i = 0; i < length; i++)
+  {
+    if (data[i])
+      out[n++] = data[i];
+    if (!data[i] || n - code == 0xFF)
+    {
+      out[code] = n - code;
+      code = n++;
+    }
+  }
+  out[code] = n - code;
+  return n;
+}
+
+bool Telemetry::send(uint8_t type, const void *payload, uint8_t length)
+{
+  if (length > kMaxPayload)
+    return false;
+  uint8_t record[kMaxRecord];
+  record[0] = type;
+  record[1] = sequence++;
+  memcpy(record + 2, payload, length);
+  uint16_t crc = Crc16(record, length + 2);
+  record[length + 2] = crc & 0xFF;
+  record[length + 3] = crc >> 8;
+
+  uint8_t frame[kMaxFrame];
+  uint8_t size = CobsEncode(record, length + 4, frame);
+  frame[size++] = 0;
+  if (size > kBufferSize - used)
+  {
+    drops++;
+    return false;
+  }
+  for (uint8_t i = 0; i < size; i++)
+  {
+    buffer[head] = frame[i];
+    head = (head + 1) % kBufferSize;
+  }
+  used += size;
+  records++;
+  return true;
+}
+
+void Telemetry::pump(Print &out)
+{
+  while (used)
+  {
+    // the part up to the end of the buffer, the rest in the next round
+    uint8_t chunk = (tail + used > kBufferSize) ? kBufferSize - tail : used;
+    int room = out.availableForWrite();
+    if (room <= 0)
+      return;
+    if (chunk > room)
+      chunk = room;
+    size_t written = out.write(buffer + tail, chunk);
+    tail = (tail + written) % kBufferSize;
+    used -= written;
+    if (written < chunk)
+      return;
+  }
+}
@@ -0,0 +1,113 @@
+#include "trace.h"
+
+namespace
+{
+  const __FlashStringHelper *RunName(uint8_t run)
+  {
+    switch (run)
+    {
+    case 0: return F("stopped");
+    case 1: return F("running");
+    case 2: return F("paused");
+    }
+    return F("?");
+  }
+}
+
+void Trace::turn(uint32_t ms, int8_t direction)
+{
+  // a turn back or a full record starts another one
+  if (detents && ((detents > 0) != (direction > 0) || abs(detents) == 127))
+    endPass();
+  if (!detents)
+    turn_start = ms;
+  turn_end = ms;
+  detents += direction;
+  waiting = true;
+}
+
+void Trace::endPass()
+{
+  if (!detents)
+    return;
+  uint32_t span = turn_end - turn_start;
+  int8_t turned = detents;
+  detents = 0;
+  add(TRACE_TURN, turn_start, turned, span < 0xFFFF ? span : 0xFFFF);
+}
+
+void Trace::phase(uint32_t ms, uint8_t reactor, uint8_t run, uint8_t step, uint8_t relays)
+{
+  add(TRACE_PHASE, ms, reactor << 2 | run, step << 8 | relays);
+}
+
+void Trace::frame(uint32_t ms, uint16_t crc)
+{
+  if (!waiting)
+    return;
+  waiting = false;
+  add(TRACE_FRAME, ms, 0, crc);
+}
+
+void Trace::add(uint8_t type, uint32_t ms, int8_t arg, uint16_t value)
+{
+  // the detents came first
+  if (type != TRACE_TURN)
+    endPass();
+  TraceRecord &record = records[head];
+  record.ms = ms;
+  record.type = type;
+  record.arg = arg;
+  record.value = value;
+  head = (head + 1) % kRecords;
+  if (count < kRecords)
+    count++;
+  else
+    lost++;
+}
+
+void Trace::report(Print &out) const
+{
+  out.print(F("trace: "));
+  out.print(count);
+  out.print(F(" records, "));
+  out.print(lost);
+  out.print(F(" lost, at "));
+  out.print(millis());
+  out.println(F(" ms"));
+  for (uint8_t i = 0; i < count; i++)
+  {
+    const TraceRecord &record = records[(head + kRecords - count + i) % kRecords];
+    out.print(F("trace "));
+    out.print(record.ms);
+    switch (record.type)
+    {
+    case TRACE_TURN:
+      out.print(F(" turn "));
+      out.print(record.arg);
+      out.print(' ');
+      out.println(record.value);
+      break;
+    case TRACE_PRESS:
+      out.println(F(" press"));
+      break;
+    case TRACE_RELEASE:
+      out.println(F(" release"));
+      break;
+    case TRACE_PHASE:
+      out.print(F(" phase "));
+      out.print((record.arg >> 2) + 1);
+      out.print(' ');
+      out.print((record.value >> 8) + 1);
+      out.print(' ');
+      out.print(RunName(record.arg & 3));
+      out.print(F(" 0x"));
+      out.println(record.value & 0xFF, HEX);
+      break;
+    case TRACE_FRAME:
+      out.print(F(" frame 0x"));
+      out.println(record.value, HEX);
+      break;
+    }
+  }
+}
@@ -0,0 +1,11 @@
+#include "uptime.h"
+
+uint64_t UptimeUs()
+{
+  static uint32_t last_micros = 0;
+  static uint64_t uptime = 0;
+  uint32_t now = micros();
+  uptime += (uint32_t) (now - last_micros);
+  last_micros = now;
+  return uptime;
+}
@@ -0,0 +1,160 @@
+/*
+
+Encoder acceleration, see include/acceleration.h
+
+How many detents it takes to set typical step times. The turn is modelled
+as a user who spins while an hour or more is left, turns fast while ten
+units are left and slowly for the rest, without overshooting. Without the
+acceleration every detent was one minute or second, 480 for a waiting
+step of 8 h. The detents are then sent to the firmware at those times on
+the simulator, which has to show the target.
+
+*/
+
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include "acceleration.h"
+#include "sim.h"
+
+namespace
+{
+  // ms between the detents of a spin, a fast and a slow turn
+  const uint16_t kSpin = 30;
+  const uint16_t kFast = 70;
+  const uint16_t kSlow = 200;
+
+  struct Target
+  {
+    const char *name;
+    // minutes or seconds
+    uint16_t units;
+    bool minutes;
+    // most detents it may take
+    uint8_t budget;
+  };
+
+  const Target kTargets[] = {
+    {"filtration 5 min", 5, true, 5},
+    {"gas-jet 10 s", 10, false, 10},
+    {"pressure relief 45 s", 45, false, 15},
+    {"filtration 30 min", 30, true, 15},
+    {"waiting 8 h", 480, true, 25},
+    {"waiting 24 h", 1440, true, 40}
+  };
+
+  // Times in ms of the detents that turn to units, their number
+  uint16_t Plan(uint16_t units, uint32_t *times, uint16_t size)
+  {
+    Acceleration acceleration;
+    uint32_t time = 1000;
+    uint16_t left = units;
+    uint16_t count = 0;
+    while (left && count < size)
+    {
+      time += (left > 60) ? kSpin : (left > 10) ? kFast : kSlow;
+      uint8_t weight = acceleration.factor(time, 1);
+      TEST_ASSERT_LESS_OR_EQUAL(left, weight);
+      left -= weight;
+      times[count++] = time;
+    }
+    return count;
+  }
+}
+
+void test_weights()
+{
+  Acceleration acceleration;
+  TEST_ASSERT_EQUAL_UINT8(1, acceleration.factor(1000, 1));
+  TEST_ASSERT_EQUAL_UINT8(1, acceleration.factor(1100, 1));
+  TEST_ASSERT_EQUAL_UINT8(10, acceleration.factor(1199, 1));
+  TEST_ASSERT_EQUAL_UINT8(10, acceleration.factor(1239, 1));
+  TEST_ASSERT_EQUAL_UINT8(60, acceleration.factor(1278, 1));
+  // turning back starts slow
+  TEST_ASSERT_EQUAL_UINT8(1, acceleration.factor(1280, -1));
+  TEST_ASSERT_EQUAL_UINT8(60, acceleration.factor(1290, -1));
+  acceleration.reset();
+  TEST_ASSERT_EQUAL_UINT8(1, acceleration.factor(1300, -1));
+  // across the millis() wrap
+  TEST_ASSERT_EQUAL_UINT8(1, acceleration.factor(0xFFFFFFF0UL, 1));
+  TEST_ASSERT_EQUAL_UINT8(60, acceleration.factor(0x00000010UL, 1));
+}
+
+void test_detents_for_typical_values()
+{
+  uint32_t times[64];
+  for (const Target &target : kTargets)
+  {
+    uint16_t detents = Plan(target.units, times, 64);
+    char message[64];
+    snprintf(message, sizeof(message), "%s: %u detents", target.name, detents);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_LESS_OR_EQUAL_MESSAGE(target.budget, detents, message);
+  }
+}
+
+void test_firmware_reaches_target()
+{
+  // the planned detents, 12 ms of edges each, while the setting is edited
+  for (const Target &target : kTargets)
+  {
+    uint32_t times[64];
+    uint16_t detents = Plan(target.units, times, 64);
+    char script[4096];
+    char *p = script;
+    char *end = script + sizeof(script);
+    p += snprintf(p, end - p, R"(
+2s   turn 1                 # Settings
+3s   press
+4s   turn 1                 # Filtration
+5s   press                  # edit the minutes
+%s
+)", target.minutes ? "" : "6s   press                  # seconds");
+    for (uint16_t i = 0; i < detents; i++)
+      p += snprintf(p, end - p, "%lums turn 1\n", (unsigned long) (times[i] + 6000));
+    snprintf(p, end - p, "20s  lcd\n");
+
+    char report[4096];
+    int status = sim::run_script(script, "--duration 21s", report, sizeof(report));
+    if (status)
+      printf("%s", report);
+    TEST_ASSERT_EQUAL_MESSAGE(0, status, target.name);
+    // the cursor stands before the unit that is edited
+    char minutes[16], seconds[16];
+    snprintf(minutes, sizeof(minutes), "%3.2umin", target.minutes ? target.units : 0);
+    snprintf(seconds, sizeof(seconds), "%02usec", target.minutes ? 0 : target.units);
+    const char *row = strstr(report, minutes);
+    TEST_ASSERT_NOT_NULL_MESSAGE(row, target.name);
+    TEST_ASSERT_NOT_NULL_MESSAGE(strstr(row, seconds), target.name);
+  }
+}
+
+void test_press_starts_slow()
+{
+  // spinning the minutes and right after the press a detent of the
+  // seconds, 40 ms after the last minute
+  char report[4096];
+  int status = sim::run_script(R"(
+2s   turn 1                 # Settings
+3s   press
+4s   turn 1                 # Filtration
+5s   press                  # edit the minutes
+6s   turn 3 5ms             # 1 + 60 + 60 min
+6s080ms press               # seconds
+6s120ms turn 1 5ms
+7s   expect-lcd 1 " 121min >01sec"
+)", "--duration 8s", report, sizeof(report));
+  if (status)
+    printf("%s", report);
+  TEST_ASSERT_EQUAL(0, status);
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_weights);
+  RUN_TEST(test_detents_for_typical_values);
+  RUN_TEST(test_firmware_reaches_target);
+  RUN_TEST(test_press_starts_slow);
+  return UNITY_END();
+}
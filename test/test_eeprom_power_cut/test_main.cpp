@@ -0,0 +1,107 @@
+/*
+
+A settings save cut by a power loss at every EEPROM byte, see src/README.md
+
+The first save keeps a filtration of 5 min, the second one 7 min. The
+power goes off before the (n+1)th cell write of the second save, and
+after the boot the settings menu has to show one of the two records
+whole, never a mix or the defaults. The sweep ends with the first n that
+lets the save finish.
+
+*/
+
+#include <unity.h>
+#include <string.h>
+#include "sim.h"
+
+namespace
+{
+  const char kScript[] = R"(
+2s   turn 1                 # Settings
+3s   press
+4s   turn 1                 # Filtration
+5s   press
+6s   turn 1
+7s   turn 1
+8s   turn 1
+9s   turn 1
+10s  turn 1
+11s  press
+12s  press
+13s  turn 1
+13s200ms turn 1
+13s400ms turn 1
+13s600ms turn 1             # Save
+14s  press
+15s  expect-lcd 0 "Settings Saved"
+18s  turn -1
+18s200ms turn -1
+18s400ms turn -1
+18s600ms turn -1            # Filtration
+19s  press
+20s  turn 1
+21s  turn 1
+22s  press
+23s  press
+24s  turn 1
+24s200ms turn 1
+24s400ms turn 1
+24s600ms turn 1             # Save
+25s  cut-power-after-writes %d
+25s  press
+27s  reset                  # the same menu whether the cut came or not
+30s  turn 1                 # Settings
+31s  press
+32s  turn 1                 # Filtration
+33s  lcd
+)";
+
+  const char kOld[] = "|  05min  00sec  |";
+  const char kNew[] = "|  07min  00sec  |";
+
+  char report[4096];
+
+  // The filtration row after the boot, nullptr if the menu didn't get there
+  const char *Filtration(int writes)
+  {
+    char script[sizeof(kScript) + 16];
+    snprintf(script, sizeof(script), kScript, writes);
+    if (sim::run_script(script, "--duration 34s", report, sizeof(report)))
+    {
+      printf("%s", report);
+      return nullptr;
+    }
+    const char *row = strstr(report, "|>Filtration");
+    if (row)
+      row = strchr(row, '\n');
+    return row ? strchr(row, '|') : nullptr;
+  }
+}
+
+void test_save_is_atomic()
+{
+  int writes = 0;
+  for (;; writes++)
+  {
+    TEST_ASSERT_LESS_THAN_MESSAGE(64, writes, "the save never finished");
+    const char *row = Filtration(writes);
+    TEST_ASSERT_NOT_NULL_MESSAGE(row, "no settings menu after the power cut");
+    char message[64];
+    snprintf(message, sizeof(message), "power cut after %d writes", writes);
+    if (!strncmp(row, kNew, strlen(kNew)))
+      break;
+    TEST_ASSERT_EQUAL_MESSAGE(0, strncmp(row, kOld, strlen(kOld)), message);
+  }
+  // at least the record and its sequence number
+  TEST_ASSERT_GREATER_THAN(1, writes);
+  char message[64];
+  snprintf(message, sizeof(message), "the save takes %d cell writes", writes);
+  TEST_MESSAGE(message);
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_save_is_atomic);
+  return UNITY_END();
+}
@@ -0,0 +1,144 @@
+/*
+
+The printf-free formatter against snprintf, see include/format.h
+
+Every value up to 2^32 ms in steps of a prime, so all digit positions and
+remainders come up, and the values around the seconds, minutes and hours
+boundaries and the top of the range. The benchmark only compares the two
+on the host, on the AVR the division by a constant saves more.
+
+*/
+
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "format.h"
+
+namespace
+{
+  const uint32_t kStride = 997;
+
+  char ours[24];
+  char reference[24];
+
+  void Check(uint32_t ms)
+  {
+    uint32_t s = ms / 1000UL;
+
+    FormatClock(ours, ms);
+    snprintf(reference, sizeof(reference), "%02lu:%02lu:%02lu",
+             (unsigned long) (s / 3600UL), (unsigned long) (s / 60UL % 60UL),
+             (unsigned long) (s % 60UL));
+    TEST_ASSERT_EQUAL_STRING(reference, ours);
+
+    FormatMinSec(ours, ms);
+    snprintf(reference, sizeof(reference), "%02lu:%02lu", (unsigned long) (s / 60UL),
+             (unsigned long) (s % 60UL));
+    TEST_ASSERT_EQUAL_STRING(reference, ours);
+
+    FormatSeconds(ours, ms, 9);
+    snprintf(reference, sizeof(reference), "%9lu", (unsigned long) s);
+    TEST_ASSERT_EQUAL_STRING(reference, ours);
+
+    FormatUnsigned(ours, ms, 3, 2);
+    snprintf(reference, sizeof(reference), "%3.2lu", (unsigned long) ms);
+    TEST_ASSERT_EQUAL_STRING(reference, ours);
+
+    uint8_t digit;
+    TEST_ASSERT_EQUAL_UINT32(ms / 10UL, DivMod10(ms, digit));
+    TEST_ASSERT_EQUAL_UINT8(ms % 10UL, digit);
+  }
+
+  double Seconds()
+  {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+  }
+}
+
+void test_strided_range()
+{
+  uint32_t ms = 0;
+  do
+  {
+    Check(ms);
+    ms += kStride;
+  } while (ms >= kStride);
+  Check(0xFFFFFFFFUL);
+}
+
+void test_boundaries()
+{
+  const uint32_t kUnits[] = {10UL, 1000UL, 60000UL, 600000UL, 3600000UL, 36000000UL,
+                             360000000UL};
+  for (uint32_t unit : kUnits)
+    for (uint32_t n = unit; n <= 0xFFFFFFFFUL - unit && n / unit < 1000; n += unit)
+    {
+      Check(n - 1);
+      Check(n);
+      Check(n + 1);
+    }
+  for (uint32_t n = 0; n < 100000UL; n++)
+    Check(0xFFFFFFFFUL - n);
+}
+
+void test_widths()
+{
+  for (uint8_t width = 0; width <= 12; width++)
+    for (uint8_t digits = 1; digits <= 10; digits++)
+    {
+      const uint32_t kValues[] = {0, 7, 42, 999, 100000UL, 0xFFFFFFFFUL};
+      for (uint32_t value : kValues)
+      {
+        FormatUnsigned(ours, value, width, digits);
+        snprintf(reference, sizeof(reference), "%*.*lu", width, digits, (unsigned long) value);
+        TEST_ASSERT_EQUAL_STRING(reference, ours);
+      }
+    }
+}
+
+void test_benchmark()
+{
+  // the countdown of a running step and the clock of the report
+  const uint32_t kCalls = 2000000UL;
+  volatile char sink = 0;
+  double start = Seconds();
+  for (uint32_t i = 0; i < kCalls; i++)
+  {
+    uint32_t ms = i * 2147UL;
+    FormatMinSec(ours, ms);
+    FormatClock(ours, ms);
+    sink += ours[1];
+  }
+  double formatter = Seconds() - start;
+  start = Seconds();
+  for (uint32_t i = 0; i < kCalls; i++)
+  {
+    uint32_t ms = i * 2147UL;
+    uint32_t s = ms / 1000UL;
+    snprintf(reference, sizeof(reference), "%02lu:%02lu", (unsigned long) (s / 60UL),
+             (unsigned long) (s % 60UL));
+    snprintf(reference, sizeof(reference), "%02lu:%02lu:%02lu",
+             (unsigned long) (s / 3600UL), (unsigned long) (s / 60UL % 60UL),
+             (unsigned long) (s % 60UL));
+    sink += reference[1];
+  }
+  double printf_seconds = Seconds() - start;
+  char message[96];
+  snprintf(message, sizeof(message), "%.0f ns per countdown and clock, snprintf %.0f ns",
+           formatter * 1e9 / kCalls, printf_seconds * 1e9 / kCalls);
+  TEST_MESSAGE(message);
+  TEST_ASSERT_LESS_THAN_MESSAGE(printf_seconds, formatter, message);
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_strided_range);
+  RUN_TEST(test_boundaries);
+  RUN_TEST(test_widths);
+  RUN_TEST(test_benchmark);
+  return UNITY_END();
+}
@@ -0,0 +1,123 @@
+/*
+
+Bursts of encoder and button edges through the input queue, see
+include/inputs.h
+
+The settings menu has nine entries and wraps around, so after a burst of
+n detents it shows entry n mod 9 only if none was lost. loop() runs every
+--tick, a slow one lets several detents pile up in the queue. A time
+edited with a burst depends on the time stamps of the interrupt and not
+on when loop() took the events, also when millis() wraps in the middle of
+the burst.
+
+*/
+
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include "sim.h"
+
+namespace
+{
+  const char *const kEntries[] = {
+    ">Return", ">Filtration", ">Gas-Jet", ">Pressure Relief", ">Waiting",
+    ">Save Settings", ">Load Settings", ">Reset Cycles", ">Crashes"
+  };
+  const int kEntryCount = sizeof(kEntries) / sizeof(kEntries[0]);
+
+  char report[4096];
+
+  int Run(const char *script, const char *options)
+  {
+    int status = sim::run_script(script, options, report, sizeof(report));
+    if (status)
+      printf("%s", report);
+    return status;
+  }
+
+  // The second LCD row after a burst that edits the filtration minutes
+  void EditedRow(const char *options, char *row, size_t size)
+  {
+    const char kScript[] = R"(
+2s   turn 1                 # Settings
+3s   press
+4s   turn 1                 # Filtration
+5s   press                  # edit the minutes
+5s900ms turn 30 1500us
+7s   lcd
+)";
+    TEST_ASSERT_EQUAL(0, Run(kScript, options));
+    const char *frame = strstr(report, "|>Filtration");
+    if (!frame)
+      frame = strstr(report, "| Filtration");
+    TEST_ASSERT_NOT_NULL_MESSAGE(frame, "no filtration row");
+    frame = strchr(frame, '\n');
+    snprintf(row, size, "%.18s", strchr(frame, '|'));
+  }
+}
+
+void test_burst_navigation()
+{
+  const int kDetents[] = {1, 8, 15, 16, 17, 40, 100, -3, -16, -100};
+  const char *const kTicks[] = {"--tick 1ms", "--tick 20ms", "--tick 50ms"};
+  for (const char *tick : kTicks)
+    for (int detents : kDetents)
+    {
+      char script[256];
+      int entry = ((detents % kEntryCount) + kEntryCount) % kEntryCount;
+      // 6 ms per detent
+      snprintf(script, sizeof(script), R"(
+2s   turn 1                 # Settings
+3s   press
+4s   turn %d 1500us
+5s   expect-lcd 0 "%s"
+)", detents, kEntries[entry]);
+      char options[48];
+      snprintf(options, sizeof(options), "--duration 6s %s", tick);
+      char message[64];
+      snprintf(message, sizeof(message), "turn %d with %s", detents, tick);
+      TEST_ASSERT_EQUAL_MESSAGE(0, Run(script, options), message);
+    }
+}
+
+void test_press_after_burst()
+{
+  // the press comes while loop() still has the detents to handle, it
+  // acts on the entry they lead to
+  TEST_ASSERT_EQUAL(0, Run(R"(
+2s   turn 1                 # Settings
+3s   press
+4s   turn 5                 # Save, 60 ms of edges
+4s61ms press 0 100ms
+4s400ms expect-lcd 0 "Settings Saved"
+)", "--duration 5s --tick 80ms"));
+}
+
+void test_edit_independent_of_loop()
+{
+  char reference[32], row[32];
+  EditedRow("--duration 8s", reference, sizeof(reference));
+  // the first detent a minute, the other 29 accelerated
+  TEST_ASSERT_EQUAL_STRING("|>1741min  00sec |", reference);
+
+  const char *const kOptions[] = {
+    "--duration 8s --tick 40ms",
+    // millis() wraps at 6 s, within the burst
+    "--duration 8s --start 49d17h2m41s296ms",
+    "--duration 8s --start 49d17h2m41s296ms --tick 40ms"
+  };
+  for (const char *options : kOptions)
+  {
+    EditedRow(options, row, sizeof(row));
+    TEST_ASSERT_EQUAL_STRING_MESSAGE(reference, row, options);
+  }
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_burst_navigation);
+  RUN_TEST(test_press_after_burst);
+  RUN_TEST(test_edit_independent_of_loop);
+  return UNITY_END();
+}
@@ -0,0 +1,173 @@
+/*
+
+Walks every menu state the inputs can reach, see include/menu.h
+
+A state is what the LCD shows with the digits masked, so a countdown or
+an edited time stays one state. From the boot the walker tries a turn
+right, a turn left and a press on every state it hasn't seen, breadth
+first, each path replayed on the simulator from the start. Every state
+has to show something, every menu entry has to come up and every state
+has to lead back to the main menu.
+
+*/
+
+#include <unity.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "sim.h"
+
+namespace
+{
+  const char *const kInputs[] = {"turn 1", "turn -1", "press"};
+  const int kInputCount = sizeof(kInputs) / sizeof(kInputs[0]);
+  // no state may take a longer path from the boot
+  const size_t kMaxDepth = 16;
+
+  // a watchdog reset at the boot, so the crash log has an entry, the
+  // inputs start after it
+  const char kCrash[] = "100ms relay-stall 10s\n";
+
+  // what has to be shown in some state. The reactor in the first row is
+  // only selected with more than one.
+  const char *const kExpected[] = {
+    ">Start", ">Stop", ">Resume", ">Settings", ">Return", ">Filtration",
+    ">Gas-Jet", ">Pressure Relief", ">Waiting", ">Save Settings",
+    ">Load Settings", ">Reset Cycles", ">Crashes", "># WDT relay",
+    "/> ##min", "min >##sec"
+  };
+
+  struct State
+  {
+    std::string frame;
+    // the frame and the one after a press, the crash log and the settings
+    // both show a bare Return
+    std::string key;
+    // inputs from the boot, indices into kInputs
+    std::vector<int> path;
+    // the main menu can be reached from here
+    bool returns;
+    // the states after each of kInputs
+    std::vector<int> next;
+  };
+
+  // Both rows of the LCD after the path, digits masked
+  std::string Frame(const std::vector<int> &path)
+  {
+    // 2.5 s per input, a message is gone by then
+    std::string script = kCrash;
+    char line[48];
+    uint32_t ms = 12500;
+    for (int input : path)
+    {
+      snprintf(line, sizeof(line), "%lums %s\n", (unsigned long) ms, kInputs[input]);
+      script += line;
+      ms += 2500;
+    }
+    uint32_t end = ms - 100;
+    snprintf(line, sizeof(line), "%lums lcd\n", (unsigned long) end);
+    script += line;
+    char options[32];
+    snprintf(options, sizeof(options), "--duration %lums", (unsigned long) end + 1);
+
+    static char report[4096];
+    TEST_ASSERT_EQUAL(0, sim::run_script(script.c_str(), options, report, sizeof(report)));
+    const char *lcd = strstr(report, "] lcd\n");
+    TEST_ASSERT_NOT_NULL(lcd);
+    std::string frame;
+    for (int row = 0; row < 2; row++)
+    {
+      lcd = strchr(lcd, '|');
+      TEST_ASSERT_NOT_NULL(lcd);
+      const char *close = strchr(lcd + 1, '|');
+      frame.append(lcd + 1, close - lcd - 1);
+      frame += row ? "" : "/";
+      lcd = close + 1;
+    }
+    for (char &c : frame)
+      if (isdigit((unsigned char) c))
+        c = '#';
+    return frame;
+  }
+
+  std::string Key(const std::string &frame, std::vector<int> path)
+  {
+    path.push_back(2);
+    return frame + "|" + Frame(path);
+  }
+
+  bool MainMenu(const std::string &frame)
+  {
+    return frame.find("Settings") != std::string::npos
+      && (frame.find("Start") != std::string::npos || frame.find("Stop") != std::string::npos
+          || frame.find("Resume") != std::string::npos);
+  }
+}
+
+void test_walk_every_state()
+{
+  std::vector<State> states;
+  std::string frame = Frame({});
+  states.push_back({frame, Key(frame, {}), {}, false, {}});
+  for (size_t i = 0; i < states.size(); i++)
+  {
+    TEST_ASSERT_LESS_OR_EQUAL_MESSAGE(kMaxDepth, states[i].path.size(), states[i].frame.c_str());
+    for (int input = 0; input < kInputCount; input++)
+    {
+      std::vector<int> path = states[i].path;
+      path.push_back(input);
+      std::string frame = Frame(path);
+      std::string key = Key(frame, path);
+      size_t n = 0;
+      while (n < states.size() && states[n].key != key)
+        n++;
+      if (n == states.size())
+        states.push_back({frame, key, path, false, {}});
+      states[i].next.push_back(n);
+    }
+  }
+
+  char message[128];
+  for (const State &state : states)
+  {
+    snprintf(message, sizeof(message), "empty screen after %u inputs", (unsigned) state.path.size());
+    TEST_ASSERT_TRUE_MESSAGE(state.frame.find_first_not_of(" /") != std::string::npos, message);
+  }
+  for (const char *expected : kExpected)
+  {
+    bool found = false;
+    for (const State &state : states)
+      found = found || state.frame.find(expected) != std::string::npos;
+    snprintf(message, sizeof(message), "\"%s\" never shown", expected);
+    TEST_ASSERT_TRUE_MESSAGE(found, message);
+  }
+
+  // back to the main menu from everywhere
+  for (State &state : states)
+    state.returns = MainMenu(state.frame);
+  for (bool changed = true; changed;)
+  {
+    changed = false;
+    for (State &state : states)
+      for (int n : state.next)
+        if (!state.returns && states[n].returns)
+          changed = state.returns = true;
+  }
+  for (const State &state : states)
+  {
+    snprintf(message, sizeof(message), "no way back from \"%s\"", state.frame.c_str());
+    TEST_ASSERT_TRUE_MESSAGE(state.returns, message);
+  }
+
+  snprintf(message, sizeof(message), "%u states", (unsigned) states.size());
+  TEST_MESSAGE(message);
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_walk_every_state);
+  return UNITY_END();
+}
@@ -0,0 +1,94 @@
+/*
+
+Phase deadlines while a save is acknowledged, see src/README.md
+
+Settings can't be opened while the cycle runs, so the cycle is stopped
+a second before the end of the filtration, the settings are saved and
+the cycle resumes while "Settings Saved" is still shown. The same inputs
+without the save press are the reference: every relay switch has to come
+within 2 ms of its time there, the one under the message and the ones
+after it. The resume press can wait for a loop pass that redraws under
+the message, which moves the rest of the cycle by a millisecond.
+
+*/
+
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include "sim.h"
+
+namespace
+{
+  // 5 min filtration, 10 s gas-jet, 5 s pressure relief, started at 39 s
+  const uint32_t kSettings[] = {300, 10, 5};
+  const char kEvents[] = R"(
+5m38s       press           # Stop, a second of filtration left
+5m38s300ms  turn 1          # Settings
+5m38s600ms  press
+5m38s900ms  turn 5          # Save
+%s
+5m39s500ms  turn -5         # Return
+5m39s800ms  press
+5m40s100ms  press           # Resume
+%s
+)";
+
+  const int kSwitches = 8;
+  const uint32_t kSlackMs = 2;
+
+  struct Switch
+  {
+    uint32_t ms;
+    unsigned mask;
+  };
+
+  char report[8192];
+
+  // The relay changes of the -v log, their number or -1 if the run failed
+  int Run(const char *save, const char *expect, Switch *switches)
+  {
+    char script[4096];
+    sim::settings_script(script, sizeof(script), kSettings, 3);
+    size_t length = strlen(script);
+    snprintf(script + length, sizeof(script) - length, kEvents, save, expect);
+    if (sim::run_script(script, "--duration 6m30s -v", report, sizeof(report)))
+    {
+      printf("%s", report);
+      return -1;
+    }
+    int count = 0;
+    for (const char *line = report; line && count < kSwitches; line = strchr(line + 1, '\n'))
+    {
+      unsigned d, h, m, s, ms, mask;
+      if (sscanf(line, "\n[%ud %u:%u:%u.%u] relay 0x%x", &d, &h, &m, &s, &ms, &mask) == 6)
+        switches[count++] = {(((d * 24 + h) * 60 + m) * 60 + s) * 1000 + ms, mask};
+    }
+    return count;
+  }
+}
+
+void test_deadlines_under_message()
+{
+  Switch reference[kSwitches], saved[kSwitches];
+  int count = Run("", "", reference);
+  TEST_ASSERT_EQUAL(kSwitches, count);
+  TEST_ASSERT_EQUAL(kSwitches, Run("5m39s200ms  press", R"(
+5m39s450ms  expect-lcd 0 "Settings Saved"
+5m41s100ms  expect-lcd 0 "Settings Saved"
+)", saved));
+  for (int i = 0; i < count; i++)
+  {
+    char message[64];
+    snprintf(message, sizeof(message), "relay 0x%02x at %u ms, reference %u ms",
+             saved[i].mask, saved[i].ms, reference[i].ms);
+    TEST_ASSERT_EQUAL_MESSAGE(reference[i].mask, saved[i].mask, message);
+    TEST_ASSERT_UINT32_WITHIN_MESSAGE(kSlackMs, reference[i].ms, saved[i].ms, message);
+  }
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_deadlines_under_message);
+  return UNITY_END();
+}
@@ -0,0 +1,143 @@
+/*
+
+Scenarios of the whole firmware on the simulator, see src/README.md
+
+Every test runs a script with sim::run_script() in a child process, like
+the program of the native build would, and checks its expectations. The
+settings of most of them: 5 min filtration, 10 s gas-jet, 5 s pressure
+relief, a cycle of 319 s with the two close-all steps.
+
+*/
+
+#include <unity.h>
+#include <string.h>
+#include <time.h>
+#include "sim.h"
+
+namespace
+{
+  // filtration, gas-jet and pressure relief in s
+  const uint32_t kSettings[] = {300, 10, 5};
+
+  char report[4096];
+
+  int Run(const char *events, const char *options = "")
+  {
+    // the settings and the start, the filtration relay is on a second
+    // later
+    char script[4096];
+    uint32_t start = sim::settings_script(script, sizeof(script), kSettings, 3);
+    size_t length = strlen(script);
+    snprintf(script + length, sizeof(script) - length, "%lums expect-relay 0x01\n%s",
+             (unsigned long) start + 1000, events);
+    int status = sim::run_script(script, options, report, sizeof(report));
+    if (status)
+      printf("%s", report);
+    return status;
+  }
+
+  double WallSeconds()
+  {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+  }
+}
+
+void test_cycle()
+{
+  // filtration, close all, gas-jet, close all, pressure relief
+  TEST_ASSERT_EQUAL(0, Run(R"(
+5m39s   expect-relay 0x01
+5m41s   expect-relay 0x00
+5m45s   expect-relay 0x04
+5m53s   expect-relay 0x00
+5m56s   expect-relay 0x02
+5m59s   expect-relay 0x01
+)", "--duration 10m"));
+}
+
+void test_month()
+{
+  /*
+  A month of cycles runs in seconds: the sleeping firmware skips the
+  input interrupts that change nothing. The cycle doesn't drift, 30 days
+  later the steps switch at the same offset into the cycle.
+  */
+  double start = WallSeconds();
+  TEST_ASSERT_EQUAL(0, Run(R"(
+30d        expect-relay 0x01
+30d3m39s   expect-relay 0x04
+)", "--duration 30d5m --max-wakeups 60000"));
+  double seconds = WallSeconds() - start;
+  char message[64];
+  snprintf(message, sizeof(message), "a month took %.1f s", seconds);
+  TEST_MESSAGE(message);
+  TEST_ASSERT_LESS_THAN_MESSAGE(60.0, seconds, message);
+}
+
+void test_power_cycle_resumes()
+{
+  TEST_ASSERT_EQUAL(0, Run(R"(
+2h   reset
+2h5s expect-relay 0x01
+)", "--duration 3h"));
+}
+
+void test_crash_loop_skips_step()
+{
+  // the third reset without a checkpoint in between skips the filtration
+  TEST_ASSERT_EQUAL(0, Run(R"(
+1m   reset
+1m10s expect-relay 0x01
+2m   reset
+2m10s expect-relay 0x01
+3m   reset
+3m3s expect-relay 0x04
+)", "--duration 10m"));
+}
+
+void test_watchdog_record()
+{
+  TEST_ASSERT_EQUAL(0, Run(R"(
+1m   relay-stall 10s        # the relay check hangs
+1m20s expect-relay 0x01     # resumed after the reset
+1m21s press                 # Stop
+1m22s turn 1                # Settings
+1m23s press
+1m24s turn -1               # Crashes
+1m25s expect-lcd 0 ">Crashes"
+1m25s expect-lcd 1 "1"
+1m26s press                 # crash log
+1m27s expect-lcd 0 ">1 WDT relay"
+)", "--duration 2m"));
+}
+
+void test_relay_fault()
+{
+  // one message when the board stops answering, then a mark, the menu
+  // keeps working and the mark goes when the board is back
+  TEST_ASSERT_EQUAL(0, Run(R"(
+1m   relay-nack 20
+1m1s expect-lcd 0 "Relay Error"
+1m3s expect-lcd 0 " Filtration    !"
+1m4s press                  # Stop
+1m5s expect-lcd 1 ">Resume Settings"
+1m5s expect-lcd 0 " Filtration    !"
+1m6s press                  # Resume
+1m30s expect-lcd 0 " Filtration     "
+1m30s expect-relay 0x01
+)", "--duration 3m"));
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_cycle);
+  RUN_TEST(test_month);
+  RUN_TEST(test_power_cycle_resumes);
+  RUN_TEST(test_crash_loop_skips_step);
+  RUN_TEST(test_watchdog_record);
+  RUN_TEST(test_relay_fault);
+  return UNITY_END();
+}
@@ -0,0 +1,245 @@
+/*
+
+Step timing of a Reactor on its 64-bit microsecond clock, see
+include/reactor.h and include/duration.h
+
+The durations saturate instead of wrapping, and the elapsed time of two
+millis() readings stays right across the 49.7 day wrap. The reactor
+clock starts shortly before millis() would wrap, so every run crosses
+the 49.7 day mark. A million steps are ended with a random lateness and
+have to end exactly where the sum of their durations says, a stop and
+start at every step boundary may only lose the fraction of a millisecond
+that isn't kept. On the
+simulator the whole firmware runs a paused cycle across the wrap and
+counts down a step longer than 9 hours.
+
+*/
+
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "reactor.h"
+#include "sim.h"
+
+namespace
+{
+  const char name_a[] PROGMEM = "A";
+  const char name_b[] PROGMEM = "B";
+  const char name_c[] PROGMEM = "C";
+
+  // a block of two steps runs three times, then a step of 0 ms
+  const Step kProgram[] PROGMEM = {
+    // name, relays, default ms, flags, resume, loop to, repeat
+    {name_a, 0x01, 7, STEP_SETTING, 0, 0, 0},
+    {name_b, 0x04, 3, STEP_SETTING, 1, 0, 0},
+    {name_c, 0x02, 5, 0, 2, 1, 2},
+    {name_a, 0x00, 0, 0, 3, 0, 0}
+  };
+  const uint8_t kLength = sizeof(kProgram) / sizeof(kProgram[0]);
+
+  // 1 ms before millis() wraps, in us
+  const uint64_t kStart = 0x100000000ULL * 1000ULL - 1000ULL;
+
+  Duration durations[kLength];
+  uint8_t passes[kLength];
+  Reactor::Stats stats[kLength];
+  Reactor reactor;
+
+  // The steps of a cycle as the sequencer runs them, their number
+  uint8_t Follow(uint8_t *order, uint32_t &cycle_ms)
+  {
+    Sequencer sequencer;
+    uint8_t counters[kLength];
+    sequencer.begin(kProgram, kLength, durations, counters);
+    uint8_t steps = 0;
+    cycle_ms = 0;
+    do
+    {
+      order[steps++] = sequencer.index();
+      cycle_ms += sequencer.duration().ms();
+      sequencer.next();
+    } while (sequencer.index() != 0);
+    return steps;
+  }
+}
+
+void setUp()
+{
+  reactor.begin(0x11, kProgram, kLength, durations, passes, stats);
+  srand(1);
+}
+
+void test_duration_saturates()
+{
+  Duration most(Duration::kMax);
+  TEST_ASSERT_EQUAL_UINT32(Duration::kMax, (most + 1).ms());
+  TEST_ASSERT_EQUAL_UINT32(Duration::kMax, (most + most).ms());
+  TEST_ASSERT_EQUAL_UINT32(Duration::kMax, Duration(0xFFFFFFFFUL).ms());
+  TEST_ASSERT_EQUAL_UINT32(0, (Duration(5) - Duration(6)).ms());
+  TEST_ASSERT_EQUAL_UINT32(9999UL, most.minutes());
+  TEST_ASSERT_EQUAL_UINT8(59, most.secondOfMinute());
+}
+
+void test_elapsed_across_wrap()
+{
+  // every start within a minute of the wrap, every interval up to an hour
+  for (uint32_t since = 0xFFFFFFFFUL - 60000UL; since != 60000UL; since += 7)
+    for (uint32_t interval = 0; interval < 3600000UL; interval += 3599)
+      TEST_ASSERT_EQUAL_UINT32(interval, Duration::Elapsed(since, since + interval).ms());
+}
+
+void test_no_drift()
+{
+  // a million steps, every end noticed up to 1.5 ms late
+  const uint32_t kTransitions = 1000000UL;
+  uint8_t order[Sequencer::kMaxSteps];
+  uint32_t cycle_ms;
+  uint8_t steps = Follow(order, cycle_ms);
+
+  uint64_t now = kStart;
+  uint64_t end = kStart + durations[0].ms() * 1000ULL;
+  reactor.start(now);
+  reactor.update(now);
+  uint32_t transitions = 0;
+  uint8_t position = 0;
+  while (transitions < kTransitions)
+  {
+    now += 1 + rand() % 1500;
+    uint8_t before = reactor.sequencer.index();
+    reactor.update(now);
+    // the steps that ended in this call, 0 ms ones included
+    while (now >= end && transitions < kTransitions)
+    {
+      position = (position + 1) % steps;
+      end += durations[order[position]].ms() * 1000ULL;
+      transitions++;
+    }
+    if (reactor.sequencer.index() != before || transitions == kTransitions)
+    {
+      TEST_ASSERT_EQUAL_UINT8(order[position], reactor.sequencer.index());
+      TEST_ASSERT_EQUAL_UINT32((end - now) / 1000ULL, reactor.remaining(now).ms());
+    }
+  }
+  // whole cycles and the steps of the last one since the start
+  uint64_t expected = kStart + kTransitions / steps * cycle_ms * 1000ULL;
+  for (uint8_t i = 0; i <= kTransitions % steps; i++)
+    expected += durations[order[i]].ms() * 1000ULL;
+  TEST_ASSERT_TRUE(expected == end);
+  uint32_t counted = 0;
+  for (uint8_t i = 0; i < kLength; i++)
+    counted += stats[i].transitions;
+  TEST_ASSERT_EQUAL_UINT32(kTransitions, counted);
+}
+
+void test_pause_at_every_boundary()
+{
+  /*
+  One cycle with a stop at the end of step n, a pause of a few hours and
+  a start, for the stop just before, at and after the boundary. Every
+  step keeps its duration but for what the stop rounds off.
+  */
+  uint8_t order[Sequencer::kMaxSteps];
+  uint32_t cycle_ms;
+  uint8_t steps = Follow(order, cycle_ms);
+  const int32_t kOffsets[] = {-1000, -1, 0, 1, 999};
+  for (uint8_t n = 0; n < steps; n++)
+    for (int32_t offset : kOffsets)
+    {
+      setUp();
+      uint64_t now = kStart;
+      reactor.start(now);
+      reactor.update(now);
+      uint64_t boundary = kStart;
+      for (uint8_t i = 0; i <= n; i++)
+        boundary += durations[order[i]].ms() * 1000ULL;
+      uint64_t paused_us = 0;
+      bool stopped = false;
+      // step by step through the cycle in 250 us, the steps take ms
+      while (now - paused_us < kStart + cycle_ms * 1000ULL + 2000ULL)
+      {
+        if (!stopped && now >= boundary + offset)
+        {
+          reactor.stop(now);
+          stopped = true;
+          uint64_t pause = 3600000000ULL + rand() % 1000000;
+          paused_us += pause;
+          now += pause;
+          reactor.start(now);
+        }
+        reactor.update(now);
+        now += 250;
+      }
+      char message[48];
+      snprintf(message, sizeof(message), "stop at step %u %+d us", n, (int) offset);
+      // 2 ms into the second cycle, give or take the rounding
+      TEST_ASSERT_EQUAL_UINT8_MESSAGE(order[0], reactor.sequencer.index(), message);
+      TEST_ASSERT_UINT32_WITHIN_MESSAGE(1, 2, reactor.elapsed(now).ms(), message);
+    }
+}
+
+void test_firmware_across_wrap()
+{
+  // a cycle of the plant settings that crosses the wrap at 2m47s, paused
+  // across it and resumed 15 s later
+  char report[4096];
+  const uint32_t kSettings[] = {300, 10, 5};
+  char script[4096];
+  sim::settings_script(script, sizeof(script), kSettings, 3);
+  strcat(script, R"(
+40s  expect-relay 0x01
+2m40s press                 # Stop
+2m41s expect-relay 0x00
+2m55s press                 # Resume
+2m56s expect-relay 0x01
+5m53s900ms expect-relay 0x01
+5m54s200ms expect-relay 0x00
+5m56s200ms expect-relay 0x04
+11m16s expect-relay 0x04
+)");
+  int status = sim::run_script(script, "--start 49d17h --duration 12m", report, sizeof(report));
+  if (status)
+    printf("%s", report);
+  TEST_ASSERT_EQUAL(0, status);
+}
+
+void test_long_countdown()
+{
+  // 600 min of filtration, more seconds than an AVR int holds, the
+  // detents too slow to be accelerated
+  char script[16384] = R"(
+2s   turn 1                 # Settings
+3s   press
+4s   turn 1                 # Filtration
+5s   press
+)";
+  for (int i = 0; i < 600; i++)
+    snprintf(script + strlen(script), sizeof(script) - strlen(script),
+             "%ums turn 1\n", 6000 + i * 250);
+  strcat(script, R"(
+156s press                  # seconds
+157s press
+158s turn -1                # Return
+159s press
+160s press                  # Start
+161s500ms expect-lcd 1 ">Stop     35999s"
+2h500ms expect-lcd 1 ">Stop     28960s"
+)");
+  char report[4096];
+  int status = sim::run_script(script, "--duration 2h1m", report, sizeof(report));
+  if (status)
+    printf("%s", report);
+  TEST_ASSERT_EQUAL(0, status);
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_duration_saturates);
+  RUN_TEST(test_elapsed_across_wrap);
+  RUN_TEST(test_no_drift);
+  RUN_TEST(test_pause_at_every_boundary);
+  RUN_TEST(test_firmware_across_wrap);
+  RUN_TEST(test_long_countdown);
+  return UNITY_END();
+}